@@ -12,51 +12,341 @@ bool IsMostSignificantBitSet(ap_uint<bits> const &num) {
     return num.test(bits - 1);
 }
 
+// Number of bits needed to shift by any amount below the given width
+constexpr int ShiftBits(int bits) {
+    return hlslib::ConstLog2(bits - 1) + 1;
+}
+
 template <int bits>
-ap_uint<bits> DynamicRightShift(ap_uint<bits> num, ap_uint<hlslib::ConstLog2(bits)> const &shift_by) {
+ap_uint<bits> FullLeftShift(ap_uint<bits> num, ap_uint<ShiftBits(bits)> const &shift_by) {
 #pragma HLS INLINE
-    const auto kNumStages = hlslib::ConstLog2(bits);
-    for (int i = 0; i < kNumStages; ++i) {
+    for (int i = 0; i < ShiftBits(bits); ++i) {
 #pragma HLS UNROLL
-        num = shift_by.test(i) ? (num >> (1 << i)) : num;
+        num = shift_by.test(i) ? (num << (1 << i)) : num;
     }
     return num;
 }
 
 template <int bits>
-ap_uint<bits> DynamicLeftShift(ap_uint<bits> num, ap_uint<hlslib::ConstLog2(bits)> const &shift_by) {
+ap_uint<bits> FullRightShift(ap_uint<bits> num, ap_uint<ShiftBits(bits)> const &shift_by) {
 #pragma HLS INLINE
-    const auto kNumStages = hlslib::ConstLog2(bits);
-    for (int i = 0; i < kNumStages; ++i) {
+    for (int i = 0; i < ShiftBits(bits); ++i) {
 #pragma HLS UNROLL
-        num = shift_by.test(i) ? (num << (1 << i)) : num;
+        num = shift_by.test(i) ? (num >> (1 << i)) : num;
     }
     return num;
 }
 
+// Leading zero anticipation for x - y with x > y. Bit i of the indicator is set if bits i + 1 of x and y differ and
+// bits i are not x = 0, y = 1. Its leading one lies at the leading one of the difference or one position below it, so
+// the count is either exact or one short, and does not depend on the carry chain of the subtraction.
+template <int bits>
+ap_uint<ShiftBits(bits)> AnticipateLeadingZeros(ap_uint<bits> const &x, ap_uint<bits> const &y) {
+#pragma HLS INLINE
+    const ap_uint<bits> different = x ^ y;
+    const ap_uint<bits> borrow = ~x & y;
+    const ap_uint<bits - 1> indicator = (different >> 1) & ~borrow;
+    return indicator.countLeadingZeros();
+}
+
+// Builds a product from the top M + 1 bits of the product of two mantissas and the sum of their exponents
+PackedFloat NormalizeProduct(ap_uint<kMantissaBits + 1> const &_m_mantissa, Exponent const &exponent_sum,
+                             const bool sign) {
+#pragma HLS INLINE
+    // We need to shift the mantissa forward if the most significant bit is not set
+    const bool should_be_shifted = !IsMostSignificantBitSet(_m_mantissa);
+    const ap_uint<kMantissaBits> m_mantissa =
+        should_be_shifted ? _m_mantissa.range(kMantissaBits - 1, 0) : _m_mantissa.range(kMantissaBits, 1);
+    // If the most significant bit was 1, we're done. Otherwise subtract 1 due to the shift.
+    PackedFloat result;
+    result.SetMantissa(m_mantissa);
+    result.SetExponent(exponent_sum - should_be_shifted);
+    result.SetSign(sign);
+    return result;
+}
+
 PackedFloat Multiply(PackedFloat const &a, PackedFloat const &b) {
+#ifdef APFP_SHORT_PRODUCT
+    // Align the mantissas to the top of the multiplier, so that the high half of the product holds the result followed
+    // by guard bits absorbing the error of the short product
+    constexpr int kGuardBits = kBits - kMantissaBits - 1;
+    static_assert((1L << (kGuardBits - 1)) > KaratsubaHighError(kBits), "Not enough guard bits for the short product.");
+    const ap_uint<kBits> a_mantissa = ap_uint<kBits>(a.GetMantissa()) << (kBits - kMantissaBits);
+    const ap_uint<kBits> b_mantissa = ap_uint<kBits>(b.GetMantissa()) << (kBits - kMantissaBits);
+    const ap_uint<kMantissaBits + 1> _m_mantissa = KaratsubaHigh(a_mantissa, b_mantissa).range(kBits - 1, kGuardBits);
+#else
     // Pad mantissas to avoid passing awkward sizes to Karatsuba
     const ap_uint<kMantissaBits> a_mantissa = a.GetMantissa();
     const ap_uint<kMantissaBits> b_mantissa = b.GetMantissa();
     const ap_uint<kMantissaBits + 1> _m_mantissa =
         Karatsuba(a_mantissa, b_mantissa).range(2 * kMantissaBits - 1, kMantissaBits - 1);
-    // We need to shift the mantissa forward if the most significant bit is not set
-    const bool should_be_shifted = !IsMostSignificantBitSet(_m_mantissa);
-    const ap_uint<kMantissaBits> m_mantissa =
-        should_be_shifted ? _m_mantissa.range(kMantissaBits - 1, 0) : _m_mantissa.range(kMantissaBits, 1);
-    // Add up exponents. If the most significant bit was 1, we're done. Otherwise subtract 1 due to
-    // the shift.
-    const Exponent m_exponent = a.GetExponent() + b.GetExponent() - should_be_shifted;
+#endif
     // The sign is just the XOR of the existing signs
+    return NormalizeProduct(_m_mantissa, a.GetExponent() + b.GetExponent(), a.GetSignBit() != b.GetSignBit());
+}
+
+PackedFloat Square(PackedFloat const &a) {
+    // The full square is cheap enough that there is no need for a short product here
+    const ap_uint<kMantissaBits> a_mantissa = a.GetMantissa();
+    const ap_uint<kMantissaBits + 1> _m_mantissa =
+        KaratsubaSquare(a_mantissa).range(2 * kMantissaBits - 1, kMantissaBits - 1);
+    return NormalizeProduct(_m_mantissa, a.GetExponent() + a.GetExponent(), false);
+}
+
+// The reciprocal of the divisor's mantissa is seeded from a table indexed by its leading bits, then refined by
+// Newton-Raphson iterations that each double the number of correct bits
+constexpr int kReciprocalTableBits = 10;
+constexpr int kReciprocalSeedBits = kReciprocalTableBits + 2;  // Fractional bits of every table entry
+
+struct ReciprocalTable {
+    constexpr ReciprocalTable() : entries() {
+        for (int i = 0; i < (1 << kReciprocalTableBits); ++i) {
+            // Entry i covers mantissas in [1/2 + i/2^(t+1), 1/2 + (i+1)/2^(t+1)). Use the reciprocal of the upper end,
+            // so the seed never exceeds the reciprocal of any mantissa it covers.
+            const unsigned upper_end = (1 << kReciprocalTableBits) + i + 1;
+            entries[i] = (1 << (kReciprocalTableBits + 1 + kReciprocalSeedBits)) / upper_end;
+        }
+    }
+    unsigned entries[1 << kReciprocalTableBits];
+};
+
+constexpr ReciprocalTable kReciprocalTable{};
+
+// The seed is accurate to at least kReciprocalTableBits - 2 bits. Iterate until the square of the error is negligible
+// compared to the truncation error of a single iteration, which is less than 3 units in the last place.
+constexpr int ReciprocalIterations() {
+    int precision = kReciprocalTableBits - 2;
+    int iterations = 0;
+    while (precision < kMantissaBits + 4) {
+        precision *= 2;
+        ++iterations;
+    }
+    return iterations;
+}
+
+constexpr int kReciprocalIterations = ReciprocalIterations();
+static_assert(kMantissaBits + 2 <= kBits, "Reciprocal must fit into the operands of the multiplier.");
+
+// Returns floor(a * 2^M / b) for normalized mantissas a and b of M bits, which has either M or M + 1 significant bits
+ap_uint<kMantissaBits + 1> DivideMantissas(ap_uint<kMantissaBits> const &a, ap_uint<kMantissaBits> const &b) {
+#pragma HLS INLINE
+    // Approximates 2^(2M) / b from below, which lies in (2^M, 2^(M + 1)]
+    using Reciprocal = ap_uint<kMantissaBits + 2>;
+    using Product = ap_uint<2 * kMantissaBits + 2>;
+    const ap_uint<kReciprocalTableBits> index = b.range(kMantissaBits - 2, kMantissaBits - 1 - kReciprocalTableBits);
+    const Product two = Product(1) << (2 * kMantissaBits + 1);
+    Reciprocal r = Reciprocal(kReciprocalTable.entries[index]) << (kMantissaBits - kReciprocalSeedBits);
+DivideMantissas_Newton:
+    for (int i = 0; i < kReciprocalIterations; ++i) {
+#pragma HLS UNROLL
+        // r' = r * (2 - b * r). As long as b * r <= 1, this cannot exceed 1/b, and both truncations below only make
+        // r' smaller, so the reciprocal is approached from below.
+        const Product residual = PipelinedSub<2 * kMantissaBits + 2>(two, Karatsuba(b, r));
+        const ap_uint<kMantissaBits + 1> factor = residual.range(2 * kMantissaBits, kMantissaBits);
+        r = Karatsuba(r, factor).range(2 * kMantissaBits + 1, kMantissaBits);
+    }
+    // The reciprocal is less than 4 below 2^(2M) / b, so the estimated quotient is at most 4 below the exact one
+    const ap_uint<kMantissaBits + 1> estimate = Karatsuba(a, r).range(2 * kMantissaBits, kMantissaBits);
+    // The remainder a * 2^M - estimate * b is thus below 5b < 2^(M + 3), so only the low bits of both terms are needed
+    using Remainder = ap_uint<kMantissaBits + 3>;
+    Remainder dividend(0);
+    dividend.range(kMantissaBits + 2, kMantissaBits) = a.range(2, 0);
+    const Remainder product = Karatsuba(estimate, b).range(kMantissaBits + 2, 0);
+    const Remainder remainder = PipelinedSub<kMantissaBits + 3>(dividend, product);
+    // Compare against every multiple of b at once instead of correcting one step at a time
+    const Remainder b1 = b;
+    const Remainder b2 = b1 << 1;
+    const Remainder b3 = PipelinedAdd<kMantissaBits + 3>(b1, b2);
+    const Remainder b4 = b1 << 2;
+    const ap_uint<3> correction = ap_uint<3>(remainder >= b1) + ap_uint<3>(remainder >= b2) +
+                                  ap_uint<3>(remainder >= b3) + ap_uint<3>(remainder >= b4);
+    return PipelinedAdd<kMantissaBits + 1>(estimate, correction);
+}
+
+PackedFloat Divide(PackedFloat const &a, PackedFloat const &b) {
+    const ap_uint<kMantissaBits + 1> quotient = DivideMantissas(a.GetMantissa(), b.GetMantissa());
+    // The ratio of two mantissas in [1/2, 1) lies in (1/2, 2), so at most a single shift normalizes the quotient.
+    // Shifting out the least significant bit truncates, as required by round-toward-zero.
+    const bool should_be_shifted = IsMostSignificantBitSet(quotient);
+    const ap_uint<kMantissaBits> mantissa =
+        should_be_shifted ? quotient.range(kMantissaBits, 1) : quotient.range(kMantissaBits - 1, 0);
+    const Exponent exponent = a.GetExponent() - b.GetExponent() + should_be_shifted;
     PackedFloat result;
-    result.SetMantissa(m_mantissa);
-    result.SetExponent(m_exponent);
+    result.SetMantissa(mantissa);
+    result.SetExponent(exponent);
     result.SetSign(a.GetSignBit() != b.GetSignBit());
-    return result;
+    // There are no infinities, so division by zero flushes to zero like a zero dividend does
+    return (a.IsZero() || b.IsZero()) ? PackedFloat::Zero() : result;
+}
+
+PackedFloat Reciprocal(PackedFloat const &a) {
+#pragma HLS INLINE
+    return Divide(PackedFloat::One(), a);
+}
+
+// The inverse square root is seeded the same way, but the table is split in two halves for even and odd exponents,
+// as the exponent of the square root is halved
+constexpr int kInvSqrtTableBits = 10;
+constexpr int kInvSqrtSeedBits = kInvSqrtTableBits + 2;
+
+constexpr unsigned long FloorSqrt(const unsigned long x) {
+    unsigned long low = 0;
+    unsigned long high = (1ul << 32) - 1;
+    while (low < high) {
+        const unsigned long mid = (low + high + 1) / 2;
+        if (mid * mid <= x) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+struct InvSqrtTable {
+    constexpr InvSqrtTable() : entries() {
+        for (int odd = 0; odd < 2; ++odd) {
+            for (int i = 0; i < (1 << kInvSqrtTableBits); ++i) {
+                // Mantissas with an odd exponent are halved, so entry i covers [1/2 + i/2^(t+1), 1/2 + (i+1)/2^(t+1))
+                // or half of that. Like for the reciprocal, use the upper end of the interval.
+                const unsigned long upper_end = (1ul << kInvSqrtTableBits) + i + 1;
+                const unsigned long scaled = (1ul << (2 * kInvSqrtSeedBits + kInvSqrtTableBits + 1 + odd)) / upper_end;
+                entries[(odd << kInvSqrtTableBits) + i] = FloorSqrt(scaled);
+            }
+        }
+    }
+    unsigned entries[2 << kInvSqrtTableBits];
+};
+
+constexpr InvSqrtTable kInvSqrtTable{};
+
+// The seed is accurate to kInvSqrtTableBits bits. Every iteration squares the relative error and multiplies it by up
+// to 3/2, and as for the reciprocal, the final error must be dominated by the truncation of the last iteration.
+constexpr int InvSqrtIterations() {
+    int precision = kInvSqrtTableBits;
+    int iterations = 0;
+    while (precision < kMantissaBits + 4) {
+        precision = 2 * precision - 1;
+        ++iterations;
+    }
+    return iterations;
+}
+
+constexpr int kInvSqrtIterations = InvSqrtIterations();
+static_assert(kMantissaBits + 3 <= kBits, "Inverse square root must fit into the operands of the multiplier.");
+
+// Approximates 2^M / sqrt(t) from below, to within 5, for t = t_scaled / 2^(M + 1) in [1/4, 1). The result lies in
+// (2^M, 2^(M + 1)].
+ap_uint<kMantissaBits + 2> InvSqrtMantissa(ap_uint<kMantissaBits + 1> const &t_scaled) {
+#pragma HLS INLINE
+    using Root = ap_uint<kMantissaBits + 2>;
+    using Residual = ap_uint<kMantissaBits + 2>;
+    const bool odd = !IsMostSignificantBitSet(t_scaled);
+    const ap_uint<kInvSqrtTableBits> index =
+        odd ? t_scaled.range(kMantissaBits - 2, kMantissaBits - 1 - kInvSqrtTableBits)
+            : t_scaled.range(kMantissaBits - 1, kMantissaBits - kInvSqrtTableBits);
+    const Residual three = Residual(3) << kMantissaBits;
+    Root r = Root(kInvSqrtTable.entries[(ap_uint<kInvSqrtTableBits + 1>(odd) << kInvSqrtTableBits) | index])
+             << (kMantissaBits - kInvSqrtSeedBits);
+InvSqrtMantissa_Newton:
+    for (int i = 0; i < kInvSqrtIterations; ++i) {
+#pragma HLS UNROLL
+        // r' = r * (3 - t * r^2) / 2, which never exceeds 1/sqrt(t). Rounding t * r^2 up and everything else down keeps
+        // it that way in spite of the truncations.
+        using Square = ap_uint<kMantissaBits + 3>;
+        const Square r_squared_truncated = KaratsubaSquare(r).range(2 * kMantissaBits + 2, kMantissaBits);
+        const Square r_squared = PipelinedAdd<kMantissaBits + 3>(r_squared_truncated, 1);
+        const Residual t_r_squared_truncated =
+            Karatsuba(t_scaled, r_squared).range(2 * kMantissaBits + 2, kMantissaBits + 1);
+        const Residual t_r_squared = PipelinedAdd<kMantissaBits + 2>(t_r_squared_truncated, 1);
+        const Residual factor = PipelinedSub<kMantissaBits + 2>(three, t_r_squared);
+        r = Karatsuba(r, factor).range(2 * kMantissaBits + 2, kMantissaBits + 1);
+    }
+    return r;
+}
+
+// Maps x = m * 2^e to t * 2^(2k), where t = t_scaled / 2^(M + 1) lies in [1/4, 1), so that sqrt(x) = sqrt(t) * 2^k
+void SplitSquare(PackedFloat const &x, ap_uint<kMantissaBits + 1> &t_scaled, Exponent &k) {
+#pragma HLS INLINE
+    const Exponent e = x.GetExponent();
+    const bool odd = (e & 1) != 0;
+    t_scaled = odd ? ap_uint<kMantissaBits + 1>(x.GetMantissa()) : (ap_uint<kMantissaBits + 1>(x.GetMantissa()) << 1);
+    k = (e + 1) >> 1;
+}
+
+PackedFloat Sqrt(PackedFloat const &a) {
+    ap_uint<kMantissaBits + 1> t_scaled;
+    Exponent k;
+    SplitSquare(a, t_scaled, k);
+    // sqrt(t) = t / sqrt(t), scaled by 2^M. As t <= 1, the estimate is at most 5 below the exact root.
+    const ap_uint<kMantissaBits> estimate =
+        Karatsuba(t_scaled, InvSqrtMantissa(t_scaled)).range(2 * kMantissaBits, kMantissaBits + 1);
+    // The root s must satisfy s^2 <= t * 2^(2M). The remainder t * 2^(2M) - estimate^2 is below 12 * 2^M + 36, so only
+    // the low bits of both terms are needed.
+    using Remainder = ap_uint<kMantissaBits + 5>;
+    Remainder square(0);
+    square.range(kMantissaBits + 4, kMantissaBits - 1) = t_scaled.range(5, 0);
+    const Remainder remainder =
+        PipelinedSub<kMantissaBits + 5>(square, KaratsubaSquare(estimate).range(kMantissaBits + 4, 0));
+    // (s + j)^2 - s^2 = 2js + j^2. Compare against all of them at once.
+    const Remainder s2 = Remainder(estimate) << 1;
+    const Remainder s4 = Remainder(estimate) << 2;
+    const Remainder s8 = Remainder(estimate) << 3;
+    const Remainder s6 = PipelinedAdd<kMantissaBits + 5>(s2, s4);
+    const Remainder s10 = PipelinedAdd<kMantissaBits + 5>(s2, s8);
+    const ap_uint<3> correction = ap_uint<3>(remainder >= PipelinedAdd<kMantissaBits + 5>(s2, 1)) +
+                                  ap_uint<3>(remainder >= PipelinedAdd<kMantissaBits + 5>(s4, 4)) +
+                                  ap_uint<3>(remainder >= PipelinedAdd<kMantissaBits + 5>(s6, 9)) +
+                                  ap_uint<3>(remainder >= PipelinedAdd<kMantissaBits + 5>(s8, 16)) +
+                                  ap_uint<3>(remainder >= PipelinedAdd<kMantissaBits + 5>(s10, 25));
+    PackedFloat result;
+    result.SetMantissa(PipelinedAdd<kMantissaBits>(estimate, correction));
+    result.SetExponent(k);
+    result.SetSign(false);
+    // There are no NaNs, so negative numbers flush to zero
+    return (a.IsZero() || a.GetSignBit()) ? PackedFloat::Zero() : result;
+}
+
+PackedFloat InvSqrt(PackedFloat const &a) {
+    ap_uint<kMantissaBits + 1> t_scaled;
+    Exponent k;
+    SplitSquare(a, t_scaled, k);
+    // 1/sqrt(t) lies in (1, 2], so the mantissa of the result is half of it, and the estimate is at most 3 below
+    const ap_uint<kMantissaBits + 1> estimate = InvSqrtMantissa(t_scaled) >> 1;
+    // The mantissa y must satisfy y^2 * t_scaled <= 2^(3M - 1). The remainder is below 2^(2M + 5), and the bound is a
+    // multiple of 2^(2M + 6), so only the low bits of y^2 * t_scaled are needed, which takes two multiplications.
+    using Remainder = ap_uint<2 * kMantissaBits + 6>;
+    const ap_uint<2 * kMantissaBits + 2> y_squared = KaratsubaSquare(estimate);
+    const ap_uint<kMantissaBits> y_squared_low = y_squared.range(kMantissaBits - 1, 0);
+    const ap_uint<kMantissaBits + 2> y_squared_high = y_squared.range(2 * kMantissaBits + 1, kMantissaBits);
+    const Remainder product_low = Karatsuba(y_squared_low, t_scaled);
+    const Remainder product_high = Remainder(Karatsuba(y_squared_high, t_scaled)) << kMantissaBits;
+    const Remainder remainder =
+        PipelinedSub<2 * kMantissaBits + 6>(0, PipelinedAdd<2 * kMantissaBits + 6>(product_low, product_high));
+    // ((y + j)^2 - y^2) * t_scaled = j * 2y * t_scaled + j^2 * t_scaled. Compare against all of them at once.
+    const Remainder yt2 = Remainder(Karatsuba(estimate, t_scaled)) << 1;
+    const Remainder t = t_scaled;
+    const Remainder yt4 = yt2 << 1;
+    const Remainder yt6 = PipelinedAdd<2 * kMantissaBits + 6>(yt2, yt4);
+    const Remainder t4 = t << 2;
+    const Remainder t9 = PipelinedAdd<2 * kMantissaBits + 6>(t << 3, t);
+    const ap_uint<2> correction = ap_uint<2>(remainder >= PipelinedAdd<2 * kMantissaBits + 6>(yt2, t)) +
+                                  ap_uint<2>(remainder >= PipelinedAdd<2 * kMantissaBits + 6>(yt4, t4)) +
+                                  ap_uint<2>(remainder >= PipelinedAdd<2 * kMantissaBits + 6>(yt6, t9));
+    // The mantissa reaches 2^M only for powers of four, whose inverse square root is a power of two
+    const ap_uint<kMantissaBits + 1> y = PipelinedAdd<kMantissaBits + 1>(estimate, correction);
+    const bool should_be_shifted = IsMostSignificantBitSet(y);
+    PackedFloat result;
+    result.SetMantissa(should_be_shifted ? y.range(kMantissaBits, 1) : y.range(kMantissaBits - 1, 0));
+    result.SetExponent(1 - k + should_be_shifted);
+    result.SetSign(false);
+    // There are no infinities or NaNs, so zero and negative numbers flush to zero
+    return (a.IsZero() || a.GetSignBit()) ? PackedFloat::Zero() : result;
 }
 
-// Does this correctly output the result if a and b are different signs?
-// The mantissa of the result should depend on the sign bits of a and b
+// Sum rounded toward zero. Subtractions of operands whose exponents differ by at most one take the close path, which
+// can cancel any number of leading bits but never needs to round. Everything else takes the far path, which never
+// shifts the result by more than one position, so only a guard bit and a sticky bit are kept below the mantissa.
 PackedFloat Add(PackedFloat const &a_in, PackedFloat const &b_in) {
     // Retrieve once and for all to make sure there's no overhead from unpacking them
     const bool _a_sign = a_in.GetSign();
@@ -99,70 +389,72 @@ PackedFloat Add(PackedFloat const &a_in, PackedFloat const &b_in) {
 #endif
 
     const bool subtraction = a_sign != b_sign;
-    Exponent res_exponent = a_exponent;
-    using Shift = ap_uint<8 * sizeof(Exponent) - 2>;
-    const Shift shift_m = a_exponent - b_exponent;
-
-    // Figure out how much we need to shift by
-    // Xilinx permits signed shifts
-    // We want to keep an extra bit of precision (LSB) to properly round the output
-    // We also want an extra bit of range (MSB) to track overflow
-    // The names in the following code segment have _msb/_lsb suffix if they have the extra msb/lsb respectively
-    using MantissaExtended = ap_uint<2 * kMantissaBits + 1>;
-    auto a_mantissa_shifted = MantissaExtended(a_mantissa) << kMantissaBits;
-    auto b_mantissa_shifted = DynamicRightShift(MantissaExtended(b_mantissa) << kMantissaBits, shift_m);
-
-    // Now we can add up the aligned mantissas
-    // ==== Add/Sub mantissas ====
-    // We cannot truncate yet because of the renormalization step
-    const MantissaExtended ab_sum_lsb_msb = PipelinedAdd<2 * kMantissaBits>(a_mantissa_shifted, b_mantissa_shifted);
-
-    // This returns an ap_int but the answer is always positive so the MSB is never set
-    // Xilinx manual states signed <-> unsigned ignores the sign and converts bit for bit
-    // Widening assignments and right shifts of ap_int are sign extended so we specify the casting route
-    assert(a_mantissa_shifted >= b_mantissa_shifted);
-    MantissaExtended ab_diff_lsb_msb = MantissaExtended(PipelinedSub(a_mantissa_shifted, b_mantissa_shifted));
-    assert(!IsMostSignificantBitSet(ab_diff_lsb_msb));
-
-    // ==== overflow check ====
-
-    // If the addition overflowed, we need to shift and increment the exponent
-    // We could just do the right shift and let the mantissa normalization step fix up the exponent
-    const auto _res_mantissa_lsb_msb = subtraction ? ab_diff_lsb_msb : ab_sum_lsb_msb;
-
-    const bool addition_overflowed = IsMostSignificantBitSet(_res_mantissa_lsb_msb);
-    // We're still holding onto the extra lsb
-    const MantissaExtended res_mantissa_lsb =
-        addition_overflowed ? (_res_mantissa_lsb_msb >> 1) : _res_mantissa_lsb_msb;
-    res_exponent = res_exponent + (addition_overflowed ? 1 : 0);
-
-    // ==== Renormalize / Underflow ====
-    // Normalize the mantissa
-    bool res_nonzero = res_mantissa_lsb != 0;
-    const ap_uint<hlslib::ConstLog2(kMantissaBits)> leading_zeros =
-        MantissaFlat(res_mantissa_lsb >> kMantissaBits).countLeadingZeros();
-
-    // Left shift by the number of leading zeros and truncate the lsb now
-    ap_uint<kMantissaBits> res_mantissa = DynamicLeftShift(res_mantissa_lsb, leading_zeros) >> kMantissaBits;
+    const Exponent exponent_difference = a_exponent - b_exponent;
+    const bool close = subtraction && (exponent_difference == 0 || exponent_difference == 1);
 
-    // We need to watch for underflow here
-    const bool underflow = res_exponent < std::numeric_limits<Exponent>::min() + leading_zeros;
-    res_exponent = res_exponent - leading_zeros;
+    // ==== Close path ====
+    // b is shifted by at most one position, so the difference is exact with a single extra bit. The number of leading
+    // zeros is anticipated from the operands while the subtraction is running, and corrected by one position after.
+    using Close = ap_uint<kMantissaBits + 1>;
+    const Close close_a = Close(a_mantissa) << 1;
+    const Close close_b = (exponent_difference == 0) ? Close(Close(b_mantissa) << 1) : Close(b_mantissa);
+    const Close close_difference = PipelinedSub<kMantissaBits + 1>(close_a, close_b);
+    const auto close_anticipated = AnticipateLeadingZeros(close_a, close_b);
+    const Close close_shifted = FullLeftShift(close_difference, close_anticipated);
+    const bool close_short = !IsMostSignificantBitSet(close_shifted);
+    const ap_uint<kMantissaBits> close_mantissa =
+        close_short ? close_shifted.range(kMantissaBits - 1, 0) : close_shifted.range(kMantissaBits, 1);
+    // Full cancellation is detected by comparing the operands instead of waiting for the difference
+    const bool close_is_zero = exponent_difference == 0 && a_mantissa == b_mantissa;
 
-    // Flush to zero if we underflow
-    if (underflow || !res_nonzero) {
-        res_mantissa = 0;
-        res_exponent = 0;
+    // ==== Far path ====
+    // Holds a carry bit, the mantissa and a guard bit. Rounding toward zero truncates, so the bits of b shifted out
+    // below the guard bit only matter when subtracting, where any of them being set borrows one from the guard bit.
+    constexpr int kFarBits = kMantissaBits + 2;
+    using Far = ap_uint<kFarBits>;
+    const bool far_saturate = exponent_difference < 0 || exponent_difference > kMantissaBits + 1;
+    const ap_uint<ShiftBits(kFarBits)> far_shift = far_saturate ? Exponent(kMantissaBits + 1) : exponent_difference;
+    const Far far_a = Far(a_mantissa) << 1;
+    const Far far_b = FullRightShift(Far(Far(b_mantissa) << 1), far_shift);
+    // The sticky bit is computed from the unshifted b in parallel with the shift: bit i ends up below the guard bit if
+    // it is shifted by more than i + 1 positions
+    MantissaFlat shifted_out;
+    for (int i = 0; i < kMantissaBits; ++i) {
+#pragma HLS UNROLL
+        shifted_out.set_bit(i, far_shift > i + 1);
     }
+    const bool far_sticky = (b_mantissa & shifted_out) != 0;
+    const Far far_sum = PipelinedAdd<kFarBits>(far_a, far_b);
+    const Far far_difference = PipelinedAdd<kFarBits>(far_a, ~far_b, !far_sticky);
+    const Far far_result = subtraction ? far_difference : far_sum;
+    // A sum can carry into the extra bit, and a difference can lose the leading bit, but not both
+    const bool far_carry = far_result.test(kMantissaBits + 1);
+    const bool far_short = !far_carry && !far_result.test(kMantissaBits);
+    const ap_uint<kMantissaBits> far_mantissa = far_carry   ? far_result.range(kMantissaBits + 1, 2)
+                                                : far_short ? far_result.range(kMantissaBits - 1, 0)
+                                                            : far_result.range(kMantissaBits, 1);
+
+    // ==== Select and renormalize the exponent ====
+    using NormalizeShift = ap_uint<ShiftBits(kMantissaBits + 1)>;
+    const NormalizeShift normalize_shift = close ? NormalizeShift(close_anticipated + close_short)
+                                                 : NormalizeShift(far_short);
+    const bool carry = !close && far_carry;
+    const bool res_is_zero = close && close_is_zero;
+
+    // We need to watch for underflow here
+    const bool underflow = a_exponent < std::numeric_limits<Exponent>::min() + normalize_shift;
+    const Exponent res_exponent = a_exponent + carry - normalize_shift;
 
 #ifndef HLSLIB_SYNTHESIS
     // We cannot have an unnormalized mantissa by this point
-    assert(underflow || !res_nonzero || IsMostSignificantBitSet(res_mantissa));
+    assert(a_is_zero || res_is_zero || IsMostSignificantBitSet(close ? close_mantissa : far_mantissa));
 #endif
 
+    // Flush to zero if we underflow
+    const bool flush = underflow || res_is_zero;
     PackedFloat result;
-    result.SetMantissa(res_mantissa);
-    result.SetExponent(res_exponent);
+    result.SetMantissa(flush ? MantissaFlat(0) : (close ? close_mantissa : far_mantissa));
+    result.SetExponent(flush ? Exponent(0) : res_exponent);
     // Sign will be the same as whatever is the largest number
     result.SetSign(a_sign);
 
@@ -173,3 +465,93 @@ PackedFloat MultiplyAccumulate(PackedFloat const &a, PackedFloat const &b, Packe
 #pragma HLS INLINE
     return Add(c, Multiply(a, b));
 }
+
+// Shifts in copies of the sign bit, so shifting by the full width or more leaves 0 or -1
+template <int bits>
+ap_int<bits> ArithmeticRightShift(ap_int<bits> num, Exponent const &shift_by) {
+#pragma HLS INLINE
+    const bool saturate = shift_by >= bits;
+    for (int i = 0; i < ShiftBits(bits); ++i) {
+#pragma HLS UNROLL
+        num = ((shift_by >> i) & 1) ? ap_int<bits>(num >> (1 << i)) : num;
+    }
+    return saturate ? ap_int<bits>(num.test(bits - 1) ? -1 : 0) : num;
+}
+
+using Accumulator = ap_int<kAccumulatorBits>;
+
+LongAccumulator ToAccumulator(PackedFloat const &a) {
+    const Accumulator magnitude = Accumulator(ap_uint<kMantissaBits>(a.GetMantissa())) << kAccumulatorGuardBits;
+    LongAccumulator result;
+    result.value = a.GetSignBit() ? Accumulator(-magnitude) : magnitude;
+    result.exponent = a.GetExponent();
+    return result;
+}
+
+LongAccumulator AccumulateProduct(PackedFloat const &a, PackedFloat const &b, LongAccumulator const &c) {
+    // The product is never normalized, so its leading bit might be zero. This costs one guard bit, but removes the
+    // shift that Multiply needs.
+    const ap_uint<kMantissaBits> a_mantissa = a.GetMantissa();
+    const ap_uint<kMantissaBits> b_mantissa = b.GetMantissa();
+    const ap_uint<kAccumulatorFractionBits> magnitude =
+        Karatsuba(a_mantissa, b_mantissa).range(2 * kMantissaBits - 1, kMantissaBits - kAccumulatorGuardBits);
+    const Accumulator term = (a.GetSignBit() != b.GetSignBit()) ? Accumulator(-Accumulator(magnitude))
+                                                                : Accumulator(magnitude);
+    const Exponent term_exponent = a.GetExponent() + b.GetExponent();
+
+    // Only the operand with the smaller exponent is shifted, so a single shifter is needed. The exponent of an empty
+    // accumulator is meaningless, so the term is always taken to be larger, and shifting zero by any amount is fine.
+    const bool term_larger = c.value == 0 || term_exponent > c.exponent;
+    const Exponent shift = term_larger ? term_exponent - c.exponent : c.exponent - term_exponent;
+    const Accumulator larger = term_larger ? term : c.value;
+    const Accumulator smaller = ArithmeticRightShift(term_larger ? c.value : term, shift);
+
+    // Two's complement addition is the same as unsigned addition modulo the width, which never overflows thanks to the
+    // headroom bits
+    LongAccumulator result;
+    result.value = PipelinedAdd<kAccumulatorBits>(larger, smaller).range(kAccumulatorBits - 1, 0);
+    result.exponent = term_larger ? term_exponent : c.exponent;
+    return (a.IsZero() || b.IsZero()) ? c : result;
+}
+
+PackedFloat Normalize(LongAccumulator const &a) {
+    using Magnitude = ap_uint<kAccumulatorBits - 1>;
+    const bool sign = a.value.test(kAccumulatorBits - 1);
+    const Magnitude magnitude = sign ? Accumulator(-a.value) : a.value;
+    const ap_uint<ShiftBits(kAccumulatorBits - 1)> leading_zeros = magnitude.countLeadingZeros();
+    // Truncating the magnitude rounds toward zero
+    const MantissaFlat mantissa = FullLeftShift(magnitude, leading_zeros).range(kAccumulatorBits - 2,
+                                                                                kAccumulatorBits - 1 - kMantissaBits);
+    PackedFloat result;
+    result.SetMantissa(mantissa);
+    result.SetExponent(a.exponent + (kAccumulatorBits - 1 - kAccumulatorFractionBits) - leading_zeros);
+    result.SetSign(sign);
+    return (a.value == 0) ? PackedFloat::Zero() : result;
+}
+
+PartialSum ToPartialSum(PackedFloat const &a) {
+#pragma HLS INLINE
+#ifdef APFP_LONG_ACCUMULATOR
+    return ToAccumulator(a);
+#else
+    return a;
+#endif
+}
+
+PartialSum MultiplyAccumulatePartial(PackedFloat const &a, PackedFloat const &b, PartialSum const &c) {
+#pragma HLS INLINE
+#ifdef APFP_LONG_ACCUMULATOR
+    return AccumulateProduct(a, b, c);
+#else
+    return MultiplyAccumulate(a, b, c);
+#endif
+}
+
+PackedFloat RoundPartialSum(PartialSum const &a) {
+#pragma HLS INLINE
+#ifdef APFP_LONG_ACCUMULATOR
+    return Normalize(a);
+#else
+    return a;
+#endif
+}
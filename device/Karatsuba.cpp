@@ -54,7 +54,203 @@ auto _Karatsuba(ap_uint<bits> const &a, ap_uint<bits> const &b) ->
     return a * b;
 }
 
+// Squaring needs only squares at every level: 2*a_0*a_1 = a_0^2 + a_1^2 - (a_0 - a_1)^2 is never negative, so unlike
+// the general case, there are no signs to track and only one operand to take the difference of
+template <int bits>
+auto _KaratsubaSquare(ap_uint<bits> const &a) ->
+    typename std::enable_if<(bits > kMultBaseBits), ap_uint<2 * bits>>::type {
+    static_assert(bits % 2 == 0, "Number of bits must be even.");
+    using Full = ap_uint<bits>;
+    using Half = ap_uint<bits / 2>;
+
+    // Decompose the operand into halves for the recursive step
+    Half a0 = a.range(bits / 2 - 1, 0);
+    Half a1 = a.range(bits - 1, bits / 2);
+
+    // Recurse on a_0^2, a_1^2 and |a_0 - a_1|^2
+    Full z0 = _KaratsubaSquare<bits / 2>(a0);
+    Full z2 = _KaratsubaSquare<bits / 2>(a1);
+    bool a0a1_is_neg = a0 < a1;
+    Half a0a1 = PipelinedSub(a0a1_is_neg ? a1 : a0, a0a1_is_neg ? a0 : a1);
+    Full a0a1_squared = _KaratsubaSquare<bits / 2>(a0a1);
+    ap_uint<bits + 1> z1 = PipelinedSub<bits + 1>(PipelinedAdd<bits>(z0, z2), a0a1_squared);
+
+    // Align everything and combine
+    ap_uint<(2 * bits)> z0z2;
+    z0z2.range(bits - 1, 0) = z0;
+    z0z2.range(2 * bits - 1, bits) = z2;
+    ap_uint<(bits + 1 + bits / 2)> z1_aligned(0);
+    z1_aligned.range(bits / 2 + bits, bits / 2) = z1;
+    ap_uint<(2 * bits) + 1> z = PipelinedAdd<2 * bits>(z1_aligned, z0z2);
+
+    return z;
+}
+
+// In the base case, the operand is split once more, so that the product of its two halves is only computed once
+// instead of appearing twice in the partial products generated by the HLS tool
+template <int bits>
+auto _KaratsubaSquare(ap_uint<bits> const &a) ->
+    typename std::enable_if<(bits <= kMultBaseBits), ap_uint<2 * bits>>::type {
+#pragma HLS INLINE
+    static_assert(bits >= 2, "Number of bits must be at least two.");
+    constexpr int kLow = bits / 2;
+    constexpr int kHigh = bits - kLow;
+    const ap_uint<kLow> a0 = a.range(kLow - 1, 0);
+    const ap_uint<kHigh> a1 = a.range(bits - 1, kLow);
+    const ap_uint<2 * kLow> z0 = a0 * a0;
+    const ap_uint<2 * kHigh> z2 = a1 * a1;
+    const ap_uint<bits> z1 = a0 * a1;
+    ap_uint<2 * bits> z0z2;
+    z0z2.range(2 * kLow - 1, 0) = z0;
+    z0z2.range(2 * bits - 1, 2 * kLow) = z2;
+    return z0z2 + (ap_uint<2 * bits>(z1) << (kLow + 1));
+}
+
+// Smallest width of at least the given number of bits that can be halved evenly until it reaches kMultBaseBits
+constexpr int KaratsubaWidth(int bits) {
+    int levels = 0;
+    while ((kMultBaseBits << levels) < bits) {
+        ++levels;
+    }
+    return ((bits + (1 << levels) - 1) >> levels) << levels;
+}
+
+// Exact division by three modulo 2^bits of a multiple of three, using that 1/3 = (1 - 2)(1 + 4)(1 + 16)(1 + 256)...
+// modulo any power of two, which only takes a logarithmic number of additions
+template <int bits>
+ap_uint<bits> DivideExactlyByThree(ap_uint<bits> const &x) {
+#pragma HLS INLINE
+    ap_uint<bits> result = PipelinedSub<bits>(0, x);
+    for (int shift = 2; shift < bits; shift *= 2) {
+#pragma HLS UNROLL
+        result = PipelinedAdd<bits>(result, result << shift);
+    }
+    return result;
+}
+
+// Toom-Cook decomposition into thirds, evaluating both operands at 0, 1, -1, 2 and infinity. The five sub-products are
+// computed with _Karatsuba, and the coefficients of the product are interpolated modulo 2^kCoefficientBits, as they
+// are all nonnegative and fit into that many bits.
+template <int bits>
+ap_uint<2 * bits> _Toom3(ap_uint<bits> const &a, ap_uint<bits> const &b) {
+    constexpr int kPartBits = (bits + 2) / 3;
+    constexpr int kOperandBits = KaratsubaWidth(kPartBits + 3);  // Large enough to evaluate at 2
+    constexpr int kCoefficientBits = 2 * kPartBits + 7;
+    using Part = ap_uint<kPartBits>;
+    using Operand = ap_uint<kOperandBits>;
+    using Coefficient = ap_uint<kCoefficientBits>;
+    using Full = ap_uint<2 * bits>;
+
+    const ap_uint<3 * kPartBits> a_padded = a;
+    const ap_uint<3 * kPartBits> b_padded = b;
+    const Part a0 = a_padded.range(kPartBits - 1, 0);
+    const Part a1 = a_padded.range(2 * kPartBits - 1, kPartBits);
+    const Part a2 = a_padded.range(3 * kPartBits - 1, 2 * kPartBits);
+    const Part b0 = b_padded.range(kPartBits - 1, 0);
+    const Part b1 = b_padded.range(2 * kPartBits - 1, kPartBits);
+    const Part b2 = b_padded.range(3 * kPartBits - 1, 2 * kPartBits);
+
+    // Evaluate a0 + a1*x + a2*x^2 and likewise for b
+    const Operand a_even = PipelinedAdd<kPartBits>(a0, a2);
+    const Operand b_even = PipelinedAdd<kPartBits>(b0, b2);
+    const Operand a_one = PipelinedAdd<kOperandBits>(a_even, Operand(a1));
+    const Operand b_one = PipelinedAdd<kOperandBits>(b_even, Operand(b1));
+    // Compute |a(-1)| and sign(a(-1)), and likewise for b
+    const bool a_minus_one_is_neg = a_even < Operand(a1);
+    const bool b_minus_one_is_neg = b_even < Operand(b1);
+    const Operand a_minus_one = a_minus_one_is_neg ? PipelinedSub<kOperandBits>(a1, a_even)
+                                                   : PipelinedSub<kOperandBits>(a_even, a1);
+    const Operand b_minus_one = b_minus_one_is_neg ? PipelinedSub<kOperandBits>(b1, b_even)
+                                                   : PipelinedSub<kOperandBits>(b_even, b1);
+    // a(2) = a0 + 2*(a1 + 2*a2)
+    const Operand a_half_two = PipelinedAdd<kOperandBits>(a1, Operand(a2) << 1);
+    const Operand b_half_two = PipelinedAdd<kOperandBits>(b1, Operand(b2) << 1);
+    const Operand a_two = PipelinedAdd<kOperandBits>(a0, a_half_two << 1);
+    const Operand b_two = PipelinedAdd<kOperandBits>(b0, b_half_two << 1);
+
+    // Recurse on the five points
+    const Coefficient r0 = _Karatsuba<kOperandBits>(a0, b0);
+    const Coefficient r_one = _Karatsuba<kOperandBits>(a_one, b_one);
+    const Coefficient r_minus_one = _Karatsuba<kOperandBits>(a_minus_one, b_minus_one);
+    const bool r_minus_one_is_neg = a_minus_one_is_neg != b_minus_one_is_neg;
+    const Coefficient r_two = _Karatsuba<kOperandBits>(a_two, b_two);
+    const Coefficient r_infinity = _Karatsuba<kOperandBits>(a2, b2);
+
+    // Interpolate the coefficients c0 = r0, c1, c2, c3 and c4 = r_infinity
+    const Coefficient sum = r_minus_one_is_neg ? PipelinedSub<kCoefficientBits>(r_one, r_minus_one)
+                                               : PipelinedAdd<kCoefficientBits>(r_one, r_minus_one);
+    const Coefficient difference = r_minus_one_is_neg ? PipelinedAdd<kCoefficientBits>(r_one, r_minus_one)
+                                                      : PipelinedSub<kCoefficientBits>(r_one, r_minus_one);
+    const Coefficient c0c4 = PipelinedAdd<kCoefficientBits>(r0, r_infinity);
+    const Coefficient c2 = PipelinedSub<kCoefficientBits>(sum >> 1, c0c4);  // (r(1) + r(-1)) / 2 - c0 - c4
+    const Coefficient c1c3 = difference >> 1;                               // (r(1) - r(-1)) / 2 = c1 + c3
+    // r(2) - c0 - 4*c2 - 16*c4 = 2*c1 + 8*c3
+    const Coefficient c2c4 = PipelinedAdd<kCoefficientBits>(c2 << 2, r_infinity << 4);
+    const Coefficient c0c2c4 = PipelinedAdd<kCoefficientBits>(r0, c2c4);
+    const Coefficient c1c3_two = PipelinedSub<kCoefficientBits>(r_two, c0c2c4);
+    const Coefficient c3_three = PipelinedSub<kCoefficientBits>(c1c3_two >> 1, c1c3);  // c1 + 4*c3 - (c1 + c3)
+    const Coefficient c3 = DivideExactlyByThree(c3_three);
+    const Coefficient c1 = PipelinedSub<kCoefficientBits>(c1c3, c3);
+
+    // Align everything and combine. The product fits into the result, so the sum is exact modulo its width.
+    const Full c0c4_aligned = Full(r0) | (Full(r_infinity) << (4 * kPartBits));
+    const Full c1c3_aligned = PipelinedAdd<2 * bits>(Full(c1) << kPartBits, Full(c3) << (3 * kPartBits));
+    const Full even = PipelinedAdd<2 * bits>(c0c4_aligned, Full(c2) << (2 * kPartBits));
+    return PipelinedAdd<2 * bits>(even, c1c3_aligned);
+}
+
+// Short product following Mulders: the top three quarters of the operands are multiplied in full, while only the high
+// halves of the products of the top quarter of one operand and the bottom quarter of the other are needed. The
+// remaining partial products lie entirely below the result and are dropped.
+template <int bits>
+auto _KaratsubaHigh(ap_uint<bits> const &a, ap_uint<bits> const &b) ->
+    typename std::enable_if<(bits > kMultBaseBits), ap_uint<bits>>::type {
+    static_assert(bits % 4 == 0, "Number of bits must be divisible by four.");
+    constexpr int kQuarter = bits / 4;
+    using Quarter = ap_uint<kQuarter>;
+    using Upper = ap_uint<bits - kQuarter>;
+
+    const Upper a_upper = a.range(bits - 1, kQuarter);
+    const Upper b_upper = b.range(bits - 1, kQuarter);
+    const Quarter a_top = a.range(bits - 1, bits - kQuarter);
+    const Quarter b_top = b.range(bits - 1, bits - kQuarter);
+    const Quarter a_bottom = a.range(kQuarter - 1, 0);
+    const Quarter b_bottom = b.range(kQuarter - 1, 0);
+
+    // The product of the upper parts has weight 2^(bits/2), so its top bits are already aligned to the result
+    const ap_uint<bits> upper = _Karatsuba<bits - kQuarter>(a_upper, b_upper).range(2 * bits - 2 * kQuarter - 1,
+                                                                                      2 * kQuarter);
+    // The cross products have weight 2^(3*bits/4), so their high halves are aligned to the result
+    const Quarter ab = _KaratsubaHigh<kQuarter>(a_top, b_bottom);
+    const Quarter ba = _KaratsubaHigh<kQuarter>(a_bottom, b_top);
+    const ap_uint<kQuarter + 1> cross = PipelinedAdd<kQuarter>(ab, ba);
+
+    // The result is a lower bound of the exact high half, so the sum never overflows
+    return PipelinedAdd<bits>(upper, cross).range(bits - 1, 0);
+}
+
+template <int bits>
+auto _KaratsubaHigh(ap_uint<bits> const &a, ap_uint<bits> const &b) ->
+    typename std::enable_if<(bits <= kMultBaseBits), ap_uint<bits>>::type {
+#pragma HLS INLINE
+    return _Karatsuba<bits>(a, b).range(2 * bits - 1, bits);
+}
+
 ap_uint<2 * kBits> Karatsuba(ap_uint<kBits> const &a, ap_uint<kBits> const &b) {
 #pragma HLS INLINE
+#ifdef APFP_MULT_TOOM3
+    return _Toom3<kBits>(a, b);
+#else
     return _Karatsuba<kBits>(a, b);
+#endif
+}
+
+ap_uint<2 * kBits> KaratsubaSquare(ap_uint<kBits> const &a) {
+#pragma HLS INLINE
+    return _KaratsubaSquare<kBits>(a);
+}
+
+ap_uint<kBits> KaratsubaHigh(ap_uint<kBits> const &a, ap_uint<kBits> const &b) {
+#pragma HLS INLINE
+    return _KaratsubaHigh<kBits>(a, b);
 }
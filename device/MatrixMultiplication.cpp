@@ -6,20 +6,139 @@
 
 #include "ArithmeticOperations.h"
 
+// The columns of each tile are distributed across a chain of processing elements, where element p owns every column
+// m1 with m1 % kProcessingElements == p. Values of A are shared by all elements, while B and C are moved as vectors
+// holding one number per processing element. The tile shape is passed to every launch, and kTileSizeN x kTileSizeM is
+// only the largest shape that the on-chip buffers are sized for.
+static_assert(kTileSizeM % kProcessingElements == 0, "Tile size in M must be a multiple of the processing elements.");
+constexpr int kTileSizeMPerElement = kTileSizeM / kProcessingElements;
+
+struct PackedFloatVector {
+    PackedFloat data[kProcessingElements];
+};
+
+struct PartialSumVector {
+    PartialSum data[kProcessingElements];
+};
+
+// Tiles of C are traversed along M inside N, except when the panel of B is stationary, in which case N is traversed
+// inside M so that each panel of B is used by consecutive tiles
+int OuterTiles(const int tiles_n, const int tiles_m, const int flags) {
+#pragma HLS INLINE
+    return ((flags & kGemmCacheB) != 0) ? tiles_m : tiles_n;
+}
+
+int InnerTiles(const int tiles_n, const int tiles_m, const int flags) {
+#pragma HLS INLINE
+    return ((flags & kGemmCacheB) != 0) ? tiles_n : tiles_m;
+}
+
+void TileIndices(const int t0, const int t1, const int flags, int &n0, int &m0) {
+#pragma HLS INLINE
+    const bool n_inner = (flags & kGemmCacheB) != 0;
+    n0 = n_inner ? t1 : t0;
+    m0 = n_inner ? t0 : t1;
+}
+
+// With kGemmLowerTriangle, C is the block of rows starting at row_offset of a symmetric matrix, and only the tiles
+// holding entries on or below its diagonal are computed. These form a prefix of every row of tiles, and every module
+// skips the remaining tiles in the same way.
+int TilesInRow(const int n0, const int size_n, const int tiles_m, const int tile_n, const int tile_m,
+               const int row_offset, const int flags) {
+#pragma HLS INLINE
+    const int rows_end = ((n0 + 1) * tile_n < size_n) ? (n0 + 1) * tile_n : size_n;
+    const int diagonal_tiles = (row_offset + rows_end - 1) / tile_m + 1;
+    return ((flags & kGemmLowerTriangle) != 0 && diagonal_tiles < tiles_m) ? diagonal_tiles : tiles_m;
+}
+
+// Number of rows of C held by the given tile, which is only smaller than tile_n for the last tile along N. Passes over
+// tiles with fewer than MinPassRows(tile_m) rows are padded with rows that don't touch memory.
+int TileRows(const int n0, const int tiles_n, const int size_n, const int tile_n) {
+#pragma HLS INLINE
+    return (n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n);
+}
+
+bool SkipTile(const int n0, const int m0, const int size_n, const int tiles_m, const int tile_n, const int tile_m,
+              const int row_offset, const int flags) {
+#pragma HLS INLINE
+    return m0 >= TilesInRow(n0, size_n, tiles_m, tile_n, tile_m, row_offset, flags);
+}
+
+// First tile along N that is computed in the given column of tiles, which is where a stationary panel of B is fetched
+int FirstTileInColumn(const int m0, const int tile_n, const int tile_m, const int row_offset, const int flags) {
+#pragma HLS INLINE
+    const int rows_above = m0 * tile_m - row_offset;
+    return ((flags & kGemmLowerTriangle) != 0 && rows_above > 0) ? rows_above / tile_n : 0;
+}
+
+// Number of tiles computed, and the number of rows of C they span in total, which determine how many vectors pass
+// through the vectorizers
+void CountTiles(const int size_n, const int size_m, const int tile_n, const int tile_m, const int row_offset,
+                const int flags, long &num_tiles, long &num_rows) {
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    num_tiles = 0;
+    num_rows = 0;
+CountTiles_N:
+    for (int n0 = 0; n0 < tiles_n; ++n0) {
+        const int rows = (n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n);
+        const int tiles = TilesInRow(n0, size_n, tiles_m, tile_n, tile_m, row_offset, flags);
+        num_tiles += tiles;
+        num_rows += static_cast<long>(rows) * tiles;
+    }
+}
+
+// Zero-sized arrays are not allowed, even when the panel caches are disabled
+constexpr int kPanelCacheCapacity = (kPanelCacheDepth > 0) ? kPanelCacheDepth : 1;
+
+// With the tiled layouts, the kernel consumes every block of memory front to back, so each one is transferred as a
+// single long burst rather than one burst per number
+void ReadContiguous(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_feeder, const long offset,
+                    const long count) {
+#pragma HLS INLINE
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+ReadContiguous_Lines:
+    for (long i = 0; i < count * kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+        num[i % kLinesPerNumber] = mem[offset * kLinesPerNumber + i];
+        if (i % kLinesPerNumber == kLinesPerNumber - 1) {
+            to_feeder.Push(PackedFloat(num));
+        }
+    }
+}
+
+void WriteContiguous(hlslib::Stream<PackedFloat> &from_kernel, DramLine *const mem, const long offset,
+                     const long count) {
+#pragma HLS INLINE
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+WriteContiguous_Lines:
+    for (long i = 0; i < count * kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+        if (i % kLinesPerNumber == 0) {
+            from_kernel.Pop().UnpackFlits(num);
+        }
+        mem[offset * kLinesPerNumber + i] = num[i % kLinesPerNumber];
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 // Annoyingly we have to specialize the innermost loop on whether multiple DRAM flits per number are required or not,
 // because HLS otherwise gets confused by pragmas applied to a loop of size 1 in the latter case.
 template <int lines_per_number>
 void ReadAInner(DramLine const *const mem, hlslib::Stream<PackedFloat> &a_to_feeder, const int size_n,
-                const int tiles_n, const int size_k, const int n0, const int k) {
+                const int tiles_n, const int size_k, const int tile_n, const int n0, const int k) {
 #pragma HLS INLINE
     DramLine num[kLinesPerNumber];
 ReadA_N:
-    for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN)); ++n1) {
+    for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n)); ++n1) {
     ReadA_Flits:
         for (int i = 0; i < kLinesPerNumber; ++i) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
-            num[i] = mem[((n0 * kTileSizeN + n1) * size_k + k) * kLinesPerNumber + i];
+            num[i] = mem[((n0 * tile_n + n1) * size_k + k) * kLinesPerNumber + i];
             if (i == kLinesPerNumber - 1) {
                 a_to_feeder.Push(PackedFloat(num));
             }
@@ -29,29 +148,93 @@ ReadA_N:
 
 template <>
 void ReadAInner<1>(DramLine const *const mem, hlslib::Stream<PackedFloat> &a_to_feeder, const int size_n,
-                   const int tiles_n, const int size_k, const int n0, const int k) {
+                   const int tiles_n, const int size_k, const int tile_n, const int n0, const int k) {
 #pragma HLS INLINE
 ReadA_N:
-    for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN)); ++n1) {
+    for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n)); ++n1) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
         DramLine num[1];
-        num[0] = mem[(n0 * kTileSizeN + n1) * size_k + k];
+        num[0] = mem[(n0 * tile_n + n1) * size_k + k];
         a_to_feeder.Push(PackedFloat(num));
     }
 }
 
 void ReadA(DramLine const *const mem, hlslib::Stream<PackedFloat> &a_to_feeder, const int size_n, const int size_k,
-           const int size_m) {
-    const auto tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
-    const auto tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
-ReadA_TilesN:
-    for (int n0 = 0; n0 < tiles_n; ++n0) {
-    ReadA_TilesM:
-        for (int m0 = 0; m0 < tiles_m; ++m0) {
+           const int size_m, const int tile_n, const int tile_m, const int row_offset, const int flags) {
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    if ((flags & kGemmTiledLayout) != 0) {
+    ReadA_TiledOuter:
+        for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+        ReadA_TiledInner:
+            for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+                int n0, m0;
+                TileIndices(t0, t1, flags, n0, m0);
+                if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                    continue;  // Above the diagonal
+                }
+                if (m0 > 0 && (flags & kGemmCacheA) != 0) {
+                    continue;  // Replayed by CacheA
+                }
+                const int rows = (n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n);
+                ReadContiguous(mem, a_to_feeder, static_cast<long>(n0) * tile_n * size_k,
+                               static_cast<long>(rows) * size_k);
+            }
+        }
+        return;
+    }
+ReadA_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    ReadA_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
+            if (m0 > 0 && (flags & kGemmCacheA) != 0) {
+                continue;  // Replayed by CacheA
+            }
         ReadA_K:
             for (int k = 0; k < size_k; ++k) {
-                ReadAInner<kLinesPerNumber>(mem, a_to_feeder, size_n, tiles_n, size_k, n0, k);
+                ReadAInner<kLinesPerNumber>(mem, a_to_feeder, size_n, tiles_n, size_k, tile_n, n0, k);
+            }
+        }
+    }
+}
+
+// When A is stationary, the reader only fetches the panel of A for the first tile of each row of tiles, which is kept
+// on chip and replayed for the remaining tiles along M. Otherwise values are passed through.
+void CacheA(hlslib::Stream<PackedFloat> &from_reader, hlslib::Stream<PackedFloat> &to_feeder, const int size_n,
+            const int size_k, const int size_m, const int tile_n, const int tile_m, const int row_offset,
+            const int flags) {
+    PackedFloat panel[kTileSizeN * kPanelCacheCapacity];
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    const bool cache = (flags & kGemmCacheA) != 0;
+CacheA_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    CacheA_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
+        CacheA_K:
+            for (int k = 0; k < size_k; ++k) {
+            CacheA_N:
+                for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n)); ++n1) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_FLATTEN
+                    const bool replay = cache && m0 > 0;
+                    const PackedFloat a = replay ? panel[k * tile_n + n1] : from_reader.Pop();
+                    if (cache && m0 == 0) {
+                        panel[k * tile_n + n1] = a;
+                    }
+                    to_feeder.Push(a);
+                }
             }
         }
     }
@@ -60,23 +243,32 @@ ReadA_TilesN:
 // In order to eliminate control logic in the compute function, we introduce extra feeders that run in the iteration
 // space of the computational module, but write to the kernel every iteration to absorb the conditional pipeline reads
 void FeedA(hlslib::Stream<PackedFloat> &a_to_feeder, hlslib::Stream<PackedFloat> &a_to_kernel, const int size_n,
-           const int size_k, const int size_m) {
-    const auto tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
-    const auto tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
+           const int size_k, const int size_m, const int tile_n, const int tile_m, const int row_offset,
+           const int flags) {
+    const int tile_m_per_element = tile_m / kProcessingElements;
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    const int min_rows = MinPassRows(tile_m);
     PackedFloat a;
-FeedA_TilesN:
-    for (int n0 = 0; n0 < tiles_n; ++n0) {
-    FeedA_TilesM:
-        for (int m0 = 0; m0 < tiles_m; ++m0) {
+FeedA_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    FeedA_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
+            const int rows = TileRows(n0, tiles_n, size_n, tile_n);
         FeedA_K:
             for (int k = 0; k < size_k; ++k) {
             FeedA_N:
-                for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN)); ++n1) {
+                for (int n1 = 0; n1 < PassRows(rows, min_rows); ++n1) {
                 FeedA_M:
-                    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+                    for (int m1 = 0; m1 < tile_m_per_element; ++m1) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
-                        if (m1 == 0) {
+                        if (m1 == 0 && n1 < rows) {
                             a = a_to_feeder.Pop();
                         }
                         a_to_kernel.Push(a);
@@ -90,17 +282,17 @@ FeedA_TilesN:
 ////////////////////////////////////////////////////////////////////////////////
 
 template <int lines_per_number>
-void ReadBInner(DramLine const *const mem, hlslib::Stream<PackedFloat> &b_to_feeder, const int size_m, const int m0,
-                const int k) {
+void ReadBInner(DramLine const *const mem, hlslib::Stream<PackedFloat> &b_to_feeder, const int size_m,
+                const int tile_m, const int m0, const int k) {
 #pragma HLS INLINE
     DramLine num[kLinesPerNumber];
 ReadB_M:
-    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+    for (int m1 = 0; m1 < tile_m; ++m1) {
     ReadB_Flits:
         for (int i = 0; i < kLinesPerNumber; ++i) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
-            num[i] = mem[(k * size_m + m0 * kTileSizeM + m1) * kLinesPerNumber + i];
+            num[i] = mem[(k * size_m + m0 * tile_m + m1) * kLinesPerNumber + i];
             if (i == kLinesPerNumber - 1) {
                 b_to_feeder.Push(PackedFloat(num));
             }
@@ -109,50 +301,123 @@ ReadB_M:
 }
 
 template <>
-void ReadBInner<1>(DramLine const *const mem, hlslib::Stream<PackedFloat> &b_to_feeder, const int size_m, const int m0,
-                   const int k) {
+void ReadBInner<1>(DramLine const *const mem, hlslib::Stream<PackedFloat> &b_to_feeder, const int size_m,
+                   const int tile_m, const int m0, const int k) {
 #pragma HLS INLINE
 ReadB_M:
-    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+    for (int m1 = 0; m1 < tile_m; ++m1) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
         DramLine num[1];
-        num[0] = mem[k * size_m + m0 * kTileSizeM + m1];
+        num[0] = mem[k * size_m + m0 * tile_m + m1];
         b_to_feeder.Push(PackedFloat(num));
     }
 }
 
 void ReadB(DramLine const *const mem, hlslib::Stream<PackedFloat> &b_to_feeder, const int size_n, const int size_k,
-           const int size_m) {
-    const auto tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
-    const auto tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
-ReadB_TilesN:
-    for (int n0 = 0; n0 < tiles_n; ++n0) {
-    ReadB_TilesM:
-        for (int m0 = 0; m0 < tiles_m; ++m0) {
+           const int size_m, const int tile_n, const int tile_m, const int row_offset, const int flags) {
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    if ((flags & kGemmTiledLayout) != 0) {
+    ReadB_TiledOuter:
+        for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+        ReadB_TiledInner:
+            for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+                int n0, m0;
+                TileIndices(t0, t1, flags, n0, m0);
+                if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                    continue;  // Above the diagonal
+                }
+                if (n0 > FirstTileInColumn(m0, tile_n, tile_m, row_offset, flags) && (flags & kGemmCacheB) != 0) {
+                    continue;  // Replayed by CacheB
+                }
+                ReadContiguous(mem, b_to_feeder, static_cast<long>(m0) * size_k * tile_m,
+                               static_cast<long>(size_k) * tile_m);
+            }
+        }
+        return;
+    }
+ReadB_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    ReadB_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
+            if (n0 > FirstTileInColumn(m0, tile_n, tile_m, row_offset, flags) && (flags & kGemmCacheB) != 0) {
+                continue;  // Replayed by CacheB
+            }
         ReadB_K:
             for (int k = 0; k < size_k; ++k) {
-                ReadBInner<kLinesPerNumber>(mem, b_to_feeder, size_m, m0, k);
+                ReadBInner<kLinesPerNumber>(mem, b_to_feeder, size_m, tile_m, m0, k);
             }
         }
     }
 }
 
-void FeedB(hlslib::Stream<PackedFloat> &b_to_feeder, hlslib::Stream<PackedFloat> &b_to_kernel, const int size_n,
-           const int size_k, const int size_m) {
-    const auto tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
-    const auto tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
-    PackedFloat b;
-FeedB_TilesN:
-    for (int n0 = 0; n0 < tiles_n; ++n0) {
-    FeedB_TilesM:
-        for (int m0 = 0; m0 < tiles_m; ++m0) {
+// Counterpart of CacheA for the panel of B, which is fetched for the first computed tile of each column of tiles when B
+// is stationary
+void CacheB(hlslib::Stream<PackedFloat> &from_reader, hlslib::Stream<PackedFloat> &to_vectorizer, const int size_n,
+            const int size_k, const int size_m, const int tile_n, const int tile_m, const int row_offset,
+            const int flags) {
+    PackedFloat panel[kPanelCacheCapacity * kTileSizeM];
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    const bool cache = (flags & kGemmCacheB) != 0;
+CacheB_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    CacheB_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
+            const int first_n0 = FirstTileInColumn(m0, tile_n, tile_m, row_offset, flags);
+        CacheB_K:
+            for (int k = 0; k < size_k; ++k) {
+            CacheB_M:
+                for (int m1 = 0; m1 < tile_m; ++m1) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_FLATTEN
+                    const bool replay = cache && n0 > first_n0;
+                    const PackedFloat b = replay ? panel[k * tile_m + m1] : from_reader.Pop();
+                    if (cache && n0 == first_n0) {
+                        panel[k * tile_m + m1] = b;
+                    }
+                    to_vectorizer.Push(b);
+                }
+            }
+        }
+    }
+}
+
+void FeedB(hlslib::Stream<PackedFloatVector> &b_to_feeder, hlslib::Stream<PackedFloatVector> &b_to_kernel,
+           const int size_n, const int size_k, const int size_m, const int tile_n, const int tile_m,
+           const int row_offset, const int flags) {
+    const int tile_m_per_element = tile_m / kProcessingElements;
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    const int min_rows = MinPassRows(tile_m);
+    PackedFloatVector b;
+FeedB_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    FeedB_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
+            const int rows = TileRows(n0, tiles_n, size_n, tile_n);
         FeedB_K:
             for (int k = 0; k < size_k; ++k) {
             FeedB_N:
-                for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN)); ++n1) {
+                for (int n1 = 0; n1 < PassRows(rows, min_rows); ++n1) {
                 FeedB_M:
-                    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+                    for (int m1 = 0; m1 < tile_m_per_element; ++m1) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
                         if (n1 == 0) {
@@ -169,17 +434,17 @@ FeedB_TilesN:
 ////////////////////////////////////////////////////////////////////////////////
 
 template <int lines_per_number>
-void ReadCInner(DramLine const *const mem, hlslib::Stream<PackedFloat> &c_to_feeder, const int size_m, const int n0,
-                const int m0, const int n1) {
+void ReadCInner(DramLine const *const mem, hlslib::Stream<PackedFloat> &c_to_feeder, const int size_m,
+                const int tile_n, const int tile_m, const int n0, const int m0, const int n1) {
 #pragma HLS INLINE
 ReadC_M:
-    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+    for (int m1 = 0; m1 < tile_m; ++m1) {
         DramLine num[kLinesPerNumber];
     ReadC_Flits:
         for (int i = 0; i < kLinesPerNumber; ++i) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
-            num[i] = mem[((n0 * kTileSizeN + n1) * size_m + m0 * kTileSizeM + m1) * kLinesPerNumber + i];
+            num[i] = mem[((n0 * tile_n + n1) * size_m + m0 * tile_m + m1) * kLinesPerNumber + i];
             if (i == kLinesPerNumber - 1) {
                 c_to_feeder.Push(PackedFloat(num));
             }
@@ -188,52 +453,91 @@ ReadC_M:
 }
 
 template <>
-void ReadCInner<1>(DramLine const *const mem, hlslib::Stream<PackedFloat> &c_to_feeder, const int size_m, const int n0,
-                   const int m0, const int n1) {
+void ReadCInner<1>(DramLine const *const mem, hlslib::Stream<PackedFloat> &c_to_feeder, const int size_m,
+                   const int tile_n, const int tile_m, const int n0, const int m0, const int n1) {
 #pragma HLS INLINE
 ReadC_M:
-    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+    for (int m1 = 0; m1 < tile_m; ++m1) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
         DramLine num[1];
-        num[0] = mem[(n0 * kTileSizeN + n1) * size_m + m0 * kTileSizeM + m1];
+        num[0] = mem[(n0 * tile_n + n1) * size_m + m0 * tile_m + m1];
         c_to_feeder.Push(PackedFloat(num));
     }
 }
 
-void ReadC(DramLine const *const mem, hlslib::Stream<PackedFloat> &c_to_feeder, const int size_n, const int size_m) {
-    const auto tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
-    const auto tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
-ReadC_TilesN:
-    for (int n0 = 0; n0 < tiles_n; ++n0) {
-    ReadC_TilesM:
-        for (int m0 = 0; m0 < tiles_m; ++m0) {
+void ReadC(DramLine const *const mem, hlslib::Stream<PackedFloat> &c_to_feeder, const int size_n, const int size_m,
+           const int tile_n, const int tile_m, const int row_offset, const int flags) {
+    if ((flags & kGemmReadC) == 0) {
+        return;  // C is overwritten, so skip the memory traffic entirely
+    }
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    if ((flags & kGemmTiledLayout) != 0) {
+    ReadC_TiledOuter:
+        for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+        ReadC_TiledInner:
+            for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+                int n0, m0;
+                TileIndices(t0, t1, flags, n0, m0);
+                if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                    continue;  // Above the diagonal
+                }
+                const int rows = (n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n);
+                ReadContiguous(mem, c_to_feeder,
+                               (static_cast<long>(n0) * tile_n * tiles_m + static_cast<long>(m0) * rows) *
+                                   tile_m,
+                               static_cast<long>(rows) * tile_m);
+            }
+        }
+        return;
+    }
+ReadC_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    ReadC_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
         ReadC_N:
-            for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN)); ++n1) {
-                ReadCInner<kLinesPerNumber>(mem, c_to_feeder, size_m, n0, m0, n1);
+            for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n)); ++n1) {
+                ReadCInner<kLinesPerNumber>(mem, c_to_feeder, size_m, tile_n, tile_m, n0, m0, n1);
             }
         }
     }
 }
 
-void FeedC(hlslib::Stream<PackedFloat> &c_to_feeder, hlslib::Stream<PackedFloat> &c_to_kernel, const int size_n,
-           const int size_k, const int size_m) {
-    const auto tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
-    const auto tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
-    PackedFloat c;
-FeedC_TilesN:
-    for (int n0 = 0; n0 < tiles_n; ++n0) {
-    FeedC_TilesM:
-        for (int m0 = 0; m0 < tiles_m; ++m0) {
+void FeedC(hlslib::Stream<PackedFloatVector> &c_to_feeder, hlslib::Stream<PackedFloatVector> &c_to_kernel,
+           const int size_n, const int size_k, const int size_m, const int tile_n, const int tile_m,
+           const int row_offset, const int flags) {
+    const int tile_m_per_element = tile_m / kProcessingElements;
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    // C is the initial value of the accumulation, unless it is scaled by beta after the product has been drained
+    const bool read_c = (flags & kGemmReadC) != 0 && (flags & kGemmScaleC) == 0;
+    const int min_rows = MinPassRows(tile_m);
+    PackedFloatVector c;
+FeedC_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    FeedC_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
+            const int rows = TileRows(n0, tiles_n, size_n, tile_n);
         FeedC_K:
             for (int k = 0; k < size_k; ++k) {
             FeedC_N:
-                for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN)); ++n1) {
+                for (int n1 = 0; n1 < PassRows(rows, min_rows); ++n1) {
                 FeedC_M:
-                    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+                    for (int m1 = 0; m1 < tile_m_per_element; ++m1) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
-                        if (k == 0) {
+                        if (read_c && k == 0 && n1 < rows) {
                             c = c_to_feeder.Pop();
                         }
                         c_to_kernel.Push(c);
@@ -246,24 +550,46 @@ FeedC_TilesN:
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void DrainC(hlslib::Stream<PackedFloat> &c_to_drainer, hlslib::Stream<PackedFloat> &drainer_to_c, const int size_n,
-            const int size_k, const int size_m) {
-    const auto tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
-    const auto tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
-DrainC_TilesN:
-    for (int n0 = 0; n0 < tiles_n; ++n0) {
-    DrainC_TilesM:
-        for (int m0 = 0; m0 < tiles_m; ++m0) {
+// Collects the results of all processing elements into vectors, forwarding only those of the last pass. With
+// APFP_LONG_ACCUMULATOR, this is where the partial sums are normalized, once per forwarded result.
+void DrainC(hlslib::Stream<PartialSum, 16> c_to_drainer[kProcessingElements],
+            hlslib::Stream<PackedFloatVector> &drainer_to_c, const int size_n, const int size_k, const int size_m,
+            const int tile_n, const int tile_m, const int row_offset, const int flags) {
+    const int tile_m_per_element = tile_m / kProcessingElements;
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    const int min_rows = MinPassRows(tile_m);
+DrainC_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    DrainC_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
+            const int rows = TileRows(n0, tiles_n, size_n, tile_n);
         DrainC_K:
             for (int k = 0; k < size_k; ++k) {
             DrainC_N:
-                for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN)); ++n1) {
+                for (int n1 = 0; n1 < PassRows(rows, min_rows); ++n1) {
                 DrainC_M:
-                    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+                    for (int m1 = 0; m1 < tile_m_per_element; ++m1) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
-                        const auto c = c_to_drainer.Pop();
-                        if (k == size_k - 1) {
+                        PartialSumVector partial;
+                    DrainC_Pop:
+                        for (int pe = 0; pe < kProcessingElements; ++pe) {
+#pragma HLS UNROLL
+                            partial.data[pe] = c_to_drainer[pe].Pop();
+                        }
+                        if (k == size_k - 1 && n1 < rows) {
+                            PackedFloatVector c;
+                        DrainC_Round:
+                            for (int pe = 0; pe < kProcessingElements; ++pe) {
+#pragma HLS UNROLL
+                                c.data[pe] = RoundPartialSum(partial.data[pe]);
+                            }
                             drainer_to_c.Push(c);
                         }
                     }
@@ -275,10 +601,10 @@ DrainC_TilesN:
 
 template <int lines_per_number>
 void WriteCInner(hlslib::Stream<PackedFloat> &from_kernel, DramLine *const mem, const int size_n, const int size_m,
-                 const int n0, const int m0, const int n1) {
+                 const int tile_n, const int tile_m, const int n0, const int m0, const int n1) {
 #pragma HLS INLINE
 WriteC_M:
-    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+    for (int m1 = 0; m1 < tile_m; ++m1) {
         DramLine num[kLinesPerNumber];
 #pragma HLS ARRAY_PARTITION variable = num complete
     WriteC_Flits:
@@ -288,9 +614,9 @@ WriteC_M:
             if (i == 0) {
                 from_kernel.Pop().UnpackFlits(num);
             }
-            const bool in_bounds = (n0 * kTileSizeN + n1 < size_n) && (m0 * kTileSizeM + m1 < size_m);
+            const bool in_bounds = (n0 * tile_n + n1 < size_n) && (m0 * tile_m + m1 < size_m);
             if (in_bounds) {
-                mem[((n0 * kTileSizeN + n1) * size_m + m0 * kTileSizeM + m1) * kLinesPerNumber + i] = num[i];
+                mem[((n0 * tile_n + n1) * size_m + m0 * tile_m + m1) * kLinesPerNumber + i] = num[i];
             }
         }
     }
@@ -298,31 +624,57 @@ WriteC_M:
 
 template <>
 void WriteCInner<1>(hlslib::Stream<PackedFloat> &from_kernel, DramLine *const mem, const int size_n, const int size_m,
-                    const int n0, const int m0, const int n1) {
+                    const int tile_n, const int tile_m, const int n0, const int m0, const int n1) {
 #pragma HLS INLINE
 WriteC_M:
-    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+    for (int m1 = 0; m1 < tile_m; ++m1) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
         DramLine num[1];
         from_kernel.Pop().UnpackFlits(num);
-        const bool in_bounds = (n0 * kTileSizeN + n1 < size_n) && (m0 * kTileSizeM + m1 < size_m);
+        const bool in_bounds = (n0 * tile_n + n1 < size_n) && (m0 * tile_m + m1 < size_m);
         if (in_bounds) {
-            mem[(n0 * kTileSizeN + n1) * size_m + m0 * kTileSizeM + m1] = num[0];
+            mem[(n0 * tile_n + n1) * size_m + m0 * tile_m + m1] = num[0];
         }
     }
 }
 
-void WriteC(hlslib::Stream<PackedFloat> &from_kernel, DramLine *const mem, const int size_n, int const size_m) {
-    const auto tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
-    const auto tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
-WriteC_TilesN:
-    for (int n0 = 0; n0 < tiles_n; ++n0) {
-    WriteC_TilesM:
-        for (int m0 = 0; m0 < tiles_m; ++m0) {
+void WriteC(hlslib::Stream<PackedFloat> &from_kernel, DramLine *const mem, const int size_n, int const size_m,
+            const int tile_n, const int tile_m, const int row_offset, const int flags) {
+    const auto tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const auto tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    if ((flags & kGemmTiledLayout) != 0) {
+        // Tiles are padded to full columns in memory, so the out-of-bounds results can be written along with the rest
+    WriteC_TiledOuter:
+        for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+        WriteC_TiledInner:
+            for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+                int n0, m0;
+                TileIndices(t0, t1, flags, n0, m0);
+                if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                    continue;  // Above the diagonal
+                }
+                const int rows = (n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n);
+                WriteContiguous(from_kernel, mem,
+                                (static_cast<long>(n0) * tile_n * tiles_m + static_cast<long>(m0) * rows) *
+                                    tile_m,
+                                static_cast<long>(rows) * tile_m);
+            }
+        }
+        return;
+    }
+WriteC_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    WriteC_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
         WriteC_N:
-            for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN)); ++n1) {
-                WriteCInner<kLinesPerNumber>(from_kernel, mem, size_n, size_m, n0, m0, n1);
+            for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? tile_n : (size_n - n0 * tile_n)); ++n1) {
+                WriteCInner<kLinesPerNumber>(from_kernel, mem, size_n, size_m, tile_n, tile_m, n0, m0, n1);
             }
         }
     }
@@ -330,42 +682,164 @@ WriteC_TilesN:
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void Compute(hlslib::Stream<PackedFloat> &a_in, hlslib::Stream<PackedFloat> &b_in, hlslib::Stream<PackedFloat> &c_in,
-             hlslib::Stream<PackedFloat> &c_out, int const size_n, int const size_k, int const size_m) {
+// The memory modules read and write one number at a time in row-major order, so consecutive numbers along M are
+// grouped into vectors for the processing elements, and split up again before being written back
+void Vectorize(hlslib::Stream<PackedFloat> &in, hlslib::Stream<PackedFloatVector> &out, const long num_vectors) {
+#pragma HLS INLINE
+    PackedFloatVector vec;
+Vectorize_Numbers:
+    for (long i = 0; i < num_vectors * kProcessingElements; ++i) {
+#pragma HLS PIPELINE II = 1
+        // Shift numbers in from the back, so the first number ends up in the first element
+    Vectorize_Shift:
+        for (int pe = 0; pe < kProcessingElements - 1; ++pe) {
+#pragma HLS UNROLL
+            vec.data[pe] = vec.data[pe + 1];
+        }
+        vec.data[kProcessingElements - 1] = in.Pop();
+        if (i % kProcessingElements == kProcessingElements - 1) {
+            out.Push(vec);
+        }
+    }
+}
+
+void Devectorize(hlslib::Stream<PackedFloatVector> &in, hlslib::Stream<PackedFloat> &out, const long num_vectors) {
+#pragma HLS INLINE
+    PackedFloatVector vec;
+Devectorize_Numbers:
+    for (long i = 0; i < num_vectors * kProcessingElements; ++i) {
+#pragma HLS PIPELINE II = 1
+        if (i % kProcessingElements == 0) {
+            vec = in.Pop();
+        }
+        out.Push(vec.data[0]);
+    Devectorize_Shift:
+        for (int pe = 0; pe < kProcessingElements - 1; ++pe) {
+#pragma HLS UNROLL
+            vec.data[pe] = vec.data[pe + 1];
+        }
+    }
+}
+
+void VectorizeB(hlslib::Stream<PackedFloat> &b_to_vectorizer, hlslib::Stream<PackedFloatVector> &b_to_feeder,
+                const int size_n, const int size_k, const int size_m, const int tile_n, const int tile_m,
+                const int row_offset, const int flags) {
+    long num_tiles, num_rows;
+    CountTiles(size_n, size_m, tile_n, tile_m, row_offset, flags, num_tiles, num_rows);
+    Vectorize(b_to_vectorizer, b_to_feeder, num_tiles * size_k * (tile_m / kProcessingElements));
+}
+
+// C initializes the accumulation in the processing elements, unless it is scaled by beta, in which case it is passed
+// on one number at a time to be combined with the drained product
+void VectorizeC(hlslib::Stream<PackedFloat> &c_to_vectorizer, hlslib::Stream<PackedFloatVector> &c_to_feeder,
+                hlslib::Stream<PackedFloat> &c_to_scaler, const int size_n, const int size_m, const int tile_n,
+                const int tile_m, const int row_offset, const int flags) {
+    long num_tiles, num_rows;
+    CountTiles(size_n, size_m, tile_n, tile_m, row_offset, flags, num_tiles, num_rows);
+    if ((flags & kGemmReadC) == 0) {
+        return;
+    }
+    if ((flags & kGemmScaleC) != 0) {
+    VectorizeC_Forward:
+        for (long i = 0; i < num_rows * tile_m; ++i) {
+#pragma HLS PIPELINE II = 1
+            c_to_scaler.Push(c_to_vectorizer.Pop());
+        }
+        return;
+    }
+    Vectorize(c_to_vectorizer, c_to_feeder, num_rows * (tile_m / kProcessingElements));
+}
+
+void DevectorizeC(hlslib::Stream<PackedFloatVector> &drainer_to_devectorizer,
+                  hlslib::Stream<PackedFloat> &devectorizer_to_c, const int size_n, const int size_m, const int tile_n,
+                  const int tile_m, const int row_offset, const int flags) {
+    long num_tiles, num_rows;
+    CountTiles(size_n, size_m, tile_n, tile_m, row_offset, flags, num_tiles, num_rows);
+    Devectorize(drainer_to_devectorizer, devectorizer_to_c, num_rows * (tile_m / kProcessingElements));
+}
+
+// Computes alpha*A*B + beta*C from the drained product, one number per cycle like the writer. Scaling here rather than
+// in the processing elements keeps a single multiply-accumulate unit per element, and costs no passes over the tiles.
+void ScaleC(hlslib::Stream<PackedFloat> &devectorizer_to_scaler, hlslib::Stream<PackedFloat> &c_to_scaler,
+            hlslib::Stream<PackedFloat> &scaler_to_c, const int size_n, const int size_m, const int tile_n,
+            const int tile_m, const int row_offset, PackedFloat const alpha, PackedFloat const beta, const int flags) {
+    long num_tiles, num_rows;
+    CountTiles(size_n, size_m, tile_n, tile_m, row_offset, flags, num_tiles, num_rows);
+    const bool scale_product = (flags & kGemmScaleProduct) != 0;
+    const bool scale_c = (flags & kGemmScaleC) != 0;
+ScaleC_Numbers:
+    for (long i = 0; i < num_rows * tile_m; ++i) {
+#pragma HLS PIPELINE II = 1
+        const PackedFloat product = devectorizer_to_scaler.Pop();
+        const PackedFloat c = scale_c ? c_to_scaler.Pop() : PackedFloat::Zero();
+        const PackedFloat scaled = scale_product ? Multiply(alpha, product) : product;
+        scaler_to_c.Push(scale_c ? MultiplyAccumulate(beta, c, scaled) : scaled);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// One element of the systolic chain. Operands are forwarded to the next element before being used, so the chain never
+// waits on results, which are collected from every element separately by the drain module.
+void ProcessingElement(hlslib::Stream<PackedFloat> &a_in, hlslib::Stream<PackedFloat> &a_out,
+                       hlslib::Stream<PackedFloatVector> &b_in, hlslib::Stream<PackedFloatVector> &b_out,
+                       hlslib::Stream<PackedFloatVector> &c_in, hlslib::Stream<PackedFloatVector> &c_out,
+                       hlslib::Stream<PartialSum> &result_out, int const size_n, int const size_k, int const size_m,
+                       int const tile_n, int const tile_m, int const row_offset, int const flags, int const pe) {
     PackedFloat a_buffer;  // Just to make A symmetric to B and C
-    PackedFloat b_buffer[kTileSizeM];
-    PackedFloat c_buffer[kTileSizeN * kTileSizeM];
-    const int tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
-    const int tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
-Compute_TilesN:
-    for (int n0 = 0; n0 < tiles_n; ++n0) {
-    Compute_TilesM:
-        for (int m0 = 0; m0 < tiles_m; ++m0) {
+    PackedFloat b_buffer[kTileSizeMPerElement];
+    PartialSum c_buffer[kTileSizeN * kTileSizeMPerElement];
+    const int tile_m_per_element = tile_m / kProcessingElements;
+    const int tiles_n = hlslib::CeilDivide(size_n, tile_n);
+    const int tiles_m = hlslib::CeilDivide(size_m, tile_m);
+    const int min_rows = MinPassRows(tile_m);
+    const bool initialize_from_c = (flags & kGemmReadC) != 0 && (flags & kGemmScaleC) == 0;
+    const bool forward = pe < kProcessingElements - 1;
+Compute_TilesOuter:
+    for (int t0 = 0; t0 < OuterTiles(tiles_n, tiles_m, flags); ++t0) {
+    Compute_TilesInner:
+        for (int t1 = 0; t1 < InnerTiles(tiles_n, tiles_m, flags); ++t1) {
+            int n0, m0;
+            TileIndices(t0, t1, flags, n0, m0);
+            if (SkipTile(n0, m0, size_n, tiles_m, tile_n, tile_m, row_offset, flags)) {
+                continue;  // Above the diagonal
+            }
+            const int rows = TileRows(n0, tiles_n, size_n, tile_n);
         Compute_K:
             for (int k = 0; k < size_k; ++k) {
             Compute_N:
-                for (int n1 = 0; n1 < ((n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN)); ++n1) {
+                for (int n1 = 0; n1 < PassRows(rows, min_rows); ++n1) {
                 Compute_M:
-                    for (int m1 = 0; m1 < kTileSizeM; ++m1) {
+                    for (int m1 = 0; m1 < tile_m_per_element; ++m1) {
 #pragma HLS PIPELINE II = 1
 #pragma HLS LOOP_FLATTEN
                         const PackedFloat a_read = a_in.Pop();
-                        const PackedFloat b_read = b_in.Pop();
-                        const PackedFloat c_read = c_in.Pop();
+                        const PackedFloatVector b_read = b_in.Pop();
+                        const PackedFloatVector c_vector = c_in.Pop();
+                        if (forward) {
+                            a_out.Push(a_read);
+                            b_out.Push(b_read);
+                            c_out.Push(c_vector);
+                        }
+                        const PackedFloat c_read = c_vector.data[pe];
                         const PackedFloat a = (m1 == 0) ? a_read : a_buffer;
-                        const PackedFloat b = (n1 == 0) ? b_read : b_buffer[m1];
-                        const PackedFloat c = (k == 0) ? c_read : c_buffer[n1 * kTileSizeM + m1];
+                        const PackedFloat b = (n1 == 0) ? b_read.data[pe] : b_buffer[m1];
+                        const PartialSum c = c_buffer[n1 * tile_m_per_element + m1];
                         a_buffer = a;
                         b_buffer[m1] = b;
-                        // Ignore contributions from out-of-bound indices
-                        const bool in_bounds = (n0 * kTileSizeN + n1 < size_n) && (m0 * kTileSizeM + m1 < size_m);
+                        // Ignore contributions from out-of-bound indices and padding rows, whose results are dropped
+                        const bool in_bounds =
+                            (n1 < rows) && (m0 * tile_m + m1 * kProcessingElements + pe < size_m);
+                        const PartialSum add_c = (k == 0)
+                                                     ? (initialize_from_c ? ToPartialSum(c_read) : PartialSum::Zero())
+                                                     : c;
                         // Meat of the computation
-                        const auto res = MultiplyAccumulate(in_bounds ? a : PackedFloat::Zero(),
-                                                            in_bounds ? b : PackedFloat::Zero(), c);
+                        const PartialSum res = MultiplyAccumulatePartial(in_bounds ? a : PackedFloat::Zero(),
+                                                                         in_bounds ? b : PackedFloat::Zero(), add_c);
                         // Write back to buffer
-                        c_buffer[n1 * kTileSizeM + m1] = res;
+                        c_buffer[n1 * tile_m_per_element + m1] = res;
 #pragma HLS DEPENDENCE variable = c_buffer false
-                        c_out.Push(res);
+                        result_out.Push(res);
                     }
                 }
             }
@@ -376,7 +850,9 @@ Compute_TilesN:
 ////////////////////////////////////////////////////////////////////////////////
 
 void MatrixMultiplication(DramLine const *const a, DramLine const *const b, DramLine const *const c_read,
-                          DramLine *const c_write, const int size_n, const int size_k, int const size_m) {
+                          DramLine *const c_write, const int size_n, const int size_k, int const size_m,
+                          const int tile_n, const int tile_m, const int row_offset, PackedFloat const alpha,
+                          PackedFloat const beta, const int flags) {
 #pragma HLS INTERFACE m_axi offset = slave port = a bundle = a
 #pragma HLS INTERFACE m_axi offset = slave port = b bundle = b
 // Even though they actually point to the same memory location, we use two separate interfaces for reading and writing
@@ -390,6 +866,12 @@ void MatrixMultiplication(DramLine const *const a, DramLine const *const b, Dram
 #pragma HLS INTERFACE s_axilite port = size_n
 #pragma HLS INTERFACE s_axilite port = size_k
 #pragma HLS INTERFACE s_axilite port = size_m
+#pragma HLS INTERFACE s_axilite port = tile_n
+#pragma HLS INTERFACE s_axilite port = tile_m
+#pragma HLS INTERFACE s_axilite port = row_offset
+#pragma HLS INTERFACE s_axilite port = alpha
+#pragma HLS INTERFACE s_axilite port = beta
+#pragma HLS INTERFACE s_axilite port = flags
 #pragma HLS STABLE variable = a
 #pragma HLS STABLE variable = b
 #pragma HLS STABLE variable = c_read
@@ -397,24 +879,321 @@ void MatrixMultiplication(DramLine const *const a, DramLine const *const b, Dram
 #pragma HLS STABLE variable = size_n
 #pragma HLS STABLE variable = size_k
 #pragma HLS STABLE variable = size_m
+#pragma HLS STABLE variable = tile_n
+#pragma HLS STABLE variable = tile_m
+#pragma HLS STABLE variable = row_offset
+#pragma HLS STABLE variable = alpha
+#pragma HLS STABLE variable = beta
+#pragma HLS STABLE variable = flags
+#pragma HLS DATAFLOW
+    hlslib::Stream<PackedFloat, 16> a_to_cache("a_to_cache");
+    hlslib::Stream<PackedFloat, 16> a_to_feeder("a_to_feeder");
+    hlslib::Stream<PackedFloat, 16> b_to_cache("b_to_cache");
+    hlslib::Stream<PackedFloat, 16> b_to_vectorizer("b_to_vectorizer");
+    hlslib::Stream<PackedFloatVector, 16> b_to_feeder("b_to_feeder");
+    hlslib::Stream<PackedFloat, 16> c_to_vectorizer("c_to_vectorizer");
+    hlslib::Stream<PackedFloatVector, 16> c_to_feeder("c_to_feeder");
+    // Element i of each chain feeds processing element i. The last entry is never used.
+    hlslib::Stream<PackedFloat, 16> a_chain[kProcessingElements + 1];
+    hlslib::Stream<PackedFloatVector, 16> b_chain[kProcessingElements + 1];
+    hlslib::Stream<PackedFloatVector, 16> c_chain[kProcessingElements + 1];
+    hlslib::Stream<PartialSum, 16> c_from_elements[kProcessingElements];
+    hlslib::Stream<PackedFloatVector, 16> c_from_drainer("c_from_drainer");
+    hlslib::Stream<PackedFloat, 16> c_to_scaler("c_to_scaler");
+    hlslib::Stream<PackedFloat, 16> c_from_devectorizer("c_from_devectorizer");
+    hlslib::Stream<PackedFloat, 16> c_from_scaler("c_from_scaler");
+    HLSLIB_DATAFLOW_INIT();
+    HLSLIB_DATAFLOW_FUNCTION(ReadA, a, a_to_cache, size_n, size_k, size_m, tile_n, tile_m, row_offset, flags);
+    HLSLIB_DATAFLOW_FUNCTION(CacheA, a_to_cache, a_to_feeder, size_n, size_k, size_m, tile_n, tile_m, row_offset,
+                             flags);
+    HLSLIB_DATAFLOW_FUNCTION(FeedA, a_to_feeder, a_chain[0], size_n, size_k, size_m, tile_n, tile_m, row_offset,
+                             flags);
+    HLSLIB_DATAFLOW_FUNCTION(ReadB, b, b_to_cache, size_n, size_k, size_m, tile_n, tile_m, row_offset, flags);
+    HLSLIB_DATAFLOW_FUNCTION(CacheB, b_to_cache, b_to_vectorizer, size_n, size_k, size_m, tile_n, tile_m, row_offset,
+                             flags);
+    HLSLIB_DATAFLOW_FUNCTION(VectorizeB, b_to_vectorizer, b_to_feeder, size_n, size_k, size_m, tile_n, tile_m,
+                             row_offset, flags);
+    HLSLIB_DATAFLOW_FUNCTION(FeedB, b_to_feeder, b_chain[0], size_n, size_k, size_m, tile_n, tile_m, row_offset,
+                             flags);
+    HLSLIB_DATAFLOW_FUNCTION(ReadC, c_read, c_to_vectorizer, size_n, size_m, tile_n, tile_m, row_offset, flags);
+    HLSLIB_DATAFLOW_FUNCTION(VectorizeC, c_to_vectorizer, c_to_feeder, c_to_scaler, size_n, size_m, tile_n, tile_m,
+                             row_offset, flags);
+    HLSLIB_DATAFLOW_FUNCTION(FeedC, c_to_feeder, c_chain[0], size_n, size_k, size_m, tile_n, tile_m, row_offset,
+                             flags);
+ProcessingElements:
+    for (int pe = 0; pe < kProcessingElements; ++pe) {
+#pragma HLS UNROLL
+        HLSLIB_DATAFLOW_FUNCTION(ProcessingElement, a_chain[pe], a_chain[pe + 1], b_chain[pe], b_chain[pe + 1],
+                                 c_chain[pe], c_chain[pe + 1], c_from_elements[pe], size_n, size_k, size_m, tile_n,
+                                 tile_m, row_offset, flags, pe);
+    }
+    HLSLIB_DATAFLOW_FUNCTION(DrainC, c_from_elements, c_from_drainer, size_n, size_k, size_m, tile_n, tile_m,
+                             row_offset, flags);
+    HLSLIB_DATAFLOW_FUNCTION(DevectorizeC, c_from_drainer, c_from_devectorizer, size_n, size_m, tile_n, tile_m,
+                             row_offset, flags);
+    HLSLIB_DATAFLOW_FUNCTION(ScaleC, c_from_devectorizer, c_to_scaler, c_from_scaler, size_n, size_m, tile_n, tile_m,
+                             row_offset, alpha, beta, flags);
+    HLSLIB_DATAFLOW_FUNCTION(WriteC, c_from_scaler, c_write, size_n, size_m, tile_n, tile_m, row_offset, flags);
+    HLSLIB_DATAFLOW_FINALIZE();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Batched mode: a descriptor table lists many independent problems, which are streamed through a single launch. The
+// memory-facing and feeding modules simply run their single-problem counterparts once per problem, while the compute
+// module runs a single flattened loop across all problems, so its deep pipeline never drains at problem boundaries.
+////////////////////////////////////////////////////////////////////////////////
+
+// Number of modules that consume the descriptor table
+constexpr int kDescriptorConsumers = 12;
+
+void ReadDescriptors(BatchDescriptor const *const descriptors,
+                     hlslib::Stream<BatchDescriptor, 16> to_modules[kDescriptorConsumers],
+                     hlslib::Stream<long> &total_iterations, const int num_problems) {
+    // First pass computes the trip count of the flattened compute loop
+    long total = 0;
+ReadDescriptors_Count:
+    for (int p = 0; p < num_problems; ++p) {
+#pragma HLS PIPELINE II = 1
+        const BatchDescriptor d = descriptors[p];
+        total += PaddedRows(d.size_n, kTileSizeN, kTileSizeM) * d.size_k * hlslib::CeilDivide(d.size_m, kTileSizeM) *
+                 kTileSizeMPerElement;
+    }
+    total_iterations.Push(total);
+ReadDescriptors_Broadcast:
+    for (int p = 0; p < num_problems; ++p) {
+#pragma HLS PIPELINE II = 1
+        const BatchDescriptor d = descriptors[p];
+        for (int i = 0; i < kDescriptorConsumers; ++i) {
+#pragma HLS UNROLL
+            to_modules[i].Push(d);
+        }
+    }
+}
+
+void BatchedReadA(DramLine const *const mem, hlslib::Stream<BatchDescriptor> &descriptors,
+                  hlslib::Stream<PackedFloat> &a_to_feeder, const int num_problems) {
+BatchedReadA_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        ReadA(mem + d.a_offset * kLinesPerNumber, a_to_feeder, d.size_n, d.size_k, d.size_m, kTileSizeN, kTileSizeM,
+              0, kGemmReadC);
+    }
+}
+
+void BatchedFeedA(hlslib::Stream<BatchDescriptor> &descriptors, hlslib::Stream<PackedFloat> &a_to_feeder,
+                  hlslib::Stream<PackedFloat> &a_to_kernel, const int num_problems) {
+BatchedFeedA_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        FeedA(a_to_feeder, a_to_kernel, d.size_n, d.size_k, d.size_m, kTileSizeN, kTileSizeM, 0, kGemmReadC);
+    }
+}
+
+void BatchedReadB(DramLine const *const mem, hlslib::Stream<BatchDescriptor> &descriptors,
+                  hlslib::Stream<PackedFloat> &b_to_feeder, const int num_problems) {
+BatchedReadB_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        ReadB(mem + d.b_offset * kLinesPerNumber, b_to_feeder, d.size_n, d.size_k, d.size_m, kTileSizeN, kTileSizeM,
+              0, kGemmReadC);
+    }
+}
+
+void BatchedVectorizeB(hlslib::Stream<BatchDescriptor> &descriptors, hlslib::Stream<PackedFloat> &b_to_vectorizer,
+                       hlslib::Stream<PackedFloatVector> &b_to_feeder, const int num_problems) {
+BatchedVectorizeB_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        VectorizeB(b_to_vectorizer, b_to_feeder, d.size_n, d.size_k, d.size_m, kTileSizeN, kTileSizeM, 0,
+                   kGemmReadC);
+    }
+}
+
+void BatchedFeedB(hlslib::Stream<BatchDescriptor> &descriptors, hlslib::Stream<PackedFloatVector> &b_to_feeder,
+                  hlslib::Stream<PackedFloatVector> &b_to_kernel, const int num_problems) {
+BatchedFeedB_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        FeedB(b_to_feeder, b_to_kernel, d.size_n, d.size_k, d.size_m, kTileSizeN, kTileSizeM, 0, kGemmReadC);
+    }
+}
+
+void BatchedReadC(DramLine const *const mem, hlslib::Stream<BatchDescriptor> &descriptors,
+                  hlslib::Stream<PackedFloat> &c_to_feeder, const int num_problems) {
+BatchedReadC_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        ReadC(mem + d.c_offset * kLinesPerNumber, c_to_feeder, d.size_n, d.size_m, kTileSizeN, kTileSizeM,
+              0, kGemmReadC);
+    }
+}
+
+void BatchedVectorizeC(hlslib::Stream<BatchDescriptor> &descriptors, hlslib::Stream<PackedFloat> &c_to_vectorizer,
+                       hlslib::Stream<PackedFloatVector> &c_to_feeder, const int num_problems) {
+BatchedVectorizeC_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        long num_tiles, num_rows;
+        CountTiles(d.size_n, d.size_m, kTileSizeN, kTileSizeM, 0, kGemmReadC, num_tiles, num_rows);
+        Vectorize(c_to_vectorizer, c_to_feeder, num_rows * kTileSizeMPerElement);
+    }
+}
+
+void BatchedFeedC(hlslib::Stream<BatchDescriptor> &descriptors, hlslib::Stream<PackedFloatVector> &c_to_feeder,
+                  hlslib::Stream<PackedFloatVector> &c_to_kernel, const int num_problems) {
+BatchedFeedC_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        FeedC(c_to_feeder, c_to_kernel, d.size_n, d.size_k, d.size_m, kTileSizeN, kTileSizeM, 0, kGemmReadC);
+    }
+}
+
+void BatchedDrainC(hlslib::Stream<BatchDescriptor> &descriptors,
+                   hlslib::Stream<PartialSum, 16> c_to_drainer[kProcessingElements],
+                   hlslib::Stream<PackedFloatVector> &drainer_to_c, const int num_problems) {
+BatchedDrainC_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        DrainC(c_to_drainer, drainer_to_c, d.size_n, d.size_k, d.size_m, kTileSizeN, kTileSizeM, 0, kGemmReadC);
+    }
+}
+
+void BatchedDevectorizeC(hlslib::Stream<BatchDescriptor> &descriptors,
+                         hlslib::Stream<PackedFloatVector> &drainer_to_devectorizer,
+                         hlslib::Stream<PackedFloat> &devectorizer_to_c, const int num_problems) {
+BatchedDevectorizeC_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        DevectorizeC(drainer_to_devectorizer, devectorizer_to_c, d.size_n, d.size_m, kTileSizeN, kTileSizeM, 0,
+                     kGemmReadC);
+    }
+}
+
+void BatchedWriteC(hlslib::Stream<BatchDescriptor> &descriptors, hlslib::Stream<PackedFloat> &from_kernel,
+                   DramLine *const mem, const int num_problems) {
+BatchedWriteC_Problems:
+    for (int p = 0; p < num_problems; ++p) {
+        const auto d = descriptors.Pop();
+        WriteC(from_kernel, mem + d.c_offset * kLinesPerNumber, d.size_n, d.size_m, kTileSizeN, kTileSizeM,
+               0, kGemmReadC);
+    }
+}
+
+// Same iteration space and arithmetic as the processing elements, but with the loop nest over all problems flattened
+// into a single pipelined loop, advancing the tile indices manually. Rather than being chained, the processing
+// elements are unrolled within this module, as the control logic is shared between them. Like in the single-problem
+// kernel, passes over tiles with few rows are padded to MinPassRows, so even a problem with a single row waits for the
+// previous update of every partial sum before reading it.
+void BatchedCompute(hlslib::Stream<BatchDescriptor> &descriptors, hlslib::Stream<long> &total_iterations,
+                    hlslib::Stream<PackedFloat> &a_in, hlslib::Stream<PackedFloatVector> &b_in,
+                    hlslib::Stream<PackedFloatVector> &c_in,
+                    hlslib::Stream<PartialSum, 16> c_out[kProcessingElements]) {
+    PackedFloat a_buffer;
+    PackedFloatVector b_buffer[kTileSizeMPerElement];
+    PartialSumVector c_buffer[kTileSizeN * kTileSizeMPerElement];
+    int size_n = 0, size_k = 0, size_m = 0, tiles_n = 0, tiles_m = 0;
+    int n0 = 0, m0 = 0, k = 0, n1 = 0, m1 = 0;
+    bool next_problem = true;
+    constexpr int kMinRows = MinPassRows(kTileSizeM);
+    const long iterations = total_iterations.Pop();
+BatchedCompute_Flattened:
+    for (long i = 0; i < iterations; ++i) {
+#pragma HLS PIPELINE II = 1
+        if (next_problem) {
+            const auto d = descriptors.Pop();
+            size_n = d.size_n;
+            size_k = d.size_k;
+            size_m = d.size_m;
+            tiles_n = hlslib::CeilDivide(size_n, kTileSizeN);
+            tiles_m = hlslib::CeilDivide(size_m, kTileSizeM);
+        }
+        const PackedFloat a_read = a_in.Pop();
+        const PackedFloatVector b_read = b_in.Pop();
+        const PackedFloatVector c_read = c_in.Pop();
+        const PackedFloat a = (m1 == 0) ? a_read : a_buffer;
+        const PackedFloatVector b = (n1 == 0) ? b_read : b_buffer[m1];
+        const PartialSumVector c = c_buffer[n1 * kTileSizeMPerElement + m1];
+        a_buffer = a;
+        b_buffer[m1] = b;
+        const int rows = (n0 < tiles_n - 1) ? kTileSizeN : (size_n - n0 * kTileSizeN);
+        PartialSumVector res;
+    BatchedCompute_Elements:
+        for (int pe = 0; pe < kProcessingElements; ++pe) {
+#pragma HLS UNROLL
+            // Ignore contributions from out-of-bound indices and padding rows
+            const bool in_bounds = (n1 < rows) && (m0 * kTileSizeM + m1 * kProcessingElements + pe < size_m);
+            res.data[pe] = MultiplyAccumulatePartial(in_bounds ? a : PackedFloat::Zero(),
+                                                     in_bounds ? b.data[pe] : PackedFloat::Zero(),
+                                                     (k == 0) ? ToPartialSum(c_read.data[pe]) : c.data[pe]);
+            c_out[pe].Push(res.data[pe]);
+        }
+        c_buffer[n1 * kTileSizeMPerElement + m1] = res;
+#pragma HLS DEPENDENCE variable = c_buffer false
+        // Advance the loop nest n0 -> m0 -> k -> n1 -> m1 of the current problem
+        const int n1_end = PassRows(rows, kMinRows);
+        const bool m1_done = m1 == kTileSizeMPerElement - 1;
+        const bool n1_done = m1_done && n1 == n1_end - 1;
+        const bool k_done = n1_done && k == size_k - 1;
+        const bool m0_done = k_done && m0 == tiles_m - 1;
+        const bool n0_done = m0_done && n0 == tiles_n - 1;
+        m1 = m1_done ? 0 : m1 + 1;
+        n1 = n1_done ? 0 : (m1_done ? n1 + 1 : n1);
+        k = k_done ? 0 : (n1_done ? k + 1 : k);
+        m0 = m0_done ? 0 : (k_done ? m0 + 1 : m0);
+        n0 = n0_done ? 0 : (m0_done ? n0 + 1 : n0);
+        next_problem = n0_done;
+    }
+}
+
+void BatchedMatrixMultiplication(BatchDescriptor const *const descriptors, DramLine const *const a,
+                                 DramLine const *const b, DramLine const *const c_read, DramLine *const c_write,
+                                 const int num_problems) {
+#pragma HLS INTERFACE m_axi offset = slave port = descriptors bundle = descriptors
+#pragma HLS INTERFACE m_axi offset = slave port = a bundle = a
+#pragma HLS INTERFACE m_axi offset = slave port = b bundle = b
+#pragma HLS INTERFACE m_axi offset = slave port = c_read bundle = c_read
+#pragma HLS INTERFACE m_axi offset = slave port = c_write bundle = c_write
+#pragma HLS INTERFACE s_axilite port = descriptors
+#pragma HLS INTERFACE s_axilite port = a
+#pragma HLS INTERFACE s_axilite port = b
+#pragma HLS INTERFACE s_axilite port = c_read
+#pragma HLS INTERFACE s_axilite port = c_write
+#pragma HLS INTERFACE s_axilite port = num_problems
+#pragma HLS STABLE variable = descriptors
+#pragma HLS STABLE variable = a
+#pragma HLS STABLE variable = b
+#pragma HLS STABLE variable = c_read
+#pragma HLS STABLE variable = c_write
+#pragma HLS STABLE variable = num_problems
 #pragma HLS DATAFLOW
+    hlslib::Stream<BatchDescriptor, 16> descriptor_streams[kDescriptorConsumers];
+    hlslib::Stream<long, 1> total_iterations("total_iterations");
     hlslib::Stream<PackedFloat, 16> a_to_feeder("a_to_feeder");
     hlslib::Stream<PackedFloat, 16> a_to_kernel("a_to_kernel");
-    hlslib::Stream<PackedFloat, 16> b_to_feeder("b_to_feeder");
-    hlslib::Stream<PackedFloat, 16> b_to_kernel("b_to_kernel");
-    hlslib::Stream<PackedFloat, 16> c_to_feeder("c_to_feeder");
-    hlslib::Stream<PackedFloat, 16> c_to_kernel("c_to_kernel");
-    hlslib::Stream<PackedFloat, 16> c_from_kernel("c_from_kernel");
-    hlslib::Stream<PackedFloat, 16> c_from_drainer("c_from_drainer");
+    hlslib::Stream<PackedFloat, 16> b_to_vectorizer("b_to_vectorizer");
+    hlslib::Stream<PackedFloatVector, 16> b_to_feeder("b_to_feeder");
+    hlslib::Stream<PackedFloatVector, 16> b_to_kernel("b_to_kernel");
+    hlslib::Stream<PackedFloat, 16> c_to_vectorizer("c_to_vectorizer");
+    hlslib::Stream<PackedFloatVector, 16> c_to_feeder("c_to_feeder");
+    hlslib::Stream<PackedFloatVector, 16> c_to_kernel("c_to_kernel");
+    hlslib::Stream<PartialSum, 16> c_from_kernel[kProcessingElements];
+    hlslib::Stream<PackedFloatVector, 16> c_from_drainer("c_from_drainer");
+    hlslib::Stream<PackedFloat, 16> c_from_devectorizer("c_from_devectorizer");
     HLSLIB_DATAFLOW_INIT();
-    HLSLIB_DATAFLOW_FUNCTION(ReadA, a, a_to_feeder, size_n, size_k, size_m);
-    HLSLIB_DATAFLOW_FUNCTION(FeedA, a_to_feeder, a_to_kernel, size_n, size_k, size_m);
-    HLSLIB_DATAFLOW_FUNCTION(ReadB, b, b_to_feeder, size_n, size_k, size_m);
-    HLSLIB_DATAFLOW_FUNCTION(FeedB, b_to_feeder, b_to_kernel, size_n, size_k, size_m);
-    HLSLIB_DATAFLOW_FUNCTION(ReadC, c_read, c_to_feeder, size_n, size_m);
-    HLSLIB_DATAFLOW_FUNCTION(FeedC, c_to_feeder, c_to_kernel, size_n, size_k, size_m);
-    HLSLIB_DATAFLOW_FUNCTION(Compute, a_to_kernel, b_to_kernel, c_to_kernel, c_from_kernel, size_n, size_k, size_m);
-    HLSLIB_DATAFLOW_FUNCTION(DrainC, c_from_kernel, c_from_drainer, size_n, size_k, size_m);
-    HLSLIB_DATAFLOW_FUNCTION(WriteC, c_from_drainer, c_write, size_n, size_m);
+    HLSLIB_DATAFLOW_FUNCTION(ReadDescriptors, descriptors, descriptor_streams, total_iterations, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedReadA, a, descriptor_streams[0], a_to_feeder, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedFeedA, descriptor_streams[1], a_to_feeder, a_to_kernel, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedReadB, b, descriptor_streams[2], b_to_vectorizer, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedVectorizeB, descriptor_streams[3], b_to_vectorizer, b_to_feeder, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedFeedB, descriptor_streams[4], b_to_feeder, b_to_kernel, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedReadC, c_read, descriptor_streams[5], c_to_vectorizer, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedVectorizeC, descriptor_streams[6], c_to_vectorizer, c_to_feeder, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedFeedC, descriptor_streams[7], c_to_feeder, c_to_kernel, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedCompute, descriptor_streams[8], total_iterations, a_to_kernel, b_to_kernel,
+                             c_to_kernel, c_from_kernel);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedDrainC, descriptor_streams[9], c_from_kernel, c_from_drainer, num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedDevectorizeC, descriptor_streams[10], c_from_drainer, c_from_devectorizer,
+                             num_problems);
+    HLSLIB_DATAFLOW_FUNCTION(BatchedWriteC, descriptor_streams[11], c_from_devectorizer, c_write, num_problems);
     HLSLIB_DATAFLOW_FINALIZE();
 }
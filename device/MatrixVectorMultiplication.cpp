@@ -0,0 +1,217 @@
+#include "MatrixVectorMultiplication.h"
+
+#include <hlslib/xilinx/Simulation.h>
+#include <hlslib/xilinx/Stream.h>
+#include <hlslib/xilinx/Utility.h>  // hlslib::CeilDivide
+
+#include "ArithmeticOperations.h"
+#include "MatrixMultiplication.h"  // kGemmReadC
+
+// A single dot product would make every multiply-accumulate wait for the previous one to leave the pipeline. Instead, A
+// is processed in blocks of kMatrixVectorRows rows by kMatrixVectorChunkSize columns, where each row of a block is read
+// as one burst, and the block is then transposed on chip. Consecutive accumulations into the same row of y are thus
+// kMatrixVectorRows iterations apart, which covers the latency of the multiply-accumulate pipeline. x is read once per
+// block of rows.
+constexpr int kMatrixVectorRows = kMultiplyAccumulateLatency;
+constexpr int kMatrixVectorChunkSize = 16;
+
+void MatrixVectorReadA(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_transposer, const int size_n,
+                       const int size_m) {
+    const auto blocks_n = hlslib::CeilDivide(size_n, kMatrixVectorRows);
+    const auto blocks_m = hlslib::CeilDivide(size_m, kMatrixVectorChunkSize);
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+MatrixVectorReadA_BlocksN:
+    for (int n0 = 0; n0 < blocks_n; ++n0) {
+        const int rows = (n0 < blocks_n - 1) ? kMatrixVectorRows : (size_n - n0 * kMatrixVectorRows);
+    MatrixVectorReadA_BlocksM:
+        for (int m0 = 0; m0 < blocks_m; ++m0) {
+            const int cols = (m0 < blocks_m - 1) ? kMatrixVectorChunkSize : (size_m - m0 * kMatrixVectorChunkSize);
+        MatrixVectorReadA_Rows:
+            for (int n1 = 0; n1 < rows; ++n1) {
+                const long offset =
+                    static_cast<long>(n0 * kMatrixVectorRows + n1) * size_m + m0 * kMatrixVectorChunkSize;
+            MatrixVectorReadA_Lines:
+                for (int i = 0; i < cols * kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+                    num[i % kLinesPerNumber] = mem[offset * kLinesPerNumber + i];
+                    if (i % kLinesPerNumber == kLinesPerNumber - 1) {
+                        to_transposer.Push(PackedFloat(num));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Reorders every block from row-major to column-major order. Blocks are double buffered, so each block is received
+// while the previous one is emitted. Blocks that are partial along N are padded with zeros, so the distance between
+// accumulations into the same row holds for the last block of rows as well.
+void MatrixVectorTranspose(hlslib::Stream<PackedFloat> &from_reader, hlslib::Stream<PackedFloat> &to_kernel,
+                           const int size_n, const int size_m) {
+    PackedFloat buffer[2][kMatrixVectorRows * kMatrixVectorChunkSize];
+#pragma HLS ARRAY_PARTITION variable = buffer complete dim = 1
+    const auto blocks_n = hlslib::CeilDivide(size_n, kMatrixVectorRows);
+    const auto blocks_m = hlslib::CeilDivide(size_m, kMatrixVectorChunkSize);
+    const int num_blocks = blocks_n * blocks_m;
+    int rows_previous = 0;
+    int cols_previous = 0;
+MatrixVectorTranspose_Blocks:
+    for (int b = 0; b <= num_blocks; ++b) {
+        const int n0 = b / blocks_m;
+        const int m0 = b % blocks_m;
+        const bool receive = b < num_blocks;
+        const int rows = !receive ? 0 : (n0 < blocks_n - 1) ? kMatrixVectorRows : (size_n - n0 * kMatrixVectorRows);
+        const int cols =
+            !receive ? 0 : (m0 < blocks_m - 1) ? kMatrixVectorChunkSize : (size_m - m0 * kMatrixVectorChunkSize);
+        const int num_received = rows * cols;
+        const int num_emitted = cols_previous * kMatrixVectorRows;
+        int n1_in = 0, m1_in = 0, n1_out = 0, m1_out = 0;
+    MatrixVectorTranspose_Elements:
+        for (int i = 0; i < ((num_received > num_emitted) ? num_received : num_emitted); ++i) {
+#pragma HLS PIPELINE II = 1
+            if (i < num_received) {
+                buffer[b % 2][n1_in * kMatrixVectorChunkSize + m1_in] = from_reader.Pop();
+                const bool row_done = m1_in == cols - 1;
+                m1_in = row_done ? 0 : m1_in + 1;
+                n1_in = row_done ? n1_in + 1 : n1_in;
+            }
+            if (i < num_emitted) {
+                to_kernel.Push((n1_out < rows_previous) ? buffer[(b + 1) % 2][n1_out * kMatrixVectorChunkSize + m1_out]
+                                                        : PackedFloat::Zero());
+                const bool col_done = n1_out == kMatrixVectorRows - 1;
+                n1_out = col_done ? 0 : n1_out + 1;
+                m1_out = col_done ? m1_out + 1 : m1_out;
+            }
+#pragma HLS DEPENDENCE variable = buffer false
+        }
+        rows_previous = rows;
+        cols_previous = cols;
+    }
+}
+
+// The whole of x is consumed once per block of rows, and y once in total, in both cases front to back
+void MatrixVectorReadX(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_kernel, const int size_n,
+                       const int size_m) {
+    const auto blocks_n = hlslib::CeilDivide(size_n, kMatrixVectorRows);
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+MatrixVectorReadX_BlocksN:
+    for (int n0 = 0; n0 < blocks_n; ++n0) {
+    MatrixVectorReadX_Lines:
+        for (int i = 0; i < size_m * kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+            num[i % kLinesPerNumber] = mem[i];
+            if (i % kLinesPerNumber == kLinesPerNumber - 1) {
+                to_kernel.Push(PackedFloat(num));
+            }
+        }
+    }
+}
+
+void MatrixVectorReadY(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_kernel, const int size_n,
+                       const int flags) {
+    if ((flags & kGemmReadC) == 0) {
+        return;  // y is overwritten
+    }
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+MatrixVectorReadY_Lines:
+    for (int i = 0; i < size_n * kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+        num[i % kLinesPerNumber] = mem[i];
+        if (i % kLinesPerNumber == kLinesPerNumber - 1) {
+            to_kernel.Push(PackedFloat(num));
+        }
+    }
+}
+
+void MatrixVectorCompute(hlslib::Stream<PackedFloat> &a_in, hlslib::Stream<PackedFloat> &x_in,
+                         hlslib::Stream<PackedFloat> &y_in, hlslib::Stream<PackedFloat> &y_out, const int size_n,
+                         const int size_m, const int flags) {
+    PartialSum accumulators[kMatrixVectorRows];
+    PackedFloat x;
+    const bool read_y = (flags & kGemmReadC) != 0;
+    const auto blocks_n = hlslib::CeilDivide(size_n, kMatrixVectorRows);
+    const auto blocks_m = hlslib::CeilDivide(size_m, kMatrixVectorChunkSize);
+MatrixVectorCompute_BlocksN:
+    for (int n0 = 0; n0 < blocks_n; ++n0) {
+        const int rows = (n0 < blocks_n - 1) ? kMatrixVectorRows : (size_n - n0 * kMatrixVectorRows);
+    MatrixVectorCompute_BlocksM:
+        for (int m0 = 0; m0 < blocks_m; ++m0) {
+            const int cols = (m0 < blocks_m - 1) ? kMatrixVectorChunkSize : (size_m - m0 * kMatrixVectorChunkSize);
+        MatrixVectorCompute_M:
+            for (int m1 = 0; m1 < cols; ++m1) {
+            MatrixVectorCompute_N:
+                for (int n1 = 0; n1 < kMatrixVectorRows; ++n1) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_FLATTEN
+                    const PackedFloat a = a_in.Pop();
+                    if (n1 == 0) {
+                        x = x_in.Pop();
+                    }
+                    // Every row starts from y or zero, and padding rows are never written
+                    const bool first = m0 == 0 && m1 == 0;
+                    const bool in_bounds = n1 < rows;
+                    const PackedFloat y = (first && read_y && in_bounds) ? y_in.Pop() : PackedFloat::Zero();
+                    const auto res = MultiplyAccumulatePartial(a, x, first ? ToPartialSum(y) : accumulators[n1]);
+                    accumulators[n1] = res;
+#pragma HLS DEPENDENCE variable = accumulators false
+                    if (m0 == blocks_m - 1 && m1 == cols - 1 && in_bounds) {
+                        y_out.Push(RoundPartialSum(res));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void MatrixVectorWriteY(hlslib::Stream<PackedFloat> &from_kernel, DramLine *const mem, const int size_n) {
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+MatrixVectorWriteY_Lines:
+    for (int i = 0; i < size_n * kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+        if (i % kLinesPerNumber == 0) {
+            from_kernel.Pop().UnpackFlits(num);
+        }
+        mem[i] = num[i % kLinesPerNumber];
+    }
+}
+
+void MatrixVectorMultiplication(DramLine const *const a, DramLine const *const x, DramLine const *const y_read,
+                                DramLine *const y_write, const int size_n, const int size_m, const int flags) {
+#pragma HLS INTERFACE m_axi offset = slave port = a bundle = a
+#pragma HLS INTERFACE m_axi offset = slave port = x bundle = x
+#pragma HLS INTERFACE m_axi offset = slave port = y_read bundle = y_read
+#pragma HLS INTERFACE m_axi offset = slave port = y_write bundle = y_write
+#pragma HLS INTERFACE s_axilite port = a
+#pragma HLS INTERFACE s_axilite port = x
+#pragma HLS INTERFACE s_axilite port = y_read
+#pragma HLS INTERFACE s_axilite port = y_write
+#pragma HLS INTERFACE s_axilite port = size_n
+#pragma HLS INTERFACE s_axilite port = size_m
+#pragma HLS INTERFACE s_axilite port = flags
+#pragma HLS STABLE variable = a
+#pragma HLS STABLE variable = x
+#pragma HLS STABLE variable = y_read
+#pragma HLS STABLE variable = y_write
+#pragma HLS STABLE variable = size_n
+#pragma HLS STABLE variable = size_m
+#pragma HLS STABLE variable = flags
+#pragma HLS DATAFLOW
+    hlslib::Stream<PackedFloat, 16> a_to_transposer("a_to_transposer");
+    hlslib::Stream<PackedFloat, 16> a_to_kernel("a_to_kernel");
+    hlslib::Stream<PackedFloat, 16> x_to_kernel("x_to_kernel");
+    hlslib::Stream<PackedFloat, 16> y_to_kernel("y_to_kernel");
+    hlslib::Stream<PackedFloat, 16> y_from_kernel("y_from_kernel");
+    HLSLIB_DATAFLOW_INIT();
+    HLSLIB_DATAFLOW_FUNCTION(MatrixVectorReadA, a, a_to_transposer, size_n, size_m);
+    HLSLIB_DATAFLOW_FUNCTION(MatrixVectorTranspose, a_to_transposer, a_to_kernel, size_n, size_m);
+    HLSLIB_DATAFLOW_FUNCTION(MatrixVectorReadX, x, x_to_kernel, size_n, size_m);
+    HLSLIB_DATAFLOW_FUNCTION(MatrixVectorReadY, y_read, y_to_kernel, size_n, flags);
+    HLSLIB_DATAFLOW_FUNCTION(MatrixVectorCompute, a_to_kernel, x_to_kernel, y_to_kernel, y_from_kernel, size_n, size_m,
+                             flags);
+    HLSLIB_DATAFLOW_FUNCTION(MatrixVectorWriteY, y_from_kernel, y_write, size_n);
+    HLSLIB_DATAFLOW_FINALIZE();
+}
@@ -105,20 +105,33 @@ void ReadA(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_kernel, co
     Read<kLinesPerNumber>(mem, to_kernel, size);
 }
 
-void ReadB(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_kernel, const int size) {
+void ReadB(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_kernel, const int size, const int operation) {
+    if (operation != kMicrobenchmarkMultiply) {
+        return;  // Unary operation
+    }
     Read<kLinesPerNumber>(mem, to_kernel, size);
 }
 
 void Compute(hlslib::Stream<PackedFloat> &a_in, hlslib::Stream<PackedFloat> &b_in, hlslib::Stream<PackedFloat> &c_out,
-             const int size) {
+             const int size, const int operation) {
 Compute:
     for (int i = 0; i < size; ++i) {
 #pragma HLS PIPELINE II = 1
-        c_out.Push(Multiply(a_in.Pop(), b_in.Pop()));
+        const PackedFloat a = a_in.Pop();
+        if (operation == kMicrobenchmarkMultiply) {
+            c_out.Push(Multiply(a, b_in.Pop()));
+        } else if (operation == kMicrobenchmarkSqrt) {
+            c_out.Push(Sqrt(a));
+        } else if (operation == kMicrobenchmarkSquare) {
+            c_out.Push(Square(a));
+        } else {
+            c_out.Push(InvSqrt(a));
+        }
     }
 }
 
-void Microbenchmark(DramLine const *const a, DramLine const *const b, DramLine *const c, const int size) {
+void Microbenchmark(DramLine const *const a, DramLine const *const b, DramLine *const c, const int size,
+                    const int operation) {
 #pragma HLS INTERFACE m_axi offset = slave port = a bundle = a
 #pragma HLS INTERFACE m_axi offset = slave port = b bundle = b
 #pragma HLS INTERFACE m_axi offset = slave port = c bundle = c
@@ -126,18 +139,20 @@ void Microbenchmark(DramLine const *const a, DramLine const *const b, DramLine *
 #pragma HLS INTERFACE s_axilite port = b
 #pragma HLS INTERFACE s_axilite port = c
 #pragma HLS INTERFACE s_axilite port = size
+#pragma HLS INTERFACE s_axilite port = operation
 #pragma HLS STABLE variable = a
 #pragma HLS STABLE variable = b
 #pragma HLS STABLE variable = c
 #pragma HLS STABLE variable = size
+#pragma HLS STABLE variable = operation
 #pragma HLS DATAFLOW
     hlslib::Stream<PackedFloat, 16> a_to_kernel("a_to_kernel");
     hlslib::Stream<PackedFloat, 16> b_to_kernel("b_to_kernel");
     hlslib::Stream<PackedFloat, 16> c_from_kernel("c_from_kernel");
     HLSLIB_DATAFLOW_INIT();
     HLSLIB_DATAFLOW_FUNCTION(ReadA, a, a_to_kernel, size);
-    HLSLIB_DATAFLOW_FUNCTION(ReadB, b, b_to_kernel, size);
-    HLSLIB_DATAFLOW_FUNCTION(Compute, a_to_kernel, b_to_kernel, c_from_kernel, size);
+    HLSLIB_DATAFLOW_FUNCTION(ReadB, b, b_to_kernel, size, operation);
+    HLSLIB_DATAFLOW_FUNCTION(Compute, a_to_kernel, b_to_kernel, c_from_kernel, size, operation);
     HLSLIB_DATAFLOW_FUNCTION(Write<kLinesPerNumber>, c_from_kernel, c, size);
     HLSLIB_DATAFLOW_FINALIZE();
 }
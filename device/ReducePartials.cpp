@@ -0,0 +1,100 @@
+#include "ReducePartials.h"
+
+#include <hlslib/xilinx/Simulation.h>
+#include <hlslib/xilinx/Stream.h>
+#include <hlslib/xilinx/Utility.h>  // hlslib::CeilDivide
+
+#include "ArithmeticOperations.h"
+
+// The partials are summed one chunk of kReduceChunkSize numbers at a time. The chunk is initialized from the first
+// partial, after which the matching chunk of every following partial is added to it in turn. Consecutive additions to
+// the same number are thus a full chunk apart, the same distance as between the passes of the matrix multiplication
+// kernel producing the partials, and every chunk of every partial is read as a single contiguous burst.
+constexpr int kReduceChunkSize = kMinTileIterations;
+static_assert(kReduceChunkSize >= kMultiplyAccumulateLatency,
+              "Additions into the same number must be further apart than the latency of the adder.");
+
+void ReducePartialsRead(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_reducer, const int num_partials,
+                        const int size) {
+    const auto num_chunks = hlslib::CeilDivide(size, kReduceChunkSize);
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+ReducePartialsRead_Chunks:
+    for (int c0 = 0; c0 < num_chunks; ++c0) {
+        const int chunk = (c0 < num_chunks - 1) ? kReduceChunkSize : (size - c0 * kReduceChunkSize);
+    ReducePartialsRead_Partials:
+        for (int p = 0; p < num_partials; ++p) {
+            const long offset = static_cast<long>(p) * size + c0 * kReduceChunkSize;
+        ReducePartialsRead_Lines:
+            for (int i = 0; i < chunk * kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+                num[i % kLinesPerNumber] = mem[offset * kLinesPerNumber + i];
+                if (i % kLinesPerNumber == kLinesPerNumber - 1) {
+                    to_reducer.Push(PackedFloat(num));
+                }
+            }
+        }
+    }
+}
+
+void ReducePartialsAdd(hlslib::Stream<PackedFloat> &from_reader, hlslib::Stream<PackedFloat> &to_writer,
+                       const int num_partials, const int size) {
+    PackedFloat buffer[kReduceChunkSize];
+    const auto num_chunks = hlslib::CeilDivide(size, kReduceChunkSize);
+ReducePartialsAdd_Chunks:
+    for (int c0 = 0; c0 < num_chunks; ++c0) {
+        const int chunk = (c0 < num_chunks - 1) ? kReduceChunkSize : (size - c0 * kReduceChunkSize);
+    ReducePartialsAdd_Partials:
+        for (int p = 0; p < num_partials; ++p) {
+            // Always run over the full chunk, so the dependency distance holds for the last, partial chunk as well
+        ReducePartialsAdd_Elements:
+            for (int i = 0; i < kReduceChunkSize; ++i) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_FLATTEN
+                if (i < chunk) {
+                    const PackedFloat x = from_reader.Pop();
+                    const PackedFloat sum = (p == 0) ? x : Add(buffer[i], x);
+                    buffer[i] = sum;
+#pragma HLS DEPENDENCE variable = buffer false
+                    if (p == num_partials - 1) {
+                        to_writer.Push(sum);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ReducePartialsWrite(hlslib::Stream<PackedFloat> &from_reducer, DramLine *const mem, const int size) {
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+ReducePartialsWrite_Lines:
+    for (long i = 0; i < static_cast<long>(size) * kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+        if (i % kLinesPerNumber == 0) {
+            from_reducer.Pop().UnpackFlits(num);
+        }
+        mem[i] = num[i % kLinesPerNumber];
+    }
+}
+
+void ReducePartials(DramLine const *const partials, DramLine *const result, const int num_partials, const int size) {
+#pragma HLS INTERFACE m_axi offset = slave port = partials bundle = partials
+#pragma HLS INTERFACE m_axi offset = slave port = result bundle = result
+#pragma HLS INTERFACE s_axilite port = partials
+#pragma HLS INTERFACE s_axilite port = result
+#pragma HLS INTERFACE s_axilite port = num_partials
+#pragma HLS INTERFACE s_axilite port = size
+#pragma HLS STABLE variable = partials
+#pragma HLS STABLE variable = result
+#pragma HLS STABLE variable = num_partials
+#pragma HLS STABLE variable = size
+#pragma HLS DATAFLOW
+    hlslib::Stream<PackedFloat, 16> reader_to_reducer("reader_to_reducer");
+    hlslib::Stream<PackedFloat, 16> reducer_to_writer("reducer_to_writer");
+    HLSLIB_DATAFLOW_INIT();
+    HLSLIB_DATAFLOW_FUNCTION(ReducePartialsRead, partials, reader_to_reducer, num_partials, size);
+    HLSLIB_DATAFLOW_FUNCTION(ReducePartialsAdd, reader_to_reducer, reducer_to_writer, num_partials, size);
+    HLSLIB_DATAFLOW_FUNCTION(ReducePartialsWrite, reducer_to_writer, result, size);
+    HLSLIB_DATAFLOW_FINALIZE();
+}
@@ -0,0 +1,118 @@
+#include "Reduction.h"
+
+#include <hlslib/xilinx/Simulation.h>
+#include <hlslib/xilinx/Stream.h>
+#include <hlslib/xilinx/Utility.h>  // hlslib::CeilDivide
+
+#include "ArithmeticOperations.h"
+
+void ReductionRead(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_kernel, const int size) {
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+ReductionRead_Lines:
+    for (long i = 0; i < static_cast<long>(size) * kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+        num[i % kLinesPerNumber] = mem[i];
+        if (i % kLinesPerNumber == kLinesPerNumber - 1) {
+            to_kernel.Push(PackedFloat(num));
+        }
+    }
+}
+
+void ReductionReadX(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_kernel, const int size) {
+    ReductionRead(mem, to_kernel, size);
+}
+
+void ReductionReadY(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_kernel, const int size,
+                    const int mode) {
+    if (mode != kReductionDot) {
+        return;  // The second operand is x itself, or not used at all
+    }
+    ReductionRead(mem, to_kernel, size);
+}
+
+// Number of pairwise merges that reduce the given number of partial sums to one
+constexpr int ReductionLevels(const int lanes) {
+    int levels = 0;
+    for (int l = lanes; l > 1; l /= 2) {
+        ++levels;
+    }
+    return levels;
+}
+
+void ReductionCompute(hlslib::Stream<PackedFloat> &x_in, hlslib::Stream<PackedFloat> &y_in,
+                      hlslib::Stream<PackedFloat> &result_out, const int size, const int mode) {
+    PackedFloat accumulators[kReductionLanes];
+    const auto rounds = hlslib::CeilDivide(size, kReductionLanes);
+    // Every update goes through a single multiply-accumulate unit: sums multiply by one, and so do the pairwise merges
+    // of the partial sums, which run as extra rounds after the input rounds. Always run over all lanes, so the distance
+    // between updates of the same partial sum holds for the last round and across the merge levels.
+ReductionCompute_Rounds:
+    for (int r = 0; r < rounds + ReductionLevels(kReductionLanes); ++r) {
+    ReductionCompute_Lanes:
+        for (int l = 0; l < kReductionLanes; ++l) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_FLATTEN
+            const bool merge = r >= rounds;
+            // A merge level adds the second half of the remaining partial sums to the first half. Its lanes are issued
+            // at the end of the round, so that each one reads partial sums written exactly one round earlier.
+            const int stride = merge ? (kReductionLanes >> (r - rounds + 1)) : 0;
+            const int lane = merge ? l - (kReductionLanes - stride) : l;
+            if (merge ? lane >= 0 : r * kReductionLanes + l < size) {
+                PackedFloat a, b, c;
+                if (merge) {
+                    a = accumulators[lane + stride];
+                    b = PackedFloat::One();
+                    c = accumulators[lane];
+                } else {
+                    a = x_in.Pop();
+                    b = (mode == kReductionDot) ? y_in.Pop() : (mode == kReductionSum) ? PackedFloat::One() : a;
+                    c = (r == 0) ? PackedFloat::Zero() : accumulators[l];
+                }
+                accumulators[lane] = MultiplyAccumulate(a, b, c);
+            } else if (r == 0) {
+                accumulators[l] = PackedFloat::Zero();
+            }
+#pragma HLS DEPENDENCE variable = accumulators false
+        }
+    }
+    result_out.Push(accumulators[0]);
+}
+
+void ReductionWrite(hlslib::Stream<PackedFloat> &from_kernel, DramLine *const mem) {
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+    from_kernel.Pop().UnpackFlits(num);
+ReductionWrite_Lines:
+    for (int i = 0; i < kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+        mem[i] = num[i];
+    }
+}
+
+void Reduction(DramLine const *const x, DramLine const *const y, DramLine *const result, const int size,
+               const int mode) {
+#pragma HLS INTERFACE m_axi offset = slave port = x bundle = x
+#pragma HLS INTERFACE m_axi offset = slave port = y bundle = y
+#pragma HLS INTERFACE m_axi offset = slave port = result bundle = result
+#pragma HLS INTERFACE s_axilite port = x
+#pragma HLS INTERFACE s_axilite port = y
+#pragma HLS INTERFACE s_axilite port = result
+#pragma HLS INTERFACE s_axilite port = size
+#pragma HLS INTERFACE s_axilite port = mode
+#pragma HLS STABLE variable = x
+#pragma HLS STABLE variable = y
+#pragma HLS STABLE variable = result
+#pragma HLS STABLE variable = size
+#pragma HLS STABLE variable = mode
+#pragma HLS DATAFLOW
+    hlslib::Stream<PackedFloat, 16> x_to_kernel("x_to_kernel");
+    hlslib::Stream<PackedFloat, 16> y_to_kernel("y_to_kernel");
+    hlslib::Stream<PackedFloat, 16> result_from_kernel("result_from_kernel");
+    HLSLIB_DATAFLOW_INIT();
+    HLSLIB_DATAFLOW_FUNCTION(ReductionReadX, x, x_to_kernel, size);
+    HLSLIB_DATAFLOW_FUNCTION(ReductionReadY, y, y_to_kernel, size, mode);
+    HLSLIB_DATAFLOW_FUNCTION(ReductionCompute, x_to_kernel, y_to_kernel, result_from_kernel, size, mode);
+    HLSLIB_DATAFLOW_FUNCTION(ReductionWrite, result_from_kernel, result);
+    HLSLIB_DATAFLOW_FINALIZE();
+}
@@ -0,0 +1,184 @@
+#include "Transpose.h"
+
+#include <hlslib/xilinx/Simulation.h>
+#include <hlslib/xilinx/Stream.h>
+#include <hlslib/xilinx/Utility.h>  // hlslib::CeilDivide
+
+#include "PackedFloat.h"
+
+// The matrix is traversed in kTransposeTileSize x kTransposeTileSize tiles. Each row of a tile is read as a contiguous
+// burst, buffered on chip, and written back out as a contiguous burst along the rows of the output.
+
+template <int lines_per_number>
+void TransposeReadInner(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_buffer, const int size_cols,
+                        const int row, const int col, const int cols_in_tile) {
+#pragma HLS INLINE
+    DramLine num[kLinesPerNumber];
+TransposeRead_Cols:
+    for (int c1 = 0; c1 < cols_in_tile; ++c1) {
+    TransposeRead_Flits:
+        for (int i = 0; i < kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_FLATTEN
+            num[i] = mem[(row * size_cols + col + c1) * kLinesPerNumber + i];
+            if (i == kLinesPerNumber - 1) {
+                to_buffer.Push(PackedFloat(num));
+            }
+        }
+    }
+}
+
+template <>
+void TransposeReadInner<1>(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_buffer, const int size_cols,
+                           const int row, const int col, const int cols_in_tile) {
+#pragma HLS INLINE
+TransposeRead_Cols:
+    for (int c1 = 0; c1 < cols_in_tile; ++c1) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_FLATTEN
+        DramLine num[1];
+        num[0] = mem[row * size_cols + col + c1];
+        to_buffer.Push(PackedFloat(num));
+    }
+}
+
+void TransposeRead(DramLine const *const mem, hlslib::Stream<PackedFloat> &to_buffer, const int size_rows,
+                   const int size_cols, const int col_begin, const int col_count) {
+    const auto tiles_r = hlslib::CeilDivide(size_rows, kTransposeTileSize);
+    const auto tiles_c = hlslib::CeilDivide(col_count, kTransposeTileSize);
+TransposeRead_TilesC:
+    for (int c0 = 0; c0 < tiles_c; ++c0) {
+    TransposeRead_TilesR:
+        for (int r0 = 0; r0 < tiles_r; ++r0) {
+        TransposeRead_Rows:
+            for (int r1 = 0; r1 < ((r0 < tiles_r - 1) ? kTransposeTileSize : (size_rows - r0 * kTransposeTileSize));
+                 ++r1) {
+                TransposeReadInner<kLinesPerNumber>(
+                    mem, to_buffer, size_cols, r0 * kTransposeTileSize + r1, col_begin + c0 * kTransposeTileSize,
+                    (c0 < tiles_c - 1) ? kTransposeTileSize : (col_count - c0 * kTransposeTileSize));
+            }
+        }
+    }
+}
+
+// Double buffered on-chip tile: while one tile is being filled in row-major order, the previous one is emptied in
+// column-major order, so both sides run at one number per cycle.
+void TransposeTile(hlslib::Stream<PackedFloat> &from_reader, hlslib::Stream<PackedFloat> &to_writer,
+                   const int size_rows, const int col_count) {
+    PackedFloat tile[2][kTransposeTileSize * kTransposeTileSize];
+#pragma HLS ARRAY_PARTITION variable = tile complete dim = 1
+    const auto tiles_r = hlslib::CeilDivide(size_rows, kTransposeTileSize);
+    const auto tiles_c = hlslib::CeilDivide(col_count, kTransposeTileSize);
+    const int num_tiles = tiles_r * tiles_c;
+    int r0_in = 0, c0_in = 0, r0_out = 0, c0_out = 0;
+TransposeTile_Tiles:
+    for (int t = 0; t < num_tiles + 1; ++t) {
+        const int rows_in = (r0_in < tiles_r - 1) ? kTransposeTileSize : (size_rows - r0_in * kTransposeTileSize);
+        const int cols_in = (c0_in < tiles_c - 1) ? kTransposeTileSize : (col_count - c0_in * kTransposeTileSize);
+        const int rows_out = (r0_out < tiles_r - 1) ? kTransposeTileSize : (size_rows - r0_out * kTransposeTileSize);
+        const int cols_out = (c0_out < tiles_c - 1) ? kTransposeTileSize : (col_count - c0_out * kTransposeTileSize);
+    TransposeTile_Elements:
+        for (int i = 0; i < kTransposeTileSize * kTransposeTileSize; ++i) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS DEPENDENCE variable = tile inter false
+            // Fill the current tile in row-major order
+            const int r1_in = i / kTransposeTileSize;
+            const int c1_in = i % kTransposeTileSize;
+            if (t < num_tiles && r1_in < rows_in && c1_in < cols_in) {
+                tile[t % 2][r1_in * kTransposeTileSize + c1_in] = from_reader.Pop();
+            }
+            // Drain the previous tile in column-major order
+            const int c1_out = i / kTransposeTileSize;
+            const int r1_out = i % kTransposeTileSize;
+            if (t > 0 && c1_out < cols_out && r1_out < rows_out) {
+                to_writer.Push(tile[(t + 1) % 2][r1_out * kTransposeTileSize + c1_out]);
+            }
+        }
+        // Tiles are traversed with rows innermost, matching the reader and writer
+        if (t > 0) {
+            r0_out = (r0_out == tiles_r - 1) ? 0 : r0_out + 1;
+            c0_out = (r0_out == 0) ? c0_out + 1 : c0_out;
+        }
+        r0_in = (r0_in == tiles_r - 1) ? 0 : r0_in + 1;
+        c0_in = (r0_in == 0) ? c0_in + 1 : c0_in;
+    }
+}
+
+template <int lines_per_number>
+void TransposeWriteInner(hlslib::Stream<PackedFloat> &from_buffer, DramLine *const mem, const int size_rows,
+                         const int row, const int col, const int rows_in_tile) {
+#pragma HLS INLINE
+    DramLine num[kLinesPerNumber];
+#pragma HLS ARRAY_PARTITION variable = num complete
+TransposeWrite_Rows:
+    for (int r1 = 0; r1 < rows_in_tile; ++r1) {
+    TransposeWrite_Flits:
+        for (int i = 0; i < kLinesPerNumber; ++i) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_FLATTEN
+            if (i == 0) {
+                from_buffer.Pop().UnpackFlits(num);
+            }
+            mem[(col * size_rows + row + r1) * kLinesPerNumber + i] = num[i];
+        }
+    }
+}
+
+template <>
+void TransposeWriteInner<1>(hlslib::Stream<PackedFloat> &from_buffer, DramLine *const mem, const int size_rows,
+                            const int row, const int col, const int rows_in_tile) {
+#pragma HLS INLINE
+TransposeWrite_Rows:
+    for (int r1 = 0; r1 < rows_in_tile; ++r1) {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_FLATTEN
+        DramLine num[1];
+        from_buffer.Pop().UnpackFlits(num);
+        mem[col * size_rows + row + r1] = num[0];
+    }
+}
+
+void TransposeWrite(hlslib::Stream<PackedFloat> &from_buffer, DramLine *const mem, const int size_rows,
+                    const int col_count) {
+    const auto tiles_r = hlslib::CeilDivide(size_rows, kTransposeTileSize);
+    const auto tiles_c = hlslib::CeilDivide(col_count, kTransposeTileSize);
+TransposeWrite_TilesC:
+    for (int c0 = 0; c0 < tiles_c; ++c0) {
+    TransposeWrite_TilesR:
+        for (int r0 = 0; r0 < tiles_r; ++r0) {
+        TransposeWrite_Cols:
+            for (int c1 = 0; c1 < ((c0 < tiles_c - 1) ? kTransposeTileSize : (col_count - c0 * kTransposeTileSize));
+                 ++c1) {
+                TransposeWriteInner<kLinesPerNumber>(
+                    from_buffer, mem, size_rows, r0 * kTransposeTileSize, c0 * kTransposeTileSize + c1,
+                    (r0 < tiles_r - 1) ? kTransposeTileSize : (size_rows - r0 * kTransposeTileSize));
+            }
+        }
+    }
+}
+
+void Transpose(DramLine const *const input, DramLine *const output, const int size_rows, const int size_cols,
+               const int col_begin, const int col_count) {
+#pragma HLS INTERFACE m_axi offset = slave port = input bundle = input
+#pragma HLS INTERFACE m_axi offset = slave port = output bundle = output
+#pragma HLS INTERFACE s_axilite port = input
+#pragma HLS INTERFACE s_axilite port = output
+#pragma HLS INTERFACE s_axilite port = size_rows
+#pragma HLS INTERFACE s_axilite port = size_cols
+#pragma HLS INTERFACE s_axilite port = col_begin
+#pragma HLS INTERFACE s_axilite port = col_count
+#pragma HLS STABLE variable = input
+#pragma HLS STABLE variable = output
+#pragma HLS STABLE variable = size_rows
+#pragma HLS STABLE variable = size_cols
+#pragma HLS STABLE variable = col_begin
+#pragma HLS STABLE variable = col_count
+#pragma HLS DATAFLOW
+    hlslib::Stream<PackedFloat, 16> reader_to_buffer("reader_to_buffer");
+    hlslib::Stream<PackedFloat, 16> buffer_to_writer("buffer_to_writer");
+    HLSLIB_DATAFLOW_INIT();
+    HLSLIB_DATAFLOW_FUNCTION(TransposeRead, input, reader_to_buffer, size_rows, size_cols, col_begin, col_count);
+    HLSLIB_DATAFLOW_FUNCTION(TransposeTile, reader_to_buffer, buffer_to_writer, size_rows, col_count);
+    HLSLIB_DATAFLOW_FUNCTION(TransposeWrite, buffer_to_writer, output, size_rows, col_count);
+    HLSLIB_DATAFLOW_FINALIZE();
+}
@@ -0,0 +1,74 @@
+#include <gmp.h>
+#include <mpfr.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Conversion.h"
+#include "DeviceTypes.h"
+#include "PackedFloat.h"
+#include "Random.h"
+
+// Measures the host-side conversion between MPFR numbers and PackedFloat, which bounds the rate at which matrices can
+// be uploaded and downloaded, comparing a single thread against the conversion engine used by the transfers
+
+template <typename Func>
+double Seconds(Func const &func) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    func();
+    const auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+void Report(std::string const &name, std::size_t size, double seconds) {
+    std::cout << name << ": " << seconds << " seconds, " << 1e-6 * size / seconds << " M numbers/s, "
+              << 1e-9 * size * sizeof(PackedFloat) / seconds << " GB/s\n";
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " n <threads>\n";
+        return 1;
+    }
+    const std::size_t size = std::stoul(argv[1]);
+    const unsigned num_threads = (argc == 3) ? std::stoul(argv[2]) : std::thread::hardware_concurrency();
+
+    std::cout << "Initializing input data..." << std::flush;
+    std::vector<mpfr_t> numbers(size);
+    RandomNumberGenerator rng;
+    for (auto &x : numbers) {
+        mpfr_init2(x, kMantissaBits);
+        rng.Generate(x);
+    }
+    std::vector<PackedFloat> packed(size);
+    std::cout << " Done.\n";
+
+    const double pack_serial = Seconds([&]() {
+        for (std::size_t i = 0; i < size; ++i) {
+            packed[i] = PackedFloat(numbers[i]);
+        }
+    });
+    const double unpack_serial = Seconds([&]() {
+        for (std::size_t i = 0; i < size; ++i) {
+            packed[i].ToMpfr(numbers[i]);
+        }
+    });
+
+    ConversionEngine converter(num_threads);
+    const double pack_parallel = Seconds([&]() { converter.Pack(numbers.data(), size, packed.data()); });
+    const double unpack_parallel = Seconds([&]() { converter.Unpack(packed.data(), size, numbers.data()); });
+
+    std::cout << "Converting " << size << " numbers of " << kBits << " bits:\n";
+    Report("Pack (1 thread)", size, pack_serial);
+    Report("Pack (" + std::to_string(converter.num_threads()) + " threads)", size, pack_parallel);
+    Report("Unpack (1 thread)", size, unpack_serial);
+    Report("Unpack (" + std::to_string(converter.num_threads()) + " threads)", size, unpack_parallel);
+
+    for (auto &x : numbers) {
+        mpfr_clear(x);
+    }
+    return 0;
+}
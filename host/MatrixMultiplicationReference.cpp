@@ -2,17 +2,184 @@
 
 #include <gmp.h>
 
-void MatrixMultiplicationReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size_n, int size_k, int size_m) {
+#include <algorithm>  // std::min
+
+#include "ArithmeticOperations.h"  // kAccumulatorBits, kAccumulatorFractionBits
+#include "MatrixMultiplication.h"  // GemmFlags
+
+namespace {
+
+// Multiplies z by 2^shift, truncating toward zero
+void ShiftTruncated(mpz_ptr z, mpfr_exp_t shift) {
+    if (shift >= 0) {
+        mpz_mul_2exp(z, z, shift);
+    } else {
+        mpz_tdiv_q_2exp(z, z, -shift);
+    }
+}
+
+// Shifting by the full width of the device accumulator already leaves 0 or -1
+mp_bitcnt_t SaturateShift(mpfr_exp_t shift) {
+    return std::min<mpfr_exp_t>(shift, kAccumulatorBits);
+}
+
+// Adds the products of row n of A and column m of B over [k_begin, k_end) to acc, in the same order and with the same
+// rounding as the processing elements
+void AccumulateProducts(mpfr_ptr acc, mpfr_t const *a, mpfr_t const *b, int size_k, int size_m, int n, int m,
+                        int k_begin, int k_end) {
+#ifdef APFP_LONG_ACCUMULATOR
+    LongAccumulatorReference sum;
+    sum.Set(acc);
+    for (int k = k_begin; k < k_end; ++k) {
+        sum.AddProduct(a[n * size_k + k], b[k * size_m + m]);
+    }
+    sum.Get(acc);
+#else
     mpfr_t tmp;
     mpfr_init2(tmp, kMantissaBits);
+    for (int k = k_begin; k < k_end; ++k) {
+        mpfr_mul(tmp, a[n * size_k + k], b[k * size_m + m], kRoundingMode);
+        mpfr_add(acc, acc, tmp, kRoundingMode);
+    }
+    mpfr_clear(tmp);
+#endif
+}
+
+}  // namespace
+
+void MatrixMultiplicationReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size_n, int size_k, int size_m) {
+    for (int n = 0; n < size_n; ++n) {
+        for (int m = 0; m < size_m; ++m) {
+            AccumulateProducts(c[n * size_m + m], a, b, size_k, size_m, n, m, 0, size_k);
+        }
+    }
+}
+
+void MatrixMultiplicationReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size_n, int size_k, int size_m,
+                                   mpfr_srcptr alpha, mpfr_srcptr beta) {
+    const int flags = GemmFlags(mpfr_cmp_ui(alpha, 1) == 0, mpfr_zero_p(beta) != 0, mpfr_cmp_ui(beta, 1) == 0);
+    if (flags == kGemmReadC) {
+        MatrixMultiplicationReference(a, b, c, size_n, size_k, size_m);
+        return;
+    }
+    // The device accumulates the product from zero, then scales it by alpha and adds beta*C as it is written back
+    mpfr_t tmp, acc;
+    mpfr_init2(tmp, kMantissaBits);
+    mpfr_init2(acc, kMantissaBits);
     for (int n = 0; n < size_n; ++n) {
-        for (int k = 0; k < size_k; ++k) {
-            for (int m = 0; m < size_m; ++m) {
-                mpfr_mul(tmp, a[n * size_k + k], b[k * size_m + m], kRoundingMode);
-                mpfr_t &_c = c[n * size_m + m];
-                mpfr_add(_c, _c, tmp, kRoundingMode);
+        for (int m = 0; m < size_m; ++m) {
+            mpfr_set_ui(acc, 0, kRoundingMode);
+            AccumulateProducts(acc, a, b, size_k, size_m, n, m, 0, size_k);
+            if (flags & kGemmScaleProduct) {
+                mpfr_mul(acc, alpha, acc, kRoundingMode);
+            }
+            mpfr_t &_c = c[n * size_m + m];
+            if (flags & kGemmReadC) {
+                mpfr_mul(tmp, beta, _c, kRoundingMode);
+                mpfr_add(_c, acc, tmp, kRoundingMode);
+            } else {
+                mpfr_set(_c, acc, kRoundingMode);
             }
         }
     }
+    mpfr_clear(acc);
     mpfr_clear(tmp);
 }
+
+void MatrixMultiplicationSplitKReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size_n, int size_k,
+                                         int size_m, mpfr_srcptr alpha, mpfr_srcptr beta,
+                                         std::vector<int> const &k_begin) {
+    const int flags = GemmFlags(mpfr_cmp_ui(alpha, 1) == 0, mpfr_zero_p(beta) != 0, mpfr_cmp_ui(beta, 1) == 0);
+    const int num_partials = static_cast<int>(k_begin.size()) - 1;
+    mpfr_t tmp, acc, sum;
+    mpfr_init2(tmp, kMantissaBits);
+    mpfr_init2(acc, kMantissaBits);
+    mpfr_init2(sum, kMantissaBits);
+    for (int n = 0; n < size_n; ++n) {
+        for (int m = 0; m < size_m; ++m) {
+            mpfr_t &_c = c[n * size_m + m];
+            for (int p = 0; p < num_partials; ++p) {
+                // Only the first partial reads C, while the others overwrite their scratch output
+                const int partial_flags = (p == 0) ? flags : (flags & kGemmScaleProduct);
+                if (partial_flags == kGemmReadC) {
+                    mpfr_set(acc, _c, kRoundingMode);
+                } else {
+                    mpfr_set_ui(acc, 0, kRoundingMode);
+                }
+                AccumulateProducts(acc, a, b, size_k, size_m, n, m, k_begin[p], k_begin[p + 1]);
+                if (partial_flags & kGemmScaleProduct) {
+                    mpfr_mul(acc, alpha, acc, kRoundingMode);
+                }
+                if (partial_flags & kGemmScaleC) {
+                    mpfr_mul(tmp, beta, _c, kRoundingMode);
+                    mpfr_add(acc, acc, tmp, kRoundingMode);
+                }
+                if (p == 0) {
+                    mpfr_set(sum, acc, kRoundingMode);
+                } else {
+                    mpfr_add(sum, sum, acc, kRoundingMode);
+                }
+            }
+            mpfr_set(_c, sum, kRoundingMode);
+        }
+    }
+    mpfr_clear(sum);
+    mpfr_clear(acc);
+    mpfr_clear(tmp);
+}
+
+LongAccumulatorReference::LongAccumulatorReference() : exponent_(0) {
+    mpz_init(value_);
+    mpz_init(term_);
+}
+
+LongAccumulatorReference::~LongAccumulatorReference() {
+    mpz_clear(term_);
+    mpz_clear(value_);
+}
+
+void LongAccumulatorReference::Set(mpfr_srcptr c) {
+    if (mpfr_zero_p(c)) {
+        mpz_set_ui(value_, 0);
+        exponent_ = 0;
+        return;
+    }
+    exponent_ = mpfr_get_exp(c);
+    ShiftTruncated(value_, mpfr_get_z_2exp(value_, c) + kAccumulatorFractionBits - exponent_);
+}
+
+void LongAccumulatorReference::AddProduct(mpfr_srcptr a, mpfr_srcptr b) {
+    if (mpfr_zero_p(a) || mpfr_zero_p(b)) {
+        return;
+    }
+    // The product of the full mantissas is truncated to the fraction bits, without being normalized first
+    const mpfr_exp_t term_exponent = mpfr_get_exp(a) + mpfr_get_exp(b);
+    mpz_t b_mantissa;
+    mpz_init(b_mantissa);
+    const mpfr_exp_t exponent = mpfr_get_z_2exp(term_, a) + mpfr_get_z_2exp(b_mantissa, b);
+    mpz_mul(term_, term_, b_mantissa);
+    mpz_clear(b_mantissa);
+    ShiftTruncated(term_, exponent + kAccumulatorFractionBits - term_exponent);
+    AddTerm(term_exponent);
+}
+
+void LongAccumulatorReference::AddTerm(mpfr_exp_t term_exponent) {
+    // The operand with the smaller exponent is shifted arithmetically, which rounds toward negative infinity
+    if (mpz_sgn(value_) == 0 || term_exponent > exponent_) {
+        if (mpz_sgn(value_) != 0) {
+            mpz_fdiv_q_2exp(value_, value_, SaturateShift(term_exponent - exponent_));
+        }
+        exponent_ = term_exponent;
+    } else {
+        mpz_fdiv_q_2exp(term_, term_, SaturateShift(exponent_ - term_exponent));
+    }
+    mpz_add(value_, value_, term_);
+}
+
+void LongAccumulatorReference::Get(mpfr_ptr result) const {
+    if (mpz_sgn(value_) == 0) {
+        mpfr_set_zero(result, 1);
+        return;
+    }
+    mpfr_set_z_2exp(result, value_, exponent_ - kAccumulatorFractionBits, kRoundingMode);
+}
@@ -3,6 +3,7 @@
 #include <hlslib/xilinx/OpenCL.h>
 #include <hlslib/xilinx/Utility.h>
 
+#include <chrono>
 #include <cstdlib>  // putenv
 #include <iostream>
 #include <string>
@@ -10,6 +11,7 @@
 #include "Config.h"
 #include "MicrobenchmarkReference.h"
 #include "Random.h"
+#include "Reduction.h"
 
 struct MpfrWrapper {
     mpfr_t x;
@@ -23,10 +25,10 @@ struct MpfrWrapper {
 };
 
 #ifdef HLSLIB_SIMULATE_OPENCL
-bool RunTestSimulation(int size, bool verify) {
+bool RunTestSimulation(int size, int operation, bool verify) {
     const std::string kernel_path("");
 #else
-bool RunTest(std::string const &kernel_path, int size, bool verify) {
+bool RunTest(std::string const &kernel_path, int size, int operation, bool verify) {
 #endif
 
     hlslib::ocl::Context context;
@@ -71,6 +73,12 @@ bool RunTest(std::string const &kernel_path, int size, bool verify) {
     rng.GenerateMpfr(b_mpfr[0]);
     rng.GenerateMpfr(c_mpfr[0]);
 #endif
+    // Square roots are only defined for non-negative numbers
+    if (operation != kMicrobenchmarkMultiply) {
+        for (auto &x : a_mpfr) {
+            mpfr_abs(x, x, kRoundingMode);
+        }
+    }
 
     // Convert to PackedFloat format
     std::vector<PackedFloat> a_host, b_host, c_host;
@@ -124,14 +132,15 @@ bool RunTest(std::string const &kernel_path, int size, bool verify) {
     for (int i = 0; i < kComputeUnits; ++i) {
         kernels.emplace_back(program.MakeKernel(Microbenchmark,
                                                 "Microbenchmark:{Microbenchmark_" + std::to_string(i + 1) + "}",
-                                                a_device[i], b_device[i], c_device[i], partition_size[i]));
+                                                a_device[i], b_device[i], c_device[i], partition_size[i],
+                                                operation));
     }
 
     const float expected_runtime = expected_cycles / 0.3e9;
     std::cout << "The expected number of cycles to completion is " << expected_cycles << ", which is "
               << expected_runtime << " seconds at 300 MHz.\n";
 #ifdef APFP_USE_MEMORY
-    const auto communication_volume = 3 * size;
+    const auto communication_volume = ((operation == kMicrobenchmarkMultiply) ? 3 : 2) * size;
     const auto bandwidth = 1e-9 * kBytes * communication_volume / expected_runtime;
     std::cout << "This communicates " << 1e-6 * kBytes * communication_volume << " MB, requiring a bandwidth of "
               << bandwidth << " GB/s.\n";
@@ -146,7 +155,7 @@ bool RunTest(std::string const &kernel_path, int size, bool verify) {
     hlslib::ocl::WaitForEvents(events);
     auto end = std::chrono::high_resolution_clock::now();
     double elapsed = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-    std::cout << "Ran in " << elapsed << " seconds.\n";
+    std::cout << "Ran in " << elapsed << " seconds, computing " << 1e-6 * size / elapsed << " M results/s.\n";
 
     if (!verify) {
         return true;
@@ -173,7 +182,7 @@ bool RunTest(std::string const &kernel_path, int size, bool verify) {
     std::cout << "Running reference implementation..." << std::endl;
     start = std::chrono::high_resolution_clock::now();
     MicrobenchmarkReference(reinterpret_cast<mpfr_t const *>(&a_mpfr[0]), reinterpret_cast<mpfr_t const *>(&b_mpfr[0]),
-                            reinterpret_cast<mpfr_t *>(&c_mpfr[0]), size);
+                            reinterpret_cast<mpfr_t *>(&c_mpfr[0]), size, operation);
     end = std::chrono::high_resolution_clock::now();
     const double elapsed_reference = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
     std::cout << "Ran in " << elapsed_reference << " seconds.\n";
@@ -220,17 +229,160 @@ bool RunTest(std::string const &kernel_path, int size, bool verify) {
     return true;
 }
 
+#ifdef HLSLIB_SIMULATE_OPENCL
+bool RunReductionSimulation(int size, int mode, bool verify) {
+    const std::string kernel_path("");
+#else
+bool RunReduction(std::string const &kernel_path, int size, int mode, bool verify) {
+#endif
+
+    hlslib::ocl::Context context;
+    std::cout << "Configuring the device..." << std::flush;
+    auto program = context.MakeProgram(kernel_path);
+    std::cout << " Done.\n";
+
+    // Every compute unit reduces a contiguous range of the vectors to a single partial result
+    int i_begin[kComputeUnits];
+    int partition_size[kComputeUnits];
+    for (int i = 0; i < kComputeUnits; ++i) {
+        i_begin[i] = (i * size) / kComputeUnits;
+        partition_size[i] = ((i + 1) * size) / kComputeUnits - i_begin[i];
+    }
+
+    std::cout << "Initializing input data..." << std::flush;
+    std::vector<MpfrWrapper> x_mpfr(size), y_mpfr(size);
+    RandomNumberGenerator rng;
+    for (auto &v : x_mpfr) {
+        rng.GenerateMpfr(v);
+    }
+    for (auto &v : y_mpfr) {
+        rng.GenerateMpfr(v);
+    }
+    std::vector<PackedFloat> x_host, y_host;
+    for (auto &v : x_mpfr) {
+        x_host.emplace_back(v);
+    }
+    for (auto &v : y_mpfr) {
+        y_host.emplace_back(v);
+    }
+    std::cout << " Done.\n";
+
+    std::cout << "Copying data to the device..." << std::flush;
+    constexpr int kDramMapping[] = {1, 0, 2, 3};
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::read>> x_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::read>> y_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::write>> result_device;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        const auto bank = i % 4;
+        x_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                              kLinesPerNumber * std::max(partition_size[i], 1));
+        y_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                              kLinesPerNumber * std::max(partition_size[i], 1));
+        result_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank], kLinesPerNumber);
+        x_device[i].CopyFromHost(0, kLinesPerNumber * partition_size[i],
+                                 reinterpret_cast<DramLine const *>(&x_host[i_begin[i]]));
+        y_device[i].CopyFromHost(0, kLinesPerNumber * partition_size[i],
+                                 reinterpret_cast<DramLine const *>(&y_host[i_begin[i]]));
+    }
+    std::cout << " Done.\n";
+
+    std::vector<hlslib::ocl::Kernel> kernels;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        kernels.emplace_back(program.MakeKernel(Reduction, "Reduction:{Reduction_" + std::to_string(i + 1) + "}",
+                                                x_device[i], y_device[i], result_device[i], partition_size[i], mode));
+    }
+
+    // One number per cycle per compute unit, plus one adder latency per level of the final merge
+    const int operands = (mode == kReductionDot) ? 2 : 1;
+    std::cout << "Executing kernel...\n";
+    std::vector<hlslib::ocl::Event> events;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < kComputeUnits; ++i) {
+        if (partition_size[i] > 0) {
+            events.emplace_back(kernels[i].ExecuteTaskAsync());
+        }
+    }
+    hlslib::ocl::WaitForEvents(events);
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::cout << "Ran in " << elapsed << " seconds, reducing " << 1e-6 * size / elapsed << " M numbers/s and reading "
+              << 1e-9 * kBytes * operands * size / elapsed << " GB/s.\n";
+
+    bool success = true;
+    if (verify) {
+        std::cout << "Verifying the partial result of every compute unit...\n";
+        MpfrWrapper reference;
+        mpfr_init2(reference, kMantissaBits);
+        for (int i = 0; i < kComputeUnits && success; ++i) {
+            if (partition_size[i] == 0) {
+                continue;
+            }
+            PackedFloat result;
+            result_device[i].CopyToHost(0, kLinesPerNumber, reinterpret_cast<DramLine *>(&result));
+            ReductionReference(reinterpret_cast<mpfr_t const *>(&x_mpfr[i_begin[i]]),
+                               reinterpret_cast<mpfr_t const *>(&y_mpfr[i_begin[i]]), reference, partition_size[i],
+                               mode);
+            const PackedFloat ref(reference);
+            if (result != ref) {
+                std::cerr << "Verification failed for compute unit " << i << ":\n\t" << result << "\n\t" << ref
+                          << "\n";
+                success = false;
+            }
+        }
+        mpfr_clear(reference);
+        if (success) {
+            std::cout << "Results successfully verified against MPFR.\n";
+        }
+    }
+
+    for (auto &v : x_mpfr) {
+        mpfr_clear(v);
+    }
+    for (auto &v : y_mpfr) {
+        mpfr_clear(v);
+    }
+
+    return success;
+}
+
+/// Maps the operation given on the command line to an operation of the elementwise kernel, or -1 if it is a reduction
+int ParseElementwiseOperation(std::string const &operation) {
+    if (operation == "multiply") {
+        return kMicrobenchmarkMultiply;
+    } else if (operation == "sqrt") {
+        return kMicrobenchmarkSqrt;
+    } else if (operation == "invsqrt") {
+        return kMicrobenchmarkInvSqrt;
+    } else if (operation == "square") {
+        return kMicrobenchmarkSquare;
+    }
+    return -1;
+}
+
+/// Maps the operation given on the command line to a mode of the reduction kernel
+int ParseReductionOperation(std::string const &operation) {
+    if (operation == "sum") {
+        return kReductionSum;
+    } else if (operation == "dot") {
+        return kReductionDot;
+    } else if (operation == "norm") {
+        return kReductionSquaredNorm;
+    }
+    throw std::invalid_argument("Expected multiply/sqrt/invsqrt/square/sum/dot/norm.");
+}
+
 int main(int argc, char **argv) {
 #ifndef HLSLIB_SIMULATE_OPENCL
     // Parse input
-    if (argc < 3 || argc > 4) {
-        std::cerr << "Usage: " << argv[0] << " [hw_emu/hw] n <verify [on/off]>\n";
+    if (argc < 3 || argc > 5) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [hw_emu/hw] n <verify [on/off]> <operation [multiply/sqrt/invsqrt/square/sum/dot/norm]>\n";
         return 1;
     }
     const std::string mode_str(argv[1]);
     const int size = std::stoi(argv[2]);
     bool verify = true;
-    if (argc == 4) {
+    if (argc >= 4) {
         const std::string verify_str(argv[3]);
         if (verify_str == "on") {
             verify = true;
@@ -241,26 +393,33 @@ int main(int argc, char **argv) {
             return 1;
         }
     }
+    const std::string operation((argc == 5) ? argv[4] : "multiply");
+    // putenv keeps a pointer to the string, so it must live until the kernel has run
+    std::string kernel_path, conf_str;
     if (mode_str == "hw_emu") {
         const auto emu_str = "XCL_EMULATION_MODE=hw_emu";
         putenv(const_cast<char *>(emu_str));
-        const auto conf_str = std::string("EMCONFIG_PATH=") + kBuildDir;
+        conf_str = std::string("EMCONFIG_PATH=") + kBuildDir;
         putenv(const_cast<char *>(conf_str.c_str()));
-        return !RunTest(kBuildDir + std::string("/Microbenchmark_hw_emu.xclbin"), size, verify);
+        kernel_path = kBuildDir + std::string("/Microbenchmark_hw_emu.xclbin");
     } else if (mode_str == "hw") {
-        return !RunTest(kBuildDir + std::string("/Microbenchmark_hw.xclbin"), size, verify);
+        kernel_path = kBuildDir + std::string("/Microbenchmark_hw.xclbin");
     } else {
         throw std::invalid_argument("Invalid mode specified.");
     }
+    const int elementwise = ParseElementwiseOperation(operation);
+    return (elementwise >= 0) ? !RunTest(kernel_path, size, elementwise, verify)
+                              : !RunReduction(kernel_path, size, ParseReductionOperation(operation), verify);
 #else
     // Parse input
-    if (argc < 2 || argc > 3) {
-        std::cerr << "Usage: " << argv[0] << " n <verify [on/off]>\n";
+    if (argc < 2 || argc > 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " n <verify [on/off]> <operation [multiply/sqrt/invsqrt/square/sum/dot/norm]>\n";
         return 1;
     }
     const int size = std::stoi(argv[1]);
     bool verify = true;
-    if (argc == 3) {
+    if (argc >= 3) {
         const std::string verify_str(argv[2]);
         if (verify_str == "on") {
             verify = true;
@@ -271,6 +430,9 @@ int main(int argc, char **argv) {
             return 1;
         }
     }
-    return !RunTestSimulation(size, verify);
+    const std::string operation((argc == 4) ? argv[3] : "multiply");
+    const int elementwise = ParseElementwiseOperation(operation);
+    return (elementwise >= 0) ? !RunTestSimulation(size, elementwise, verify)
+                              : !RunReductionSimulation(size, ParseReductionOperation(operation), verify);
 #endif
 }
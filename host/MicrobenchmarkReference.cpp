@@ -1,20 +1,71 @@
 #include "MicrobenchmarkReference.h"
 
+#include <vector>
+
+#include "Microbenchmark.h"
+#include "Reduction.h"
+
+namespace {
+
+void ApplyOperation(mpfr_ptr c, mpfr_srcptr a, mpfr_srcptr b, const int operation) {
+    if (operation == kMicrobenchmarkMultiply) {
+        mpfr_mul(c, a, b, kRoundingMode);
+    } else if (operation == kMicrobenchmarkSqrt) {
+        mpfr_sqrt(c, a, kRoundingMode);
+    } else if (operation == kMicrobenchmarkSquare) {
+        mpfr_sqr(c, a, kRoundingMode);
+    } else {
+        mpfr_rec_sqrt(c, a, kRoundingMode);
+    }
+}
+
+}  // namespace
+
 #ifdef APFP_USE_MEMORY
 
-void MicrobenchmarkReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size) {
-    mpfr_t tmp;
-    mpfr_init2(tmp, kMantissaBits);
+void MicrobenchmarkReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size, int operation) {
     for (int i = 0; i < size; ++i) {
-        mpfr_mul(c[i], a[i], b[i], kRoundingMode);
+        ApplyOperation(c[i], a[i], b[i], operation);
     }
-    mpfr_clear(tmp);
 }
 
 #else
 
-void MicrobenchmarkReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int) {
-    mpfr_mul(c[0], a[0], b[0], kRoundingMode);
+void MicrobenchmarkReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int, int operation) {
+    ApplyOperation(c[0], a[0], b[0], operation);
 }
 
 #endif
+
+void ReductionReference(mpfr_t const *x, mpfr_t const *y, mpfr_ptr result, int size, int mode) {
+    // mpfr_t is an array type, so it cannot be stored in a vector directly
+    struct Lane {
+        mpfr_t value;
+    };
+    std::vector<Lane> lanes(kReductionLanes);
+    for (auto &lane : lanes) {
+        mpfr_init2(lane.value, kMantissaBits);
+        mpfr_set_ui(lane.value, 0, kRoundingMode);
+    }
+    mpfr_t tmp;
+    mpfr_init2(tmp, kMantissaBits);
+    for (int i = 0; i < size; ++i) {
+        mpfr_t &lane = lanes[i % kReductionLanes].value;
+        if (mode == kReductionSum) {
+            mpfr_add(lane, lane, x[i], kRoundingMode);
+        } else {
+            mpfr_mul(tmp, x[i], (mode == kReductionDot) ? y[i] : x[i], kRoundingMode);
+            mpfr_add(lane, lane, tmp, kRoundingMode);
+        }
+    }
+    for (int stride = kReductionLanes / 2; stride > 0; stride /= 2) {
+        for (int l = 0; l < stride; ++l) {
+            mpfr_add(lanes[l].value, lanes[l].value, lanes[l + stride].value, kRoundingMode);
+        }
+    }
+    mpfr_set(result, lanes[0].value, kRoundingMode);
+    mpfr_clear(tmp);
+    for (auto &lane : lanes) {
+        mpfr_clear(lane.value);
+    }
+}
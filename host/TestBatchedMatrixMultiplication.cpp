@@ -0,0 +1,201 @@
+#include <hlslib/xilinx/OpenCL.h>
+#include <hlslib/xilinx/Utility.h>
+
+#include <cstdlib>  // putenv
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "Config.h"
+#include "MatrixMultiplication.h"
+#include "MatrixMultiplicationReference.h"
+#include "Random.h"
+
+struct MpfrWrapper {
+    mpfr_t x;
+
+    operator mpfr_ptr() {
+        return x;
+    }
+    operator mpfr_srcptr() const {
+        return x;
+    }
+};
+
+#ifdef HLSLIB_SIMULATE_OPENCL
+bool RunTestSimulation(int num_problems, int max_size) {
+    const std::string kernel_path("");
+#else
+bool RunTest(std::string const &kernel_path, int num_problems, int max_size) {
+#endif
+
+    hlslib::ocl::Context context;
+    std::cout << "Configuring the device..." << std::flush;
+    auto program = context.MakeProgram(kernel_path);
+    std::cout << " Done.\n";
+
+    // Generate problems of random shapes, assigned round robin to compute units and stored back to back
+    std::cout << "Initializing input data..." << std::flush;
+    std::mt19937 shape_rng(0);
+    std::uniform_int_distribution<int> shape_distr(1, max_size);
+    RandomNumberGenerator rng;
+    std::vector<BatchDescriptor> descriptors[kComputeUnits];
+    std::vector<MpfrWrapper> a_mpfr, b_mpfr, c_mpfr;
+    std::vector<PackedFloat> a_host[kComputeUnits], b_host[kComputeUnits], c_host[kComputeUnits];
+    std::vector<int> a_begin, b_begin, c_begin;
+    for (int p = 0; p < num_problems; ++p) {
+        const int unit = p % kComputeUnits;
+        BatchDescriptor d;
+        d.size_n = shape_distr(shape_rng);
+        d.size_k = shape_distr(shape_rng);
+        d.size_m = shape_distr(shape_rng);
+        d.a_offset = a_host[unit].size();
+        d.b_offset = b_host[unit].size();
+        d.c_offset = c_host[unit].size();
+        descriptors[unit].push_back(d);
+        a_begin.push_back(a_mpfr.size());
+        b_begin.push_back(b_mpfr.size());
+        c_begin.push_back(c_mpfr.size());
+        for (int i = 0; i < d.size_n * d.size_k; ++i) {
+            a_mpfr.emplace_back();
+            rng.GenerateMpfr(a_mpfr.back());
+            a_host[unit].emplace_back(a_mpfr.back());
+        }
+        for (int i = 0; i < d.size_k * d.size_m; ++i) {
+            b_mpfr.emplace_back();
+            rng.GenerateMpfr(b_mpfr.back());
+            b_host[unit].emplace_back(b_mpfr.back());
+        }
+        for (int i = 0; i < d.size_n * d.size_m; ++i) {
+            c_mpfr.emplace_back();
+            rng.GenerateMpfr(c_mpfr.back());
+            c_host[unit].emplace_back(c_mpfr.back());
+        }
+    }
+    std::cout << " Done.\n";
+
+    // The kernel reads up to a tile past the end of each matrix of B and C, so pad the buffers by a tile
+    std::cout << "Copying data to the device..." << std::flush;
+    constexpr int kDramMapping[] = {1, 0, 2, 3};
+    std::vector<hlslib::ocl::Buffer<BatchDescriptor, hlslib::ocl::Access::read>> descriptors_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::read>> a_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::read>> b_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::readWrite>> c_device;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        const auto bank = i % 4;
+        descriptors_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                                        std::max<size_t>(descriptors[i].size(), 1));
+        a_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                              kLinesPerNumber * (a_host[i].size() + kTileSizeM));
+        b_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                              kLinesPerNumber * (b_host[i].size() + kTileSizeM));
+        c_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                              kLinesPerNumber * (c_host[i].size() + kTileSizeM));
+        if (descriptors[i].empty()) {
+            continue;
+        }
+        descriptors_device[i].CopyFromHost(0, descriptors[i].size(), descriptors[i].cbegin());
+        a_device[i].CopyFromHost(0, kLinesPerNumber * a_host[i].size(),
+                                 reinterpret_cast<DramLine const *>(&a_host[i][0]));
+        b_device[i].CopyFromHost(0, kLinesPerNumber * b_host[i].size(),
+                                 reinterpret_cast<DramLine const *>(&b_host[i][0]));
+        c_device[i].CopyFromHost(0, kLinesPerNumber * c_host[i].size(),
+                                 reinterpret_cast<DramLine const *>(&c_host[i][0]));
+    }
+    std::cout << " Done.\n";
+
+    std::vector<hlslib::ocl::Kernel> kernels;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        kernels.emplace_back(program.MakeKernel(
+            BatchedMatrixMultiplication,
+            "BatchedMatrixMultiplication:{BatchedMatrixMultiplication_" + std::to_string(i + 1) + "}",
+            descriptors_device[i], a_device[i], b_device[i], c_device[i], c_device[i],
+            static_cast<int>(descriptors[i].size())));
+    }
+
+    std::cout << "Executing kernel...\n";
+    std::vector<hlslib::ocl::Event> events;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < kComputeUnits; ++i) {
+        events.emplace_back(kernels[i].ExecuteTaskAsync());
+    }
+    hlslib::ocl::WaitForEvents(events);
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::cout << "Ran in " << elapsed << " seconds.\n";
+
+    std::cout << "Copying back result..." << std::flush;
+    std::vector<PackedFloat> result[kComputeUnits];
+    for (int i = 0; i < kComputeUnits; ++i) {
+        result[i].resize(c_host[i].size());
+        if (!result[i].empty()) {
+            c_device[i].CopyToHost(0, kLinesPerNumber * result[i].size(),
+                                   reinterpret_cast<DramLine *>(&result[i][0]));
+        }
+    }
+    std::cout << " Done.\n";
+
+    std::cout << "Running reference implementation and verifying results...\n";
+    for (int p = 0; p < num_problems; ++p) {
+        const int unit = p % kComputeUnits;
+        const auto &d = descriptors[unit][p / kComputeUnits];
+        MatrixMultiplicationReference(reinterpret_cast<mpfr_t const *>(&a_mpfr[a_begin[p]]),
+                                      reinterpret_cast<mpfr_t const *>(&b_mpfr[b_begin[p]]),
+                                      reinterpret_cast<mpfr_t *>(&c_mpfr[c_begin[p]]), d.size_n, d.size_k, d.size_m);
+        for (int i = 0; i < d.size_n * d.size_m; ++i) {
+            const PackedFloat res = result[unit][d.c_offset + i];
+            const PackedFloat ref(c_mpfr[c_begin[p] + i]);
+            if (ref != res) {
+                std::cerr << "Verification failed for problem " << p << " at (" << i / d.size_m << ", "
+                          << i % d.size_m << "):\n\t" << res << "\n\t" << ref << "\n";
+                return false;
+            }
+        }
+    }
+    std::cout << "Results successfully verified against MPFR.\n";
+
+    for (auto &x : a_mpfr) {
+        mpfr_clear(x);
+    }
+    for (auto &x : b_mpfr) {
+        mpfr_clear(x);
+    }
+    for (auto &x : c_mpfr) {
+        mpfr_clear(x);
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+#ifndef HLSLIB_SIMULATE_OPENCL
+    // Parse input
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " [hw_emu/hw] <number of problems> <maximum matrix size>\n";
+        return 1;
+    }
+    const std::string mode_str(argv[1]);
+    const int num_problems = std::stoi(argv[2]);
+    const int max_size = std::stoi(argv[3]);
+    if (mode_str == "hw_emu") {
+        const auto emu_str = "XCL_EMULATION_MODE=hw_emu";
+        putenv(const_cast<char *>(emu_str));
+        const auto conf_str = std::string("EMCONFIG_PATH=") + kBuildDir;
+        putenv(const_cast<char *>(conf_str.c_str()));
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw_emu.xclbin"), num_problems, max_size);
+    } else if (mode_str == "hw") {
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw.xclbin"), num_problems, max_size);
+    } else {
+        throw std::invalid_argument("Invalid mode specified.");
+    }
+#else
+    // Parse input
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <number of problems> <maximum matrix size>\n";
+        return 1;
+    }
+    const int num_problems = std::stoi(argv[1]);
+    const int max_size = std::stoi(argv[2]);
+    return !RunTestSimulation(num_problems, max_size);
+#endif
+}
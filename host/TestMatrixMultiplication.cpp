@@ -9,6 +9,7 @@
 #include "MatrixMultiplication.h"
 #include "MatrixMultiplicationReference.h"
 #include "Random.h"
+#include "TiledLayout.h"
 
 struct MpfrWrapper {
     mpfr_t x;
@@ -21,11 +22,37 @@ struct MpfrWrapper {
     }
 };
 
+// Repacks rows [row_begin, row_begin + rows) of a row-major matrix into the given layout, zeroing any padding
+std::vector<PackedFloat> ToLayout(std::vector<PackedFloat> const &matrix, int row_begin, int rows, int cols,
+                                  MatrixLayout layout) {
+    std::vector<PackedFloat> packed(LayoutSize(layout, rows, cols), PackedFloat::Zero());
+    std::size_t row, col;
+    for (std::size_t i = 0; i < packed.size(); ++i) {
+        if (LayoutCoordinates(layout, i, rows, cols, row, col)) {
+            packed[i] = matrix[(row_begin + row) * cols + col];
+        }
+    }
+    return packed;
+}
+
+// Inverse of ToLayout
+void FromLayout(std::vector<PackedFloat> const &packed, int row_begin, int rows, int cols, MatrixLayout layout,
+                std::vector<PackedFloat> &matrix) {
+    std::size_t row, col;
+    for (std::size_t i = 0; i < packed.size(); ++i) {
+        if (LayoutCoordinates(layout, i, rows, cols, row, col)) {
+            matrix[(row_begin + row) * cols + col] = packed[i];
+        }
+    }
+}
+
 #ifdef HLSLIB_SIMULATE_OPENCL
-bool RunTestSimulation(int size_n, int size_k, int size_m, bool verify) {
+bool RunTestSimulation(int size_n, int size_k, int size_m, bool verify, double alpha, double beta, bool tiled,
+                       bool lower) {
     const std::string kernel_path("");
 #else
-bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m, bool verify) {
+bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m, bool verify, double alpha,
+             double beta, bool tiled, bool lower) {
 #endif
 
     hlslib::ocl::Context context;
@@ -37,18 +64,24 @@ bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m,
     std::cout << "Initializing input data..." << std::flush;
     std::vector<MpfrWrapper> a_mpfr, b_mpfr, c_mpfr;
     RandomNumberGenerator rng;
-    for (int n = 0; n < size_n; ++n) {
-        for (int k = 0; k < size_k; ++k) {
-            a_mpfr.emplace_back();
-            rng.GenerateMpfr(a_mpfr.back());
-        }
-    }
     for (int k = 0; k < size_k; ++k) {
         for (int m = 0; m < size_m; ++m) {
             b_mpfr.emplace_back();
             rng.GenerateMpfr(b_mpfr.back());
         }
     }
+    // For the lower triangle, A is the transpose of B, so that C is symmetric
+    for (int n = 0; n < size_n; ++n) {
+        for (int k = 0; k < size_k; ++k) {
+            a_mpfr.emplace_back();
+            if (lower) {
+                mpfr_init2(a_mpfr.back(), kMantissaBits);
+                mpfr_set(a_mpfr.back(), b_mpfr[k * size_m + n], kRoundingMode);
+            } else {
+                rng.GenerateMpfr(a_mpfr.back());
+            }
+        }
+    }
     for (int n = 0; n < size_n; ++n) {
         for (int m = 0; m < size_m; ++m) {
             c_mpfr.emplace_back();
@@ -66,22 +99,33 @@ bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m,
     for (auto &x : c_mpfr) {
         c_host.emplace_back(x);
     }
+    mpfr_t alpha_mpfr, beta_mpfr;
+    mpfr_init2(alpha_mpfr, kMantissaBits);
+    mpfr_init2(beta_mpfr, kMantissaBits);
+    mpfr_set_d(alpha_mpfr, alpha, kRoundingMode);
+    mpfr_set_d(beta_mpfr, beta, kRoundingMode);
+    const int flags =
+        GemmFlags(alpha == 1, beta == 0, beta == 1) | (tiled ? kGemmTiledLayout : 0) | (lower ? kGemmLowerTriangle : 0);
+    const auto a_layout = tiled ? MatrixLayout::kTiledA : MatrixLayout::kRowMajor;
+    const auto b_layout = tiled ? MatrixLayout::kTiledB : MatrixLayout::kRowMajor;
+    const auto c_layout = tiled ? MatrixLayout::kTiledC : MatrixLayout::kRowMajor;
     std::cout << " Done.\n";
 
-    // Compute partitions
+    // Compute partitions. The tiled layouts are only defined for the largest tile shape.
     int n_begin[kComputeUnits];
     int n_end[kComputeUnits];
     int n_partition_size[kComputeUnits];
+    TileShape tiles[kComputeUnits];
     unsigned long expected_cycles = 0;
     for (int i = 0; i < kComputeUnits; ++i) {
         n_begin[i] = (i * size_n) / kComputeUnits;
         n_end[i] = ((i + 1) * size_n) / kComputeUnits;
         n_partition_size[i] = n_end[i] - n_begin[i];
-        expected_cycles =
-            std::max(expected_cycles,
-                     (unsigned long)(hlslib::CeilDivide(n_partition_size[i], kTileSizeN) *
-                                     hlslib::CeilDivide(size_m, kTileSizeM) * kTileSizeN * kTileSizeM * size_k));
+        tiles[i] = tiled ? TileShape{kTileSizeN, kTileSizeM} : ChooseTileShape(n_partition_size[i], size_k, size_m);
+        const long iterations = PaddedIterations(n_partition_size[i], size_k, size_m, tiles[i].n, tiles[i].m);
+        expected_cycles = std::max(expected_cycles, (unsigned long)iterations);
     }
+    std::cout << "Using tiles of " << tiles[0].n << "x" << tiles[0].m << " on the first compute unit.\n";
 
     // Allocate device memory, padding each buffer to the tile size
     std::cout << "Copying data to the device..." << std::flush;
@@ -100,11 +144,15 @@ bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m,
                               kLinesPerNumber * (hlslib::CeilDivide(n_partition_size[i], kTileSizeN) * kTileSizeN) *
                                   (hlslib::CeilDivide(size_m, kTileSizeM) * kTileSizeM));
         // Copy data to the accelerator cast to 512-bit DRAM lines
-        a_device[i].CopyFromHost(0, kLinesPerNumber * n_partition_size[i] * size_k,
-                                 reinterpret_cast<DramLine const *>(&a_host[n_begin[i] * size_k]));
-        b_device[i].CopyFromHost(0, kLinesPerNumber * size_k * size_m, reinterpret_cast<DramLine const *>(&b_host[0]));
-        c_device[i].CopyFromHost(0, kLinesPerNumber * n_partition_size[i] * size_m,
-                                 reinterpret_cast<DramLine const *>(&c_host[n_begin[i] * size_m]));
+        const auto a_packed = ToLayout(a_host, n_begin[i], n_partition_size[i], size_k, a_layout);
+        const auto b_packed = ToLayout(b_host, 0, size_k, size_m, b_layout);
+        const auto c_packed = ToLayout(c_host, n_begin[i], n_partition_size[i], size_m, c_layout);
+        a_device[i].CopyFromHost(0, kLinesPerNumber * a_packed.size(),
+                                 reinterpret_cast<DramLine const *>(a_packed.data()));
+        b_device[i].CopyFromHost(0, kLinesPerNumber * b_packed.size(),
+                                 reinterpret_cast<DramLine const *>(b_packed.data()));
+        c_device[i].CopyFromHost(0, kLinesPerNumber * c_packed.size(),
+                                 reinterpret_cast<DramLine const *>(c_packed.data()));
     }
     std::cout << " Done.\n";
 
@@ -114,14 +162,18 @@ bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m,
     for (int i = 0; i < kComputeUnits; ++i) {
         kernels.emplace_back(program.MakeKernel(
             MatrixMultiplication, "MatrixMultiplication:{MatrixMultiplication_" + std::to_string(i + 1) + "}",
-            a_device[i], b_device[i], c_device[i], c_device[i], n_partition_size[i], size_k, size_m));
+            a_device[i], b_device[i], c_device[i], c_device[i], n_partition_size[i], size_k, size_m, tiles[i].n,
+            tiles[i].m, n_begin[i], PackedFloat(alpha_mpfr), PackedFloat(beta_mpfr),
+            flags | StationaryOperandFlags(n_partition_size[i], size_k, size_m, tiles[i].n, tiles[i].m)));
     }
 
     const float expected_runtime = expected_cycles / 0.3e9;
     std::cout << "The expected number of cycles to completion is " << expected_cycles << ", which is "
               << expected_runtime << " seconds at 300 MHz.\n";
-    const auto communication_volume = hlslib::CeilDivide(size_n, kTileSizeN) * hlslib::CeilDivide(size_m, kTileSizeM) *
-                                      ((kTileSizeN + kTileSizeM) * size_k + 2 * kTileSizeN * kTileSizeM);
+    const auto communication_volume =
+        CommunicationVolume(size_n, size_k, size_m,
+                            StationaryOperandFlags(size_n, size_k, size_m, tiles[0].n, tiles[0].m), tiles[0].n,
+                            tiles[0].m);
     const auto bandwidth = 1e-9 * kBytes * communication_volume / expected_runtime;
     std::cout << "This communicates " << 1e-6 * kBytes * communication_volume << " MB, requiring a bandwidth of "
               << bandwidth << " GB/s.\n";
@@ -145,8 +197,9 @@ bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m,
     std::cout << "Copying back result..." << std::flush;
     std::vector<PackedFloat> result(size_n * size_m);
     for (int i = 0; i < kComputeUnits; ++i) {
-        c_device[i].CopyToHost(0, kLinesPerNumber * n_partition_size[i] * size_m,
-                               reinterpret_cast<DramLine *>(&result[n_begin[i] * size_m]));
+        std::vector<PackedFloat> c_packed(LayoutSize(c_layout, n_partition_size[i], size_m));
+        c_device[i].CopyToHost(0, kLinesPerNumber * c_packed.size(), reinterpret_cast<DramLine *>(c_packed.data()));
+        FromLayout(c_packed, n_begin[i], n_partition_size[i], size_m, c_layout, result);
     }
     std::cout << "Done.\n";
 
@@ -156,14 +209,14 @@ bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m,
     start = std::chrono::high_resolution_clock::now();
     MatrixMultiplicationReference(reinterpret_cast<mpfr_t const *>(&a_mpfr[0]),
                                   reinterpret_cast<mpfr_t const *>(&b_mpfr[0]), reinterpret_cast<mpfr_t *>(&c_mpfr[0]),
-                                  size_n, size_k, size_m);
+                                  size_n, size_k, size_m, alpha_mpfr, beta_mpfr);
     end = std::chrono::high_resolution_clock::now();
     const double elapsed_reference = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
     std::cout << "Ran in " << elapsed_reference << " seconds.\n";
 
-    // Verify results
+    // Verify results. Only the lower triangle is guaranteed to be computed for symmetric results.
     for (int n = 0; n < size_n; ++n) {
-        for (int m = 0; m < size_m; ++m) {
+        for (int m = 0; m < (lower ? n + 1 : size_m); ++m) {
             const PackedFloat res = result[n * size_m + m];
             const PackedFloat ref(c_mpfr[n * size_m + m]);
             if (ref != res) {
@@ -175,6 +228,8 @@ bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m,
     std::cout << "Results successfully verified against MPFR.\n";
 
     // Clean up
+    mpfr_clear(alpha_mpfr);
+    mpfr_clear(beta_mpfr);
     for (int n = 0; n < size_n; ++n) {
         for (int k = 0; k < size_k; ++k) {
             mpfr_clear(a_mpfr[n * size_k + k]);
@@ -197,8 +252,9 @@ bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m,
 int main(int argc, char **argv) {
 #ifndef HLSLIB_SIMULATE_OPENCL
     // Parse input
-    if (argc < 5 || argc > 6) {
-        std::cerr << "Usage: " << argv[0] << " [hw_emu/hw] n k m <verify [on/off]>\n";
+    if (argc < 5 || argc > 9 || argc == 7) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [hw_emu/hw] n k m <verify [on/off]> <alpha beta> <layout [rowmajor/tiled/lower]>\n";
         return 1;
     }
     const std::string mode_str(argv[1]);
@@ -206,7 +262,23 @@ int main(int argc, char **argv) {
     const int size_k = std::stoi(argv[3]);
     const int size_m = std::stoi(argv[4]);
     bool verify = true;
-    if (argc == 6) {
+    double alpha = 1, beta = 1;
+    bool tiled = false;
+    bool lower = false;
+    if (argc >= 8) {
+        alpha = std::stod(argv[6]);
+        beta = std::stod(argv[7]);
+    }
+    if (argc == 9) {
+        const std::string layout_str(argv[8]);
+        if (layout_str != "rowmajor" && layout_str != "tiled" && layout_str != "lower") {
+            std::cerr << "Expected rowmajor/tiled/lower.\n";
+            return 1;
+        }
+        tiled = layout_str == "tiled";
+        lower = layout_str == "lower";
+    }
+    if (argc >= 6) {
         const std::string verify_str(argv[5]);
         if (verify_str == "on") {
             verify = true;
@@ -217,28 +289,51 @@ int main(int argc, char **argv) {
             return 1;
         }
     }
+    if (lower && size_n != size_m) {
+        std::cerr << "The lower triangle is only defined for square results.\n";
+        return 1;
+    }
     if (mode_str == "hw_emu") {
         const auto emu_str = "XCL_EMULATION_MODE=hw_emu";
         putenv(const_cast<char *>(emu_str));
         const auto conf_str = std::string("EMCONFIG_PATH=") + kBuildDir;
         putenv(const_cast<char *>(conf_str.c_str()));
-        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw_emu.xclbin"), size_n, size_k, size_m, verify);
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw_emu.xclbin"), size_n, size_k, size_m, verify,
+                        alpha, beta, tiled, lower);
     } else if (mode_str == "hw") {
-        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw.xclbin"), size_n, size_k, size_m, verify);
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw.xclbin"), size_n, size_k, size_m, verify,
+                        alpha, beta, tiled, lower);
     } else {
         throw std::invalid_argument("Invalid mode specified.");
     }
 #else
     // Parse input
-    if (argc < 4 || argc > 5) {
-        std::cerr << "Usage: " << argv[0] << " n k m <verify [on/off]>\n";
+    if (argc < 4 || argc > 8 || argc == 6) {
+        std::cerr << "Usage: " << argv[0]
+                  << " n k m <verify [on/off]> <alpha beta> <layout [rowmajor/tiled/lower]>\n";
         return 1;
     }
     const int size_n = std::stoi(argv[1]);
     const int size_k = std::stoi(argv[2]);
     const int size_m = std::stoi(argv[3]);
     bool verify = true;
-    if (argc == 5) {
+    double alpha = 1, beta = 1;
+    bool tiled = false;
+    bool lower = false;
+    if (argc >= 7) {
+        alpha = std::stod(argv[5]);
+        beta = std::stod(argv[6]);
+    }
+    if (argc == 8) {
+        const std::string layout_str(argv[7]);
+        if (layout_str != "rowmajor" && layout_str != "tiled" && layout_str != "lower") {
+            std::cerr << "Expected rowmajor/tiled/lower.\n";
+            return 1;
+        }
+        tiled = layout_str == "tiled";
+        lower = layout_str == "lower";
+    }
+    if (argc >= 5) {
         const std::string verify_str(argv[4]);
         if (verify_str == "on") {
             verify = true;
@@ -249,6 +344,10 @@ int main(int argc, char **argv) {
             return 1;
         }
     }
-    return !RunTestSimulation(size_n, size_k, size_m, verify);
+    if (lower && size_n != size_m) {
+        std::cerr << "The lower triangle is only defined for square results.\n";
+        return 1;
+    }
+    return !RunTestSimulation(size_n, size_k, size_m, verify, alpha, beta, tiled, lower);
 #endif
 }
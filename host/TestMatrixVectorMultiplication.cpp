@@ -0,0 +1,194 @@
+#include <hlslib/xilinx/OpenCL.h>
+#include <hlslib/xilinx/Utility.h>
+
+#include <chrono>
+#include <cstdlib>  // putenv
+#include <iostream>
+#include <string>
+
+#include "Config.h"
+#include "MatrixMultiplication.h"
+#include "MatrixMultiplicationReference.h"
+#include "MatrixVectorMultiplication.h"
+#include "Random.h"
+
+struct MpfrWrapper {
+    mpfr_t x;
+
+    operator mpfr_ptr() {
+        return x;
+    }
+    operator mpfr_srcptr() const {
+        return x;
+    }
+};
+
+#ifdef HLSLIB_SIMULATE_OPENCL
+bool RunTestSimulation(int size_n, int size_m, bool accumulate) {
+    const std::string kernel_path("");
+#else
+bool RunTest(std::string const &kernel_path, int size_n, int size_m, bool accumulate) {
+#endif
+
+    hlslib::ocl::Context context;
+    std::cout << "Configuring the device..." << std::flush;
+    auto program = context.MakeProgram(kernel_path);
+    std::cout << " Done.\n";
+
+    std::cout << "Initializing input data..." << std::flush;
+    std::vector<MpfrWrapper> a_mpfr(size_n * size_m), x_mpfr(size_m), y_mpfr(size_n);
+    RandomNumberGenerator rng;
+    for (auto &v : a_mpfr) {
+        rng.GenerateMpfr(v);
+    }
+    for (auto &v : x_mpfr) {
+        rng.GenerateMpfr(v);
+    }
+    for (auto &v : y_mpfr) {
+        rng.GenerateMpfr(v);
+    }
+    std::vector<PackedFloat> a_host, x_host, y_host;
+    for (auto &v : a_mpfr) {
+        a_host.emplace_back(v);
+    }
+    for (auto &v : x_mpfr) {
+        x_host.emplace_back(v);
+    }
+    for (auto &v : y_mpfr) {
+        y_host.emplace_back(v);
+    }
+    const int flags = accumulate ? kGemmReadC : 0;
+    std::cout << " Done.\n";
+
+    // Split the rows across compute units, like the host library does, with x replicated in every bank
+    std::cout << "Copying data to the device..." << std::flush;
+    constexpr int kDramMapping[] = {1, 0, 2, 3};
+    int n_begin[kComputeUnits];
+    int n_partition_size[kComputeUnits];
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::read>> a_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::read>> x_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::readWrite>> y_device;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        const auto bank = i % 4;
+        n_begin[i] = (i * size_n) / kComputeUnits;
+        n_partition_size[i] = ((i + 1) * size_n) / kComputeUnits - n_begin[i];
+        a_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                              kLinesPerNumber * std::max(n_partition_size[i], 1) * size_m);
+        x_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank], kLinesPerNumber * size_m);
+        y_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                              kLinesPerNumber * std::max(n_partition_size[i], 1));
+        a_device[i].CopyFromHost(0, kLinesPerNumber * n_partition_size[i] * size_m,
+                                 reinterpret_cast<DramLine const *>(&a_host[n_begin[i] * size_m]));
+        x_device[i].CopyFromHost(0, kLinesPerNumber * size_m, reinterpret_cast<DramLine const *>(x_host.data()));
+        y_device[i].CopyFromHost(0, kLinesPerNumber * n_partition_size[i],
+                                 reinterpret_cast<DramLine const *>(&y_host[n_begin[i]]));
+    }
+    std::cout << " Done.\n";
+
+    std::vector<hlslib::ocl::Kernel> kernels;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        kernels.emplace_back(program.MakeKernel(
+            MatrixVectorMultiplication,
+            "MatrixVectorMultiplication:{MatrixVectorMultiplication_" + std::to_string(i + 1) + "}", a_device[i],
+            x_device[i], y_device[i], y_device[i], n_partition_size[i], size_m, flags));
+    }
+
+    // A is the only operand that is not negligible in size, and is read exactly once
+    const double volume = 1e-9 * kBytes * size_n * size_m;
+    std::cout << "Executing kernel...\n";
+    std::vector<hlslib::ocl::Event> events;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < kComputeUnits; ++i) {
+        if (n_partition_size[i] > 0) {
+            events.emplace_back(kernels[i].ExecuteTaskAsync());
+        }
+    }
+    hlslib::ocl::WaitForEvents(events);
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::cout << "Ran in " << elapsed << " seconds, streaming A at " << volume / elapsed << " GB/s.\n";
+
+    std::cout << "Copying back result..." << std::flush;
+    std::vector<PackedFloat> result(size_n);
+    for (int i = 0; i < kComputeUnits; ++i) {
+        y_device[i].CopyToHost(0, kLinesPerNumber * n_partition_size[i],
+                               reinterpret_cast<DramLine *>(&result[n_begin[i]]));
+    }
+    std::cout << " Done.\n";
+
+    // A vector is a matrix with a single column, and the device accumulates every row in the same order as the
+    // matrix multiplication kernel
+    std::cout << "Running reference implementation...\n";
+    mpfr_t alpha_mpfr, beta_mpfr;
+    mpfr_init2(alpha_mpfr, kMantissaBits);
+    mpfr_init2(beta_mpfr, kMantissaBits);
+    mpfr_set_ui(alpha_mpfr, 1, kRoundingMode);
+    mpfr_set_ui(beta_mpfr, accumulate ? 1 : 0, kRoundingMode);
+    MatrixMultiplicationReference(reinterpret_cast<mpfr_t const *>(&a_mpfr[0]),
+                                  reinterpret_cast<mpfr_t const *>(&x_mpfr[0]), reinterpret_cast<mpfr_t *>(&y_mpfr[0]),
+                                  size_n, size_m, 1, alpha_mpfr, beta_mpfr);
+
+    bool success = true;
+    for (int n = 0; n < size_n; ++n) {
+        const PackedFloat res = result[n];
+        const PackedFloat ref(y_mpfr[n]);
+        if (ref != res) {
+            std::cerr << "Verification failed at " << n << ":\n\t" << res << "\n\t" << ref << "\n";
+            success = false;
+            break;
+        }
+    }
+    if (success) {
+        std::cout << "Results successfully verified against MPFR.\n";
+    }
+
+    mpfr_clear(alpha_mpfr);
+    mpfr_clear(beta_mpfr);
+    for (auto &v : a_mpfr) {
+        mpfr_clear(v);
+    }
+    for (auto &v : x_mpfr) {
+        mpfr_clear(v);
+    }
+    for (auto &v : y_mpfr) {
+        mpfr_clear(v);
+    }
+
+    return success;
+}
+
+int main(int argc, char **argv) {
+#ifndef HLSLIB_SIMULATE_OPENCL
+    // Parse input
+    if (argc != 4 && argc != 5) {
+        std::cerr << "Usage: " << argv[0] << " [hw_emu/hw] n m <accumulate [on/off]>\n";
+        return 1;
+    }
+    const std::string mode_str(argv[1]);
+    const int size_n = std::stoi(argv[2]);
+    const int size_m = std::stoi(argv[3]);
+    const bool accumulate = argc < 5 || std::string(argv[4]) == "on";
+    // The kernel is linked into the matrix multiplication program, so the host library can use all of them
+    if (mode_str == "hw_emu") {
+        const auto emu_str = "XCL_EMULATION_MODE=hw_emu";
+        putenv(const_cast<char *>(emu_str));
+        const auto conf_str = std::string("EMCONFIG_PATH=") + kBuildDir;
+        putenv(const_cast<char *>(conf_str.c_str()));
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw_emu.xclbin"), size_n, size_m, accumulate);
+    } else if (mode_str == "hw") {
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw.xclbin"), size_n, size_m, accumulate);
+    } else {
+        throw std::invalid_argument("Invalid mode specified.");
+    }
+#else
+    // Parse input
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " n m <accumulate [on/off]>\n";
+        return 1;
+    }
+    const int size_n = std::stoi(argv[1]);
+    const int size_m = std::stoi(argv[2]);
+    const bool accumulate = argc < 4 || std::string(argv[3]) == "on";
+    return !RunTestSimulation(size_n, size_m, accumulate);
+#endif
+}
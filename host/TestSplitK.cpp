@@ -0,0 +1,239 @@
+#include <hlslib/xilinx/OpenCL.h>
+#include <hlslib/xilinx/Utility.h>
+
+#include <cstdlib>  // putenv
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "Config.h"
+#include "MatrixMultiplication.h"
+#include "MatrixMultiplicationReference.h"
+#include "Random.h"
+#include "ReducePartials.h"
+
+struct MpfrWrapper {
+    mpfr_t x;
+
+    operator mpfr_ptr() {
+        return x;
+    }
+    operator mpfr_srcptr() const {
+        return x;
+    }
+};
+
+#ifdef HLSLIB_SIMULATE_OPENCL
+bool RunTestSimulation(int size_n, int size_k, int size_m, int num_partials, double alpha, double beta) {
+    const std::string kernel_path("");
+#else
+bool RunTest(std::string const &kernel_path, int size_n, int size_k, int size_m, int num_partials, double alpha,
+             double beta) {
+#endif
+
+    hlslib::ocl::Context context;
+    std::cout << "Configuring the device..." << std::flush;
+    auto program = context.MakeProgram(kernel_path);
+    std::cout << " Done.\n";
+
+    std::cout << "Initializing input data..." << std::flush;
+    std::vector<MpfrWrapper> a_mpfr(size_n * size_k), b_mpfr(size_k * size_m), c_mpfr(size_n * size_m);
+    RandomNumberGenerator rng;
+    for (auto &x : a_mpfr) {
+        rng.GenerateMpfr(x);
+    }
+    for (auto &x : b_mpfr) {
+        rng.GenerateMpfr(x);
+    }
+    for (auto &x : c_mpfr) {
+        rng.GenerateMpfr(x);
+    }
+    std::vector<PackedFloat> a_host, b_host, c_host;
+    for (auto &x : a_mpfr) {
+        a_host.emplace_back(x);
+    }
+    for (auto &x : b_mpfr) {
+        b_host.emplace_back(x);
+    }
+    for (auto &x : c_mpfr) {
+        c_host.emplace_back(x);
+    }
+    mpfr_t alpha_mpfr, beta_mpfr;
+    mpfr_init2(alpha_mpfr, kMantissaBits);
+    mpfr_init2(beta_mpfr, kMantissaBits);
+    mpfr_set_d(alpha_mpfr, alpha, kRoundingMode);
+    mpfr_set_d(beta_mpfr, beta, kRoundingMode);
+    const int flags = GemmFlags(alpha == 1, beta == 0, beta == 1);
+    std::cout << " Done.\n";
+
+    // Partition K like the host library does, with partial p running on compute unit p
+    std::vector<int> k_begin;
+    for (int p = 0; p <= num_partials; ++p) {
+        k_begin.push_back((p * size_k) / num_partials);
+    }
+
+    std::cout << "Copying data to the device..." << std::flush;
+    constexpr int kDramMapping[] = {1, 0, 2, 3};
+    const int padded_n = hlslib::CeilDivide(size_n, kTileSizeN) * kTileSizeN;
+    const int padded_m = hlslib::CeilDivide(size_m, kTileSizeM) * kTileSizeM;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::read>> a_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::read>> b_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::readWrite>> partial_device;
+    for (int p = 0; p < num_partials; ++p) {
+        const auto bank = (p % kComputeUnits) % 4;
+        const int depth = k_begin[p + 1] - k_begin[p];
+        std::vector<PackedFloat> a_slice;
+        for (int n = 0; n < size_n; ++n) {
+            a_slice.insert(a_slice.end(), a_host.begin() + n * size_k + k_begin[p],
+                           a_host.begin() + n * size_k + k_begin[p + 1]);
+        }
+        a_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                              kLinesPerNumber * padded_n * depth);
+        b_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                              kLinesPerNumber * depth * padded_m);
+        partial_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                                    kLinesPerNumber * padded_n * padded_m);
+        a_device[p].CopyFromHost(0, kLinesPerNumber * size_n * depth,
+                                 reinterpret_cast<DramLine const *>(a_slice.data()));
+        b_device[p].CopyFromHost(0, kLinesPerNumber * depth * size_m,
+                                 reinterpret_cast<DramLine const *>(&b_host[k_begin[p] * size_m]));
+    }
+    // Only the first partial reads C
+    partial_device[0].CopyFromHost(0, kLinesPerNumber * size_n * size_m,
+                                   reinterpret_cast<DramLine const *>(c_host.data()));
+    hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::readWrite> gathered_device(
+        context, hlslib::ocl::StorageType::DDR, kDramMapping[0], kLinesPerNumber * num_partials * size_n * size_m);
+    hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::readWrite> result_device(
+        context, hlslib::ocl::StorageType::DDR, kDramMapping[0], kLinesPerNumber * size_n * size_m);
+    std::cout << " Done.\n";
+
+    std::vector<hlslib::ocl::Kernel> kernels;
+    for (int p = 0; p < num_partials; ++p) {
+        const int depth = k_begin[p + 1] - k_begin[p];
+        const TileShape tile = ChooseTileShape(size_n, depth, size_m);
+        const int partial_flags = ((p == 0) ? flags : (flags & kGemmScaleProduct)) |
+                                  StationaryOperandFlags(size_n, depth, size_m, tile.n, tile.m);
+        kernels.emplace_back(program.MakeKernel(
+            MatrixMultiplication,
+            "MatrixMultiplication:{MatrixMultiplication_" + std::to_string(p % kComputeUnits + 1) + "}", a_device[p],
+            b_device[p], partial_device[p], partial_device[p], size_n, depth, size_m, tile.n, tile.m, 0,
+            PackedFloat(alpha_mpfr), PackedFloat(beta_mpfr), partial_flags));
+    }
+    auto reduce_kernel = program.MakeKernel(ReducePartials, "ReducePartials:{ReducePartials_1}", gathered_device,
+                                            result_device, num_partials, size_n * size_m);
+
+    std::cout << "Executing kernels...\n";
+    std::vector<hlslib::ocl::Event> events;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto &kernel : kernels) {
+        events.emplace_back(kernel.ExecuteTaskAsync());
+    }
+    hlslib::ocl::WaitForEvents(events);
+    for (int p = 0; p < num_partials; ++p) {
+        partial_device[p].CopyToDevice(0, kLinesPerNumber * size_n * size_m, gathered_device,
+                                       kLinesPerNumber * p * size_n * size_m);
+    }
+    reduce_kernel.ExecuteTask();
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::cout << "Ran in " << elapsed << " seconds.\n";
+
+    std::cout << "Copying back result..." << std::flush;
+    std::vector<PackedFloat> result(size_n * size_m);
+    result_device.CopyToHost(0, kLinesPerNumber * size_n * size_m, reinterpret_cast<DramLine *>(result.data()));
+    std::cout << " Done.\n";
+
+    std::cout << "Running reference implementation...\n";
+    MatrixMultiplicationSplitKReference(reinterpret_cast<mpfr_t const *>(&a_mpfr[0]),
+                                        reinterpret_cast<mpfr_t const *>(&b_mpfr[0]),
+                                        reinterpret_cast<mpfr_t *>(&c_mpfr[0]), size_n, size_k, size_m, alpha_mpfr,
+                                        beta_mpfr, k_begin);
+
+    bool success = true;
+    for (int n = 0; n < size_n && success; ++n) {
+        for (int m = 0; m < size_m; ++m) {
+            const PackedFloat res = result[n * size_m + m];
+            const PackedFloat ref(c_mpfr[n * size_m + m]);
+            if (ref != res) {
+                std::cerr << "Verification failed at (" << n << ", " << m << "):\n\t" << res << "\n\t" << ref << "\n";
+                success = false;
+                break;
+            }
+        }
+    }
+    if (success) {
+        std::cout << "Results successfully verified against MPFR.\n";
+    }
+
+    mpfr_clear(alpha_mpfr);
+    mpfr_clear(beta_mpfr);
+    for (auto &x : a_mpfr) {
+        mpfr_clear(x);
+    }
+    for (auto &x : b_mpfr) {
+        mpfr_clear(x);
+    }
+    for (auto &x : c_mpfr) {
+        mpfr_clear(x);
+    }
+
+    return success;
+}
+
+int main(int argc, char **argv) {
+#ifndef HLSLIB_SIMULATE_OPENCL
+    // Parse input
+    if (argc != 6 && argc != 8) {
+        std::cerr << "Usage: " << argv[0] << " [hw_emu/hw] n k m partials <alpha beta>\n";
+        return 1;
+    }
+    const std::string mode_str(argv[1]);
+    const int size_n = std::stoi(argv[2]);
+    const int size_k = std::stoi(argv[3]);
+    const int size_m = std::stoi(argv[4]);
+    const int num_partials = std::stoi(argv[5]);
+    double alpha = 1, beta = 1;
+    if (argc == 8) {
+        alpha = std::stod(argv[6]);
+        beta = std::stod(argv[7]);
+    }
+    if (num_partials < 1 || num_partials > size_k) {
+        std::cerr << "Number of partials must be between 1 and K.\n";
+        return 1;
+    }
+    // The reduction kernel is linked into the matrix multiplication program, so the host library can use both
+    if (mode_str == "hw_emu") {
+        const auto emu_str = "XCL_EMULATION_MODE=hw_emu";
+        putenv(const_cast<char *>(emu_str));
+        const auto conf_str = std::string("EMCONFIG_PATH=") + kBuildDir;
+        putenv(const_cast<char *>(conf_str.c_str()));
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw_emu.xclbin"), size_n, size_k, size_m,
+                        num_partials, alpha, beta);
+    } else if (mode_str == "hw") {
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw.xclbin"), size_n, size_k, size_m,
+                        num_partials, alpha, beta);
+    } else {
+        throw std::invalid_argument("Invalid mode specified.");
+    }
+#else
+    // Parse input
+    if (argc != 5 && argc != 7) {
+        std::cerr << "Usage: " << argv[0] << " n k m partials <alpha beta>\n";
+        return 1;
+    }
+    const int size_n = std::stoi(argv[1]);
+    const int size_k = std::stoi(argv[2]);
+    const int size_m = std::stoi(argv[3]);
+    const int num_partials = std::stoi(argv[4]);
+    double alpha = 1, beta = 1;
+    if (argc == 7) {
+        alpha = std::stod(argv[5]);
+        beta = std::stod(argv[6]);
+    }
+    if (num_partials < 1 || num_partials > size_k) {
+        std::cerr << "Number of partials must be between 1 and K.\n";
+        return 1;
+    }
+    return !RunTestSimulation(size_n, size_k, size_m, num_partials, alpha, beta);
+#endif
+}
@@ -0,0 +1,125 @@
+#include <hlslib/xilinx/OpenCL.h>
+#include <hlslib/xilinx/Utility.h>
+
+#include <cstdlib>  // putenv
+#include <iostream>
+#include <string>
+
+#include "Config.h"
+#include "Random.h"
+#include "Transpose.h"
+
+#ifdef HLSLIB_SIMULATE_OPENCL
+bool RunTestSimulation(int size_rows, int size_cols) {
+    const std::string kernel_path("");
+#else
+bool RunTest(std::string const &kernel_path, int size_rows, int size_cols) {
+#endif
+
+    hlslib::ocl::Context context;
+    std::cout << "Configuring the device..." << std::flush;
+    auto program = context.MakeProgram(kernel_path);
+    std::cout << " Done.\n";
+
+    std::cout << "Initializing input data..." << std::flush;
+    std::vector<PackedFloat> input;
+    RandomNumberGenerator rng;
+    for (int i = 0; i < size_rows * size_cols; ++i) {
+        input.emplace_back(rng.Generate());
+    }
+    std::cout << " Done.\n";
+
+    // Split the columns across compute units, like the host library does
+    std::cout << "Copying data to the device..." << std::flush;
+    constexpr int kDramMapping[] = {1, 0, 2, 3};
+    int col_begin[kComputeUnits];
+    int col_count[kComputeUnits];
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::read>> input_device;
+    std::vector<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::write>> output_device;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        const auto bank = i % 4;
+        col_begin[i] = (i * size_cols) / kComputeUnits;
+        col_count[i] = ((i + 1) * size_cols) / kComputeUnits - col_begin[i];
+        input_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                                  kLinesPerNumber * size_rows * size_cols);
+        output_device.emplace_back(context, hlslib::ocl::StorageType::DDR, kDramMapping[bank],
+                                   kLinesPerNumber * size_rows * std::max(col_count[i], 1));
+        input_device[i].CopyFromHost(0, kLinesPerNumber * size_rows * size_cols,
+                                     reinterpret_cast<DramLine const *>(&input[0]));
+    }
+    std::cout << " Done.\n";
+
+    std::vector<hlslib::ocl::Kernel> kernels;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        kernels.emplace_back(program.MakeKernel(Transpose, "Transpose:{Transpose_" + std::to_string(i + 1) + "}",
+                                                input_device[i], output_device[i], size_rows, size_cols, col_begin[i],
+                                                col_count[i]));
+    }
+
+    std::cout << "Executing kernel...\n";
+    std::vector<hlslib::ocl::Event> events;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < kComputeUnits; ++i) {
+        events.emplace_back(kernels[i].ExecuteTaskAsync());
+    }
+    hlslib::ocl::WaitForEvents(events);
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::cout << "Ran in " << elapsed << " seconds.\n";
+
+    std::cout << "Copying back result..." << std::flush;
+    std::vector<PackedFloat> result(size_rows * size_cols);
+    for (int i = 0; i < kComputeUnits; ++i) {
+        output_device[i].CopyToHost(0, kLinesPerNumber * size_rows * col_count[i],
+                                    reinterpret_cast<DramLine *>(&result[col_begin[i] * size_rows]));
+    }
+    std::cout << " Done.\n";
+
+    for (int r = 0; r < size_rows; ++r) {
+        for (int c = 0; c < size_cols; ++c) {
+            const PackedFloat res = result[c * size_rows + r];
+            const PackedFloat ref = input[r * size_cols + c];
+            if (ref != res) {
+                std::cerr << "Verification failed at (" << r << ", " << c << "):\n\t" << res << "\n\t" << ref << "\n";
+                return false;
+            }
+        }
+    }
+    std::cout << "Results successfully verified.\n";
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+#ifndef HLSLIB_SIMULATE_OPENCL
+    // Parse input
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " [hw_emu/hw] rows cols\n";
+        return 1;
+    }
+    const std::string mode_str(argv[1]);
+    const int size_rows = std::stoi(argv[2]);
+    const int size_cols = std::stoi(argv[3]);
+    // The transpose kernel is linked into the matrix multiplication program, so the host library can use both
+    if (mode_str == "hw_emu") {
+        const auto emu_str = "XCL_EMULATION_MODE=hw_emu";
+        putenv(const_cast<char *>(emu_str));
+        const auto conf_str = std::string("EMCONFIG_PATH=") + kBuildDir;
+        putenv(const_cast<char *>(conf_str.c_str()));
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw_emu.xclbin"), size_rows, size_cols);
+    } else if (mode_str == "hw") {
+        return !RunTest(kBuildDir + std::string("/MatrixMultiplication_hw.xclbin"), size_rows, size_cols);
+    } else {
+        throw std::invalid_argument("Invalid mode specified.");
+    }
+#else
+    // Parse input
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " rows cols\n";
+        return 1;
+    }
+    const int size_rows = std::stoi(argv[1]);
+    const int size_cols = std::stoi(argv[2]);
+    return !RunTestSimulation(size_rows, size_cols);
+#endif
+}
@@ -3,9 +3,12 @@
 #include <catch.hpp>
 #include <iostream>
 #include <limits>
+#include <memory>
 
 #include "ArithmeticOperations.h"
+#include "BasicBufferPool.h"
 #include "Karatsuba.h"
+#include "MatrixMultiplicationReference.h"
 #include "PackedFloat.h"
 #include "Random.h"
 
@@ -125,6 +128,13 @@ TEST_CASE("Karatsuba") {
         REQUIRE(MultOverflow(a, b) == Karatsuba(a, b));
     }
 
+    {
+        // The multiplier is wider than the mantissa, and every bit of it must be used correctly
+        const ap_uint<kBits> a = -1;
+        const ap_uint<kBits> b = -1;
+        REQUIRE(MultOverflow(a, b) == Karatsuba(a, b));
+    }
+
     {
         auto rng = RandomNumberGenerator();
         for (int i = 0; i < kNumRandom; ++i) {
@@ -137,6 +147,181 @@ TEST_CASE("Karatsuba") {
     }
 }
 
+TEST_CASE("KaratsubaSquare") {
+    {
+        ap_uint<kBits> a;
+        a = 0;
+        REQUIRE(MultOverflow(a, a) == KaratsubaSquare(a));
+        a = 1;
+        REQUIRE(MultOverflow(a, a) == KaratsubaSquare(a));
+        a = -1;
+        REQUIRE(MultOverflow(a, a) == KaratsubaSquare(a));
+        // Both halves are equal at every level, so every difference is zero
+        a = 0;
+        a = ~a / 3;
+        REQUIRE(MultOverflow(a, a) == KaratsubaSquare(a));
+    }
+    auto rng = RandomNumberGenerator();
+    for (int i = 0; i < kNumRandom; ++i) {
+        ap_uint<kBits> a = rng.Generate().GetMantissa();
+        a = (a << (kBits - kMantissaBits)) | ap_uint<kBits>(rng.Generate().GetMantissa());
+        REQUIRE(MultOverflow(a, a) == KaratsubaSquare(a));
+    }
+}
+
+TEST_CASE("KaratsubaHigh") {
+    const auto check = [](ap_uint<kBits> const &a, ap_uint<kBits> const &b) {
+        const ap_uint<kBits> exact = Karatsuba(a, b).range(2 * kBits - 1, kBits);
+        const ap_uint<kBits> high = KaratsubaHigh(a, b);
+        CAPTURE(a);
+        CAPTURE(b);
+        REQUIRE(high <= exact);
+        REQUIRE(exact - high <= KaratsubaHighError(kBits));
+    };
+    // Every partial product that is dropped is as large as it gets
+    check(-1, -1);
+    check(-1, 1);
+    check(0, -1);
+    auto rng = RandomNumberGenerator();
+    for (int i = 0; i < kNumRandom; ++i) {
+        // Fill the bits below the mantissa too, as the multiplier does not know where the mantissa ends
+        ap_uint<kBits> a = rng.Generate().GetMantissa();
+        ap_uint<kBits> b = rng.Generate().GetMantissa();
+        a = (a << (kBits - kMantissaBits)) | ap_uint<kBits>(rng.Generate().GetMantissa());
+        b = (b << (kBits - kMantissaBits)) | ap_uint<kBits>(rng.Generate().GetMantissa());
+        check(a, b);
+    }
+}
+
+// Stand-ins for device buffers and the events of the commands using them
+struct MockBuffer {
+    int bank;
+    std::size_t lines;
+    int id;
+};
+
+struct MockEvent {
+    std::shared_ptr<bool> completed;
+
+    void wait() {
+        *completed = true;
+    }
+};
+
+using MockBufferPool = BasicBufferPool<MockBuffer, MockEvent>;
+
+TEST_CASE("BufferPool Size Classes") {
+    REQUIRE(MockBufferPool::SizeClass(1) == 1);
+    REQUIRE(MockBufferPool::SizeClass(7) == 7);
+    REQUIRE(MockBufferPool::SizeClass(8) == 8);
+    REQUIRE(MockBufferPool::SizeClass(9) == 10);
+    REQUIRE(MockBufferPool::SizeClass(100) == 112);
+    REQUIRE(MockBufferPool::SizeClass(128) == 128);
+    REQUIRE(MockBufferPool::SizeClass(129) == 160);
+    for (std::size_t lines = 1; lines < 4096; ++lines) {
+        const auto size = MockBufferPool::SizeClass(lines);
+        CAPTURE(lines);
+        REQUIRE(size >= lines);
+        REQUIRE(4 * size <= 5 * lines + 4);
+        REQUIRE(MockBufferPool::SizeClass(size) == size);
+    }
+}
+
+TEST_CASE("BufferPool Statistics") {
+    int allocations = 0;
+    auto pool = std::make_shared<MockBufferPool>(
+        [&allocations](int bank, std::size_t lines) { return MockBuffer{bank, lines, allocations++}; });
+    {
+        auto a = pool->Allocate(0, 100);
+        REQUIRE(a->lines == 112);
+        REQUIRE(a.size() == 112);
+        const auto stats = pool->statistics();
+        REQUIRE(stats.misses == 1);
+        REQUIRE(stats.hits == 0);
+        REQUIRE(stats.bytes_in_use == 112 * sizeof(DramLine));
+        REQUIRE(stats.bytes_cached == 0);
+    }
+    REQUIRE(pool->statistics().bytes_in_use == 0);
+    REQUIRE(pool->statistics().bytes_cached == 112 * sizeof(DramLine));
+    {
+        // Same bank and size class is served from the cache, while another bank or class is not
+        auto a = pool->Allocate(0, 105);
+        REQUIRE(a->id == 0);
+        auto b = pool->Allocate(1, 100);
+        REQUIRE(b->id == 1);
+        auto c = pool->Allocate(0, 200);
+        REQUIRE(c->id == 2);
+        const auto stats = pool->statistics();
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.misses == 3);
+        REQUIRE(stats.bytes_in_use == (112 + 112 + 224) * sizeof(DramLine));
+        REQUIRE(stats.peak_bytes_in_use == stats.bytes_in_use);
+        REQUIRE(stats.bytes_cached == 0);
+    }
+    pool->Clear();
+    auto a = pool->Allocate(0, 100);
+    REQUIRE(a->id == 3);
+    REQUIRE(pool->statistics().bytes_cached == 0);
+    REQUIRE(pool->statistics().peak_bytes_in_use == (112 + 112 + 224) * sizeof(DramLine));
+}
+
+TEST_CASE("BufferPool Deferred Release") {
+    int allocations = 0;
+    auto pool = std::make_shared<MockBufferPool>(
+        [&allocations](int bank, std::size_t lines) { return MockBuffer{bank, lines, allocations++}; });
+    const MockEvent first{std::make_shared<bool>(false)};
+    const MockEvent second{std::make_shared<bool>(false)};
+    {
+        auto a = pool->Allocate(0, 64);
+        REQUIRE(a.dependencies().empty());
+        a.RecordUse({first});
+        // Moving the handle keeps the commands recorded on it, and leaves nothing behind to release
+        MockBufferPool::Handle constructed(std::move(a));
+        REQUIRE(!a);
+        REQUIRE(constructed);
+        MockBufferPool::Handle assigned;
+        assigned = std::move(constructed);
+        REQUIRE(!constructed);
+        assigned.RecordUse({second});
+    }
+    REQUIRE(pool->statistics().bytes_cached == 64 * sizeof(DramLine));
+    {
+        // Another bank does not touch the cached buffer
+        auto other = pool->Allocate(1, 64);
+        REQUIRE(other->id == 1);
+        REQUIRE(other.dependencies().empty());
+    }
+    // The recycled buffer comes with the commands of its previous owner as dependencies, rather than waiting for them
+    auto recycled = pool->Allocate(0, 64);
+    REQUIRE(recycled->id == 0);
+    REQUIRE(recycled.dependencies().size() == 2);
+    REQUIRE(recycled.dependencies()[0].completed == first.completed);
+    REQUIRE(recycled.dependencies()[1].completed == second.completed);
+    REQUIRE(!*first.completed);
+    REQUIRE(!*second.completed);
+
+    // Too many commands become dependencies of the later ones, rather than growing without bound or being waited for
+    std::vector<MockEvent> uses;
+    for (std::size_t i = 0; i <= MockBufferPool::kMaxPendingEvents; ++i) {
+        uses.push_back({std::make_shared<bool>(false)});
+        recycled.RecordUse({uses.back()});
+    }
+    REQUIRE(recycled.dependencies().size() == uses.size());
+    REQUIRE(recycled.dependencies().back().completed == uses.back().completed);
+    for (auto const& use : uses) {
+        REQUIRE(!*use.completed);
+    }
+
+    // Releasing hands on both the dependencies and the commands recorded since
+    const MockEvent last{std::make_shared<bool>(false)};
+    recycled.RecordUse({last});
+    recycled = MockBufferPool::Handle();
+    auto again = pool->Allocate(0, 64);
+    REQUIRE(again->id == 0);
+    REQUIRE(again.dependencies().size() == uses.size() + 1);
+    REQUIRE(again.dependencies().front().completed == last.completed);
+}
+
 #ifdef APFP_GMP_SEMANTICS
 
 TEST_CASE("Add GMP") {
@@ -227,6 +412,70 @@ TEST_CASE("Add MPFR") {
     mpfr_clear(mpfr_num_c);
 }
 
+TEST_CASE("Add MPFR Alignment and Cancellation") {
+    auto rng = RandomNumberGenerator();
+    mpfr_t mpfr_num_a, mpfr_num_b, mpfr_num_c;
+    mpfr_init2(mpfr_num_a, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_b, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_c, 8 * sizeof(Mantissa));
+    const auto check = [&]() {
+        mpfr_add(mpfr_num_c, mpfr_num_a, mpfr_num_b, kRoundingMode);
+        const PackedFloat a(mpfr_num_a);
+        const PackedFloat b(mpfr_num_b);
+        CAPTURE(a, b);
+        REQUIRE(PackedFloat(mpfr_num_c) == Add(a, b));
+        REQUIRE(PackedFloat(mpfr_num_c) == Add(b, a));
+    };
+    // Exponent differences around the width of the mantissa and far beyond it, where b only affects the result by
+    // borrowing from the last bit when subtracting
+    const long differences[] = {2, kMantissaBits - 1, kMantissaBits, kMantissaBits + 1, kMantissaBits + 2,
+                                2 * kMantissaBits, 1 << 10, 1 << 12, 100000};
+    for (int i = 0; i < kNumRandom / 16; ++i) {
+        for (const long difference : differences) {
+            rng.Generate(mpfr_num_a);
+            rng.Generate(mpfr_num_b);
+            if (mpfr_zero_p(mpfr_num_a) || mpfr_zero_p(mpfr_num_b)) {
+                continue;
+            }
+            if (i % 2 == 0) {
+                // Powers of two lose their leading bit when anything is subtracted from them
+                mpfr_set_si_2exp(mpfr_num_a, (i % 4 == 0) ? 1 : -1, mpfr_get_exp(mpfr_num_a), kRoundingMode);
+            }
+            mpfr_set_exp(mpfr_num_b, mpfr_get_exp(mpfr_num_a) - difference);
+            check();
+            mpfr_neg(mpfr_num_b, mpfr_num_b, kRoundingMode);
+            check();
+        }
+    }
+    // Operands that agree in any number of leading bits, up to the entire mantissa
+    for (int i = 0; i < kNumRandom; ++i) {
+        rng.Generate(mpfr_num_a);
+        rng.Generate(mpfr_num_c);
+        if (mpfr_zero_p(mpfr_num_a) || mpfr_zero_p(mpfr_num_c)) {
+            continue;
+        }
+        if (i % 3 == 0) {
+            // Just below a power of two, so the exponents differ by one
+            mpfr_set_si_2exp(mpfr_num_a, 1, mpfr_get_exp(mpfr_num_a), kRoundingMode);
+            mpfr_set(mpfr_num_b, mpfr_num_a, kRoundingMode);
+            for (int j = i % 7; j >= 0; --j) {
+                mpfr_nextbelow(mpfr_num_b);
+            }
+        } else {
+            mpfr_set_exp(mpfr_num_c, mpfr_get_exp(mpfr_num_a) - i % (kMantissaBits + 2));
+            mpfr_sub(mpfr_num_b, mpfr_num_a, mpfr_num_c, kRoundingMode);
+        }
+        mpfr_neg(mpfr_num_b, mpfr_num_b, kRoundingMode);
+        check();
+        // Exact cancellation
+        mpfr_neg(mpfr_num_b, mpfr_num_a, kRoundingMode);
+        check();
+    }
+    mpfr_clear(mpfr_num_a);
+    mpfr_clear(mpfr_num_b);
+    mpfr_clear(mpfr_num_c);
+}
+
 TEST_CASE("Multiply MPFR") {
     auto rng = RandomNumberGenerator();
     mpfr_t mpfr_num_a, mpfr_num_b, mpfr_num_c;
@@ -260,6 +509,25 @@ TEST_CASE("Multiply MPFR") {
     mpfr_clear(mpfr_num_c);
 }
 
+TEST_CASE("Square MPFR") {
+    auto rng = RandomNumberGenerator();
+    mpfr_t mpfr_num_a, mpfr_num_c;
+    mpfr_init2(mpfr_num_a, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_c, 8 * sizeof(Mantissa));
+    for (int i = 0; i < kNumRandom; ++i) {
+        rng.Generate(mpfr_num_a);
+        mpfr_sqr(mpfr_num_c, mpfr_num_a, kRoundingMode);
+        const PackedFloat a(mpfr_num_a);
+        CAPTURE(a);
+        REQUIRE(PackedFloat(mpfr_num_c) == Square(a));
+    }
+    mpfr_set_si(mpfr_num_a, -3, kRoundingMode);
+    mpfr_sqr(mpfr_num_c, mpfr_num_a, kRoundingMode);
+    REQUIRE(PackedFloat(mpfr_num_c) == Square(PackedFloat(mpfr_num_a)));
+    mpfr_clear(mpfr_num_a);
+    mpfr_clear(mpfr_num_c);
+}
+
 TEST_CASE("MultiplyAccumulate MPFR") {
     auto rng = RandomNumberGenerator();
     mpfr_t mpfr_num_a, mpfr_num_b, mpfr_num_c, mpfr_num_tmp;
@@ -283,4 +551,167 @@ TEST_CASE("MultiplyAccumulate MPFR") {
     mpfr_clear(mpfr_num_tmp);
 }
 
+
+TEST_CASE("Divide MPFR") {
+    auto rng = RandomNumberGenerator();
+    mpfr_t mpfr_num_a, mpfr_num_b, mpfr_num_c;
+    mpfr_init2(mpfr_num_a, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_b, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_c, 8 * sizeof(Mantissa));
+    for (int i = 0; i < kNumRandom; ++i) {
+        rng.Generate(mpfr_num_a);
+        rng.Generate(mpfr_num_b);
+        // MPFR returns an infinity or NaN, which cannot be represented
+        if (mpfr_zero_p(mpfr_num_b)) {
+            continue;
+        }
+        mpfr_div(mpfr_num_c, mpfr_num_a, mpfr_num_b, kRoundingMode);
+        CAPTURE(PackedFloat(mpfr_num_a), PackedFloat(mpfr_num_b));
+        REQUIRE(PackedFloat(mpfr_num_c) == Divide(PackedFloat(mpfr_num_a), PackedFloat(mpfr_num_b)));
+    }
+    // Quotients that are exact or just below a representable number are the hardest to truncate correctly
+    mpfr_set_ui(mpfr_num_c, 1, kRoundingMode);
+    const PackedFloat one(mpfr_num_c);
+    for (int i = 0; i < kNumRandom; ++i) {
+        rng.Generate(mpfr_num_a);
+        rng.Generate(mpfr_num_b);
+        if (mpfr_zero_p(mpfr_num_b)) {
+            continue;
+        }
+        CAPTURE(PackedFloat(mpfr_num_b));
+        REQUIRE(one == Divide(PackedFloat(mpfr_num_b), PackedFloat(mpfr_num_b)));
+        mpfr_mul(mpfr_num_a, mpfr_num_a, mpfr_num_b, kRoundingMode);
+        mpfr_div(mpfr_num_c, mpfr_num_a, mpfr_num_b, kRoundingMode);
+        CAPTURE(PackedFloat(mpfr_num_a));
+        REQUIRE(PackedFloat(mpfr_num_c) == Divide(PackedFloat(mpfr_num_a), PackedFloat(mpfr_num_b)));
+    }
+    mpfr_clear(mpfr_num_a);
+    mpfr_clear(mpfr_num_b);
+    mpfr_clear(mpfr_num_c);
+}
+
+TEST_CASE("Reciprocal MPFR") {
+    auto rng = RandomNumberGenerator();
+    mpfr_t mpfr_num_a, mpfr_num_c;
+    mpfr_init2(mpfr_num_a, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_c, 8 * sizeof(Mantissa));
+    for (int i = 0; i < kNumRandom; ++i) {
+        rng.Generate(mpfr_num_a);
+        if (mpfr_zero_p(mpfr_num_a)) {
+            continue;
+        }
+        mpfr_ui_div(mpfr_num_c, 1, mpfr_num_a, kRoundingMode);
+        CAPTURE(PackedFloat(mpfr_num_a));
+        REQUIRE(PackedFloat(mpfr_num_c) == Reciprocal(PackedFloat(mpfr_num_a)));
+    }
+    mpfr_clear(mpfr_num_a);
+    mpfr_clear(mpfr_num_c);
+}
+
+TEST_CASE("Sqrt MPFR") {
+    auto rng = RandomNumberGenerator();
+    mpfr_t mpfr_num_a, mpfr_num_c;
+    mpfr_init2(mpfr_num_a, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_c, 8 * sizeof(Mantissa));
+    for (int i = 0; i < kNumRandom; ++i) {
+        rng.Generate(mpfr_num_a);
+        // There are no NaNs, so negative numbers flush to zero
+        if (mpfr_signbit(mpfr_num_a)) {
+            REQUIRE(Sqrt(PackedFloat(mpfr_num_a)).IsZero());
+            mpfr_neg(mpfr_num_a, mpfr_num_a, kRoundingMode);
+        }
+        mpfr_sqrt(mpfr_num_c, mpfr_num_a, kRoundingMode);
+        CAPTURE(PackedFloat(mpfr_num_a));
+        REQUIRE(PackedFloat(mpfr_num_c) == Sqrt(PackedFloat(mpfr_num_a)));
+        // Squares have exact or nearly exact roots
+        mpfr_mul(mpfr_num_a, mpfr_num_a, mpfr_num_a, kRoundingMode);
+        mpfr_sqrt(mpfr_num_c, mpfr_num_a, kRoundingMode);
+        CAPTURE(PackedFloat(mpfr_num_a));
+        REQUIRE(PackedFloat(mpfr_num_c) == Sqrt(PackedFloat(mpfr_num_a)));
+    }
+    mpfr_clear(mpfr_num_a);
+    mpfr_clear(mpfr_num_c);
+}
+
+TEST_CASE("InvSqrt MPFR") {
+    auto rng = RandomNumberGenerator();
+    mpfr_t mpfr_num_a, mpfr_num_c;
+    mpfr_init2(mpfr_num_a, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_c, 8 * sizeof(Mantissa));
+    // Powers of four have a power of two as their exact inverse square root, the largest mantissa there is
+    for (int e = -8; e <= 8; ++e) {
+        mpfr_set_ui(mpfr_num_a, 1, kRoundingMode);
+        mpfr_mul_2si(mpfr_num_a, mpfr_num_a, e, kRoundingMode);
+        mpfr_rec_sqrt(mpfr_num_c, mpfr_num_a, kRoundingMode);
+        CAPTURE(PackedFloat(mpfr_num_a));
+        REQUIRE(PackedFloat(mpfr_num_c) == InvSqrt(PackedFloat(mpfr_num_a)));
+    }
+    for (int i = 0; i < kNumRandom; ++i) {
+        rng.Generate(mpfr_num_a);
+        // MPFR returns an infinity or NaN, which cannot be represented
+        if (mpfr_zero_p(mpfr_num_a)) {
+            continue;
+        }
+        if (mpfr_signbit(mpfr_num_a)) {
+            REQUIRE(InvSqrt(PackedFloat(mpfr_num_a)).IsZero());
+            mpfr_neg(mpfr_num_a, mpfr_num_a, kRoundingMode);
+        }
+        mpfr_rec_sqrt(mpfr_num_c, mpfr_num_a, kRoundingMode);
+        CAPTURE(PackedFloat(mpfr_num_a));
+        REQUIRE(PackedFloat(mpfr_num_c) == InvSqrt(PackedFloat(mpfr_num_a)));
+    }
+    mpfr_clear(mpfr_num_a);
+    mpfr_clear(mpfr_num_c);
+}
+
+TEST_CASE("LongAccumulator MPFR") {
+    constexpr int kDotLength = 16;
+    auto rng = RandomNumberGenerator();
+    mpfr_t mpfr_num_a, mpfr_num_b, mpfr_num_c;
+    mpfr_init2(mpfr_num_a, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_b, 8 * sizeof(Mantissa));
+    mpfr_init2(mpfr_num_c, 8 * sizeof(Mantissa));
+    LongAccumulatorReference reference;
+    // Shifting a negative sum out entirely leaves -1, as arithmetic shifts round toward negative infinity
+    mpfr_set_si(mpfr_num_c, -1, kRoundingMode);
+    mpfr_mul_2si(mpfr_num_c, mpfr_num_c, -4 * kAccumulatorBits, kRoundingMode);
+    mpfr_set_ui(mpfr_num_a, 3, kRoundingMode);
+    const PackedFloat three(mpfr_num_a);
+    const LongAccumulator tiny = ToAccumulator(PackedFloat(mpfr_num_c));
+    reference.Set(mpfr_num_c);
+    reference.AddProduct(mpfr_num_a, mpfr_num_a);
+    reference.Get(mpfr_num_c);
+    REQUIRE(mpfr_cmp_ui(mpfr_num_c, 9) < 0);
+    REQUIRE(PackedFloat(mpfr_num_c) == Normalize(AccumulateProduct(three, three, tiny)));
+    for (int i = 0; i < kNumRandom / kDotLength; ++i) {
+        rng.Generate(mpfr_num_c);
+        LongAccumulator sum = ToAccumulator(PackedFloat(mpfr_num_c));
+        reference.Set(mpfr_num_c);
+        REQUIRE(PackedFloat(mpfr_num_c) == Normalize(sum));
+        for (int j = 0; j < kDotLength; ++j) {
+            rng.Generate(mpfr_num_a);
+            rng.Generate(mpfr_num_b);
+            const PackedFloat a(mpfr_num_a);
+            const PackedFloat b(mpfr_num_b);
+            // A single product is truncated once, just like by Multiply
+            mpfr_mul(mpfr_num_c, mpfr_num_a, mpfr_num_b, kRoundingMode);
+            CAPTURE(a);
+            CAPTURE(b);
+            REQUIRE(PackedFloat(mpfr_num_c) == Normalize(AccumulateProduct(a, b, LongAccumulator::Zero())));
+            sum = AccumulateProduct(a, b, sum);
+            reference.AddProduct(mpfr_num_a, mpfr_num_b);
+            reference.Get(mpfr_num_c);
+            REQUIRE(PackedFloat(mpfr_num_c) == Normalize(sum));
+        }
+        // A product cancels exactly against its negation
+        const PackedFloat a(mpfr_num_a);
+        const LongAccumulator product = AccumulateProduct(a, PackedFloat(mpfr_num_b), LongAccumulator::Zero());
+        mpfr_neg(mpfr_num_b, mpfr_num_b, kRoundingMode);
+        REQUIRE(Normalize(AccumulateProduct(a, PackedFloat(mpfr_num_b), product)).IsZero());
+    }
+    mpfr_clear(mpfr_num_a);
+    mpfr_clear(mpfr_num_b);
+    mpfr_clear(mpfr_num_c);
+}
+
 #endif
@@ -5,3 +5,59 @@
 PackedFloat MultiplyAccumulate(PackedFloat const &a, PackedFloat const &b, PackedFloat const &c);
 PackedFloat Multiply(PackedFloat const &a, PackedFloat const &b);
 PackedFloat Add(PackedFloat const &a, PackedFloat const &b);
+/// Square a * a rounded toward zero like Multiply(a, a), using a multiplier that exploits the symmetry of the product.
+PackedFloat Square(PackedFloat const &a);
+
+/// Quotient a / b rounded toward zero. As there are no infinities, dividing by zero returns zero.
+PackedFloat Divide(PackedFloat const &a, PackedFloat const &b);
+/// Reciprocal 1 / a rounded toward zero, or zero if a is zero.
+PackedFloat Reciprocal(PackedFloat const &a);
+/// Square root rounded toward zero. As there are no NaNs, negative numbers return zero.
+PackedFloat Sqrt(PackedFloat const &a);
+/// Inverse square root 1 / sqrt(a) rounded toward zero, or zero if a is zero or negative.
+PackedFloat InvSqrt(PackedFloat const &a);
+
+/// Number of bits kept below the mantissa of every product accumulated by AccumulateProduct.
+constexpr int kAccumulatorGuardBits = 64;
+constexpr int kAccumulatorFractionBits = kMantissaBits + kAccumulatorGuardBits;
+/// One sign bit and enough headroom to sum 2^31 products and a starting value without overflowing.
+constexpr int kAccumulatorBits = kAccumulatorFractionBits + 33;
+static_assert(kAccumulatorGuardBits <= kMantissaBits, "Guard bits must be taken from the full product.");
+
+/// Two's complement fixed-point sum worth value * 2^(exponent - kAccumulatorFractionBits). Every term is aligned to the
+/// largest exponent seen so far, so sums are only truncated when terms are shifted below the guard bits, and are only
+/// normalized once by Normalize.
+struct LongAccumulator {
+    ap_int<kAccumulatorBits> value;
+    Exponent exponent;
+
+    static LongAccumulator Zero() {
+#pragma HLS INLINE
+        LongAccumulator x;
+        x.value = 0;
+        x.exponent = 0;
+        return x;
+    }
+};
+
+/// Exact fixed-point representation of a.
+LongAccumulator ToAccumulator(PackedFloat const &a);
+/// Adds a*b to c, keeping the kAccumulatorFractionBits most significant bits of the product without normalizing it.
+/// Terms below the largest exponent are shifted arithmetically, i.e., truncated toward negative infinity.
+LongAccumulator AccumulateProduct(PackedFloat const &a, PackedFloat const &b, LongAccumulator const &c);
+/// Sum held by the accumulator rounded toward zero.
+PackedFloat Normalize(LongAccumulator const &a);
+
+#ifdef APFP_LONG_ACCUMULATOR
+/// The matrix kernels accumulate their dot products in a LongAccumulator, only normalizing them once they are done.
+using PartialSum = LongAccumulator;
+#else
+using PartialSum = PackedFloat;
+#endif
+
+/// Partial sum starting from a, which is exact.
+PartialSum ToPartialSum(PackedFloat const &a);
+/// Adds a*b to the partial sum c, which is MultiplyAccumulate unless APFP_LONG_ACCUMULATOR is set.
+PartialSum MultiplyAccumulatePartial(PackedFloat const &a, PackedFloat const &b, PartialSum const &c);
+/// Partial sum rounded toward zero.
+PackedFloat RoundPartialSum(PartialSum const &a);
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>  // std::max
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "DeviceTypes.h"
+
+/// Recycles device buffers per DDR bank, avoiding slow device allocations and fragmentation when matrices of recurring
+/// shapes are allocated over and over. Requests are rounded up to a size class, and buffers released by their handles
+/// are cached for the next request in the same bank and class.
+///
+/// Commands enqueued on a buffer can still be pending when its handle is released, so handles record the events of
+/// every command using them. The pool never blocks on these: a cached buffer is handed out together with the events of
+/// its previous owner as dependencies, and every command enqueued on a handle's buffer must wait for the dependencies
+/// of that handle. The pool is generic in the buffer and event types, so that its bookkeeping can be tested without a
+/// device.
+template <typename BufferType, typename EventType>
+class BasicBufferPool : public std::enable_shared_from_this<BasicBufferPool<BufferType, EventType>> {
+   public:
+    using Buffer = BufferType;
+    using Event = EventType;
+    using Allocator = std::function<Buffer(int bank, std::size_t lines)>;
+
+    struct Statistics {
+        std::size_t hits;               // Requests served from the cache
+        std::size_t misses;             // Requests that required a device allocation
+        std::size_t bytes_in_use;       // Bytes held by live handles
+        std::size_t peak_bytes_in_use;  // Maximum of bytes_in_use over the lifetime of the pool
+        std::size_t bytes_cached;       // Bytes held by the pool, waiting to be reused
+    };
+
+    /// Number of events a handle records before turning them into dependencies of its later commands, bounding the
+    /// bookkeeping of long-lived buffers
+    static constexpr std::size_t kMaxPendingEvents = 64;
+
+    /// Owning handle to a pooled buffer, returning it to the pool on destruction
+    class Handle {
+       public:
+        Handle() = default;
+        Handle(Handle const &) = delete;
+        Handle &operator=(Handle const &) = delete;
+
+        Handle(Handle &&other)
+            : pool_(std::move(other.pool_)),
+              bank_(other.bank_),
+              size_(other.size_),
+              buffer_(std::move(other.buffer_)),
+              pending_(std::move(other.pending_)),
+              dependencies_(std::move(other.dependencies_)) {
+            // Moving from an optional leaves it engaged, which would release the buffer a second time
+            other.buffer_.reset();
+            other.pending_.clear();
+            other.dependencies_.clear();
+        }
+
+        Handle &operator=(Handle &&other) {
+            if (this != &other) {
+                Release();
+                pool_ = std::move(other.pool_);
+                bank_ = other.bank_;
+                size_ = other.size_;
+                buffer_ = std::move(other.buffer_);
+                other.buffer_.reset();
+                pending_ = std::move(other.pending_);
+                other.pending_.clear();
+                dependencies_ = std::move(other.dependencies_);
+                other.dependencies_.clear();
+            }
+            return *this;
+        }
+
+        ~Handle() {
+            Release();
+        }
+
+        Buffer &operator*() const {
+            return *buffer_;
+        }
+
+        Buffer *operator->() const {
+            return &*buffer_;
+        }
+
+        explicit operator bool() const {
+            return buffer_.has_value();
+        }
+
+        /// Number of DRAM lines actually allocated, which can exceed the number requested
+        std::size_t size() const {
+            return size_;
+        }
+
+        /// Events that every command enqueued on the buffer must depend on: the commands of the previous owner of a
+        /// recycled buffer, and the recorded commands once there are too many of them to keep track of
+        std::vector<Event> const &dependencies() const {
+            return dependencies_;
+        }
+
+        /// Record commands reading or writing the buffer, which must complete before it can be recycled. These
+        /// commands must have been enqueued with the dependencies of the handle. Once too many have accumulated, they
+        /// replace the dependencies, which every later command then waits for, so that completing the later commands
+        /// implies completing all earlier ones.
+        void RecordUse(std::vector<Event> const &events) const {
+            pending_.insert(pending_.end(), events.begin(), events.end());
+            if (pending_.size() > kMaxPendingEvents) {
+                dependencies_ = std::move(pending_);
+                pending_.clear();
+            }
+        }
+
+       private:
+        friend BasicBufferPool;
+
+        Handle(std::shared_ptr<BasicBufferPool> pool, int bank, std::size_t size, Buffer &&buffer,
+               std::vector<Event> &&dependencies)
+            : pool_(std::move(pool)),
+              bank_(bank),
+              size_(size),
+              buffer_(std::move(buffer)),
+              dependencies_(std::move(dependencies)) {}
+
+        void Release() {
+            if (pool_ && buffer_) {
+                // The dependencies are only implied by the recorded commands if there are any
+                pending_.insert(pending_.end(), dependencies_.begin(), dependencies_.end());
+                pool_->Release(bank_, size_, std::move(*buffer_), std::move(pending_));
+            }
+            buffer_.reset();
+            pending_.clear();
+            dependencies_.clear();
+            pool_.reset();
+        }
+
+        std::shared_ptr<BasicBufferPool> pool_;
+        int bank_ = 0;
+        std::size_t size_ = 0;
+        // Mutable because hlslib does not expose const transfers, while handles are shared by const matrices
+        mutable std::optional<Buffer> buffer_;
+        mutable std::vector<Event> pending_;
+        mutable std::vector<Event> dependencies_;
+    };
+
+    explicit BasicBufferPool(Allocator allocator) : allocator_(std::move(allocator)) {}
+
+    BasicBufferPool(BasicBufferPool const &) = delete;
+    BasicBufferPool(BasicBufferPool &&) = delete;
+    BasicBufferPool &operator=(BasicBufferPool const &) = delete;
+    BasicBufferPool &operator=(BasicBufferPool &&) = delete;
+
+    /// Get a buffer of at least the requested number of DRAM lines in the given DDR bank. Never blocks on the device: a
+    /// cached buffer can still be in use by the commands recorded on it, which become the dependencies of the handle.
+    Handle Allocate(int bank, std::size_t lines) {
+        const std::size_t size = SizeClass(std::max<std::size_t>(lines, 1));
+        std::unique_lock<std::mutex> lock(mutex_);
+        statistics_.bytes_in_use += size * sizeof(DramLine);
+        statistics_.peak_bytes_in_use = std::max(statistics_.peak_bytes_in_use, statistics_.bytes_in_use);
+        auto cached = free_.find({bank, size});
+        if (cached != free_.end() && !cached->second.empty()) {
+            ++statistics_.hits;
+            statistics_.bytes_cached -= size * sizeof(DramLine);
+            Entry entry = std::move(cached->second.back());
+            cached->second.pop_back();
+            lock.unlock();
+            return Handle(this->shared_from_this(), bank, size, std::move(entry.buffer), std::move(entry.pending));
+        }
+        ++statistics_.misses;
+        // Don't hold the lock while the runtime allocates
+        lock.unlock();
+        return Handle(this->shared_from_this(), bank, size, allocator_(bank, size), {});
+    }
+
+    /// Free all cached buffers on the device. Buffers held by live handles are unaffected, and the runtime keeps
+    /// buffers alive until the commands still using them have completed.
+    void Clear() {
+        decltype(free_) to_free;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            std::swap(to_free, free_);
+            statistics_.bytes_cached = 0;
+        }
+    }
+
+    Statistics statistics() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return statistics_;
+    }
+
+    /// Size class that a request for the given number of lines is rounded up to. There are four geometric steps per
+    /// power of two, bounding the internal fragmentation at 25%.
+    static std::size_t SizeClass(std::size_t lines) {
+        std::size_t power = 1;
+        while (2 * power <= lines) {
+            power *= 2;
+        }
+        const std::size_t step = std::max<std::size_t>(power / 4, 1);
+        return ((lines + step - 1) / step) * step;
+    }
+
+   private:
+    struct Entry {
+        Buffer buffer;
+        std::vector<Event> pending;
+    };
+
+    void Release(int bank, std::size_t size, Buffer &&buffer, std::vector<Event> &&pending) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        statistics_.bytes_in_use -= size * sizeof(DramLine);
+        statistics_.bytes_cached += size * sizeof(DramLine);
+        free_[{bank, size}].push_back({std::move(buffer), std::move(pending)});
+    }
+
+    Allocator allocator_;
+    std::map<std::pair<int, std::size_t>, std::vector<Entry>> free_;
+    Statistics statistics_{};
+    mutable std::mutex mutex_;
+};
@@ -5,3 +5,18 @@
 #include "Config.h"
 
 ap_uint<2 * kBits> Karatsuba(ap_uint<kBits> const &a, ap_uint<kBits> const &b);
+
+/// Computes a*a, which is equal to Karatsuba(a, a), with a recursion that only ever squares. This saves the sign
+/// handling of the general case at every level, and one of the four partial products of every base case multiplier.
+ap_uint<2 * kBits> KaratsubaSquare(ap_uint<kBits> const &a);
+
+/// Upper bound on how far KaratsubaHigh can fall below the exact high half of a product of the given width. At every
+/// level, the dropped partial products are worth less than 3, and each of the three truncated products loses less
+/// than 1 on top of the error of the recursion.
+constexpr int KaratsubaHighError(int bits) {
+    return (bits <= kMultBaseBits) ? 0 : 2 * KaratsubaHighError(bits / 4) + 5;
+}
+
+/// Approximates the high half of the product a*b, i.e., bits [kBits, 2*kBits), using fewer multipliers than Karatsuba.
+/// The result is never larger than the exact high half, and at most KaratsubaHighError(kBits) smaller.
+ap_uint<kBits> KaratsubaHigh(ap_uint<kBits> const &a, ap_uint<kBits> const &b);
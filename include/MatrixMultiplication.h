@@ -2,6 +2,162 @@
 
 #include "Config.h"
 #include "DeviceTypes.h"
+#include "PackedFloat.h"
 
+/// Flags selecting how the MatrixMultiplication kernel combines the product with C. The processing elements only
+/// accumulate the product, so non-trivial scaling factors are applied once to every drained result on its way to
+/// memory.
+constexpr int kGemmScaleProduct = 1;    // Multiply the accumulated A*B by alpha after it has been drained
+constexpr int kGemmReadC = 2;           // Read C at all. Otherwise C is overwritten, and the c_read port is idle
+constexpr int kGemmScaleC = 4;          // Add beta*C after draining rather than starting the accumulation from C
+constexpr int kGemmTiledLayout = 8;     // A, B and C are stored in the kTiledA/B/C layouts of TiledLayout.h
+constexpr int kGemmCacheA = 16;         // Read each panel of A once, replaying it from chip for every tile along M
+constexpr int kGemmCacheB = 32;         // Traverse N inside M, reading each panel of B once and replaying it from chip
+constexpr int kGemmLowerTriangle = 64;  // Skip the tiles of a symmetric C that lie entirely above its diagonal
+
+/// Cheapest combination of flags computing alpha*A*B + beta*C
+constexpr int GemmFlags(bool alpha_is_one, bool beta_is_zero, bool beta_is_one) {
+    return beta_is_zero ? (alpha_is_one ? 0 : kGemmScaleProduct)
+                        : ((alpha_is_one && beta_is_one) ? kGemmReadC
+                                                         : (kGemmReadC | kGemmScaleC |
+                                                            (alpha_is_one ? 0 : kGemmScaleProduct)));
+}
+
+/// Number of numbers moved between memory and the kernel when multiplying with the given flags and tile shape.
+/// Without a stationary operand, the panels of A and B are read again for every tile of C.
+constexpr long CommunicationVolume(int size_n, int size_k, int size_m, int flags, int tile_n = kTileSizeN,
+                                   int tile_m = kTileSizeM) {
+    const long tiles_n = (size_n + tile_n - 1) / tile_n;
+    const long tiles_m = (size_m + tile_m - 1) / tile_m;
+    const long a_reads = ((flags & kGemmCacheA) != 0) ? tiles_n : tiles_n * tiles_m;
+    const long b_reads = ((flags & kGemmCacheB) != 0) ? tiles_m : tiles_n * tiles_m;
+    return (a_reads * tile_n + b_reads * tile_m) * size_k + tiles_n * tiles_m * 2 * tile_n * tile_m;
+}
+
+/// Stationary operand flag minimizing the communication volume, or 0 to stream both operands when neither panel of
+/// size_k numbers fits in the on-chip caches. The caches are sized for the largest tile shape, so narrower tiles can
+/// keep deeper panels.
+constexpr int StationaryOperandFlags(int size_n, int size_k, int size_m, int tile_n = kTileSizeN,
+                                     int tile_m = kTileSizeM) {
+    const bool fits_a = static_cast<long>(size_k) * tile_n <= static_cast<long>(kPanelCacheDepth) * kTileSizeN;
+    const bool fits_b = static_cast<long>(size_k) * tile_m <= static_cast<long>(kPanelCacheDepth) * kTileSizeM;
+    if (!fits_a || !fits_b) {
+        return fits_a ? kGemmCacheA : (fits_b ? kGemmCacheB : 0);
+    }
+    return (CommunicationVolume(size_n, size_k, size_m, kGemmCacheB, tile_n, tile_m) <
+            CommunicationVolume(size_n, size_k, size_m, kGemmCacheA, tile_n, tile_m))
+               ? kGemmCacheB
+               : kGemmCacheA;
+}
+
+/// Shape of the tiles of C computed by a single launch. Both sizes must be positive and at most kTileSizeN and
+/// kTileSizeM respectively, and m must be a multiple of kProcessingElements.
+struct TileShape {
+    int n;
+    int m;
+};
+
+static_assert(kTileSizeN * (kTileSizeM / kProcessingElements) >= kMinTileIterations,
+              "A pass over the largest tile must cover the latency of the multiply-accumulate pipeline.");
+
+/// Fewest rows that a pass over a tile with tile_m columns computes. Each partial sum is only written back to the
+/// accumulation buffer after the full latency of the multiply-accumulate pipeline, so tiles with fewer rows of C are
+/// padded with rows of zeros until a pass takes kMinTileIterations cycles, but never beyond the largest tile.
+constexpr int MinPassRows(int tile_m) {
+    const int tile_m_per_element = tile_m / kProcessingElements;
+    const int rows = (kMinTileIterations + tile_m_per_element - 1) / tile_m_per_element;
+    return (rows < kTileSizeN) ? rows : kTileSizeN;
+}
+
+/// Rows computed per pass over a tile holding the given number of rows of C
+constexpr int PassRows(int rows, int min_rows) {
+    return (rows < min_rows) ? min_rows : rows;
+}
+
+/// Rows computed per pass over all tiles along N, including the padding of tiles with too few rows
+constexpr long PaddedRows(int size_n, int tile_n, int tile_m) {
+    if (size_n <= 0) {
+        return 0;
+    }
+    const int min_rows = MinPassRows(tile_m);
+    const int full_tiles = (size_n - 1) / tile_n;
+    return static_cast<long>(full_tiles) * PassRows(tile_n, min_rows) +
+           PassRows(size_n - full_tiles * tile_n, min_rows);
+}
+
+/// Number of iterations spent by each processing element on the product, including the padding of the last tile
+/// along M and the padding rows of short passes
+constexpr long PaddedIterations(int size_n, int size_k, int size_m, int tile_n, int tile_m) {
+    return PaddedRows(size_n, tile_n, tile_m) * size_k * ((size_m + tile_m - 1) / tile_m) *
+           (tile_m / kProcessingElements);
+}
+
+/// Tile shape minimizing the padded work of a product, and then its communication volume. Every pass over a tile is
+/// padded to MinPassRows(tile_m) rows, which only reaches kMinTileIterations cycles if the tile is wide enough. Shapes
+/// meeting this are preferred regardless of their cost, and otherwise the shape keeping the shortest pass longest is
+/// chosen, as the distance between updates of the same partial sum must cover the latency of the multiply-accumulate
+/// pipeline. The largest shape always meets the minimum. Shapes padding M further than the largest one are never
+/// chosen, as the readers would access memory beyond what is allocated for it.
+constexpr TileShape ChooseTileShape(int size_n, int size_k, int size_m) {
+    const int max_padded_m = (size_m + kTileSizeM - 1) / kTileSizeM * kTileSizeM;
+    TileShape best{0, 0};
+    bool best_valid = false;
+    long best_distance = 0;
+    long best_work = 0;
+    long best_volume = 0;
+    // Candidates are visited from the largest shape down, which wins all ties
+    for (int tile_n = kTileSizeN; tile_n > 0; --tile_n) {
+        const int last_rows = size_n - (size_n - 1) / tile_n * tile_n;
+        for (int tile_m = kTileSizeM; tile_m > 0; tile_m -= kProcessingElements) {
+            if ((size_m + tile_m - 1) / tile_m * tile_m > max_padded_m) {
+                continue;
+            }
+            // The pass over the last tile along N is the shortest one
+            const long distance =
+                static_cast<long>(PassRows(last_rows, MinPassRows(tile_m))) * (tile_m / kProcessingElements);
+            const bool valid = distance >= kMinTileIterations;
+            const long work = PaddedIterations(size_n, size_k, size_m, tile_n, tile_m);
+            const long volume = CommunicationVolume(size_n, size_k, size_m,
+                                                    StationaryOperandFlags(size_n, size_k, size_m, tile_n, tile_m),
+                                                    tile_n, tile_m);
+            const bool better =
+                best.n == 0 ||
+                (valid != best_valid ? valid
+                                     : (!valid && distance != best_distance
+                                            ? distance > best_distance
+                                            : (work != best_work ? work < best_work : volume < best_volume)));
+            if (better) {
+                best = TileShape{tile_n, tile_m};
+                best_valid = valid;
+                best_distance = distance;
+                best_work = work;
+                best_volume = volume;
+            }
+        }
+    }
+    return best;
+}
+
+/// Computes C = alpha*A*B + beta*C in tiles of tile_n x tile_m, where the flags must have been derived from alpha and
+/// beta with GemmFlags, and can optionally select a stationary operand with StationaryOperandFlags for the same tile
+/// shape. The tiled layouts are only defined for the largest tile shape. With kGemmLowerTriangle, C holds the rows
+/// starting at row_offset of a symmetric matrix, such as A^T*A with A given as its transpose. Tiles that overlap the
+/// diagonal are computed in full, so only the entries above them are left untouched. row_offset is ignored otherwise.
 extern "C" void MatrixMultiplication(DramLine const *a, DramLine const *b, DramLine const *c_read, DramLine *c_write,
-                                     int n, int m, int k);
+                                     int n, int k, int m, int tile_n, int tile_m, int row_offset, PackedFloat alpha,
+                                     PackedFloat beta, int flags);
+
+/// Location and shape of a single problem in a batched matrix multiplication. Offsets are given in numbers from the
+/// start of the respective buffers, and every matrix is stored densely in row-major order.
+struct BatchDescriptor {
+    int a_offset;
+    int b_offset;
+    int c_offset;
+    int size_n;
+    int size_k;
+    int size_m;
+};
+
+/// Computes C += A*B for every problem in the descriptor table in a single launch. All sizes must be positive.
+extern "C" void BatchedMatrixMultiplication(BatchDescriptor const *descriptors, DramLine const *a, DramLine const *b,
+                                            DramLine const *c_read, DramLine *c_write, int num_problems);
@@ -1,6 +1,46 @@
 #pragma once
 
+#include <vector>
+
 #include "PackedFloat.h"
 
 /// Naive reference implementation of matrix multiplication implemented directly on GMP numbers, used for verification.
 void MatrixMultiplicationReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size_n, int size_k, int size_m);
+
+/// Reference for C = alpha*A*B + beta*C, rounding in the same order as the device does for the given scaling factors
+void MatrixMultiplicationReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size_n, int size_k, int size_m,
+                                   mpfr_srcptr alpha, mpfr_srcptr beta);
+
+/// Reference for a split-K computation of C = alpha*A*B + beta*C, where partial p covers [k_begin[p], k_begin[p+1]).
+/// The first partial includes beta*C, and the partials are then summed in order, as done by the device.
+void MatrixMultiplicationSplitKReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size_n, int size_k,
+                                         int size_m, mpfr_srcptr alpha, mpfr_srcptr beta,
+                                         std::vector<int> const &k_begin);
+
+/// Emulates the LongAccumulator of the device on GMP integers, truncating every term in the same way, so that the sum
+/// of a sequence of products is bit-identical to that of AccumulateProduct followed by Normalize.
+class LongAccumulatorReference {
+   public:
+    LongAccumulatorReference();
+    ~LongAccumulatorReference();
+
+    LongAccumulatorReference(LongAccumulatorReference const &) = delete;
+    LongAccumulatorReference &operator=(LongAccumulatorReference const &) = delete;
+
+    /// Starts the sum from c.
+    void Set(mpfr_srcptr c);
+
+    /// Adds a*b to the sum.
+    void AddProduct(mpfr_srcptr a, mpfr_srcptr b);
+
+    /// Sum rounded toward zero to the precision of result.
+    void Get(mpfr_ptr result) const;
+
+   private:
+    /// Adds term_, which is aligned to the given exponent, to the sum.
+    void AddTerm(mpfr_exp_t term_exponent);
+
+    mpz_t value_;
+    mpfr_exp_t exponent_;
+    mpz_t term_;
+};
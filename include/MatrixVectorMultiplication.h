@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Config.h"
+#include "DeviceTypes.h"
+#include "PackedFloat.h"
+
+/// Computes y = A*x for a row-major n x m matrix A and vectors x and y stored densely, or y += A*x if the kGemmReadC
+/// flag of MatrixMultiplication.h is set. A is streamed exactly once, so the kernel runs at the bandwidth of its memory
+/// bank rather than at the rate of the multiply-accumulate pipeline. Both sizes must be positive.
+extern "C" void MatrixVectorMultiplication(DramLine const *a, DramLine const *x, DramLine const *y_read,
+                                           DramLine *y_write, int n, int m, int flags);
@@ -3,5 +3,14 @@
 #include "Config.h"
 #include "DeviceTypes.h"
 
-extern "C" void Microbenchmark(DramLine const *const a, DramLine const *const b, DramLine *const c, const int size);
+/// Elementwise operations benchmarked by the kernel, passed as its operation argument
+constexpr int kMicrobenchmarkMultiply = 0;  // c = a * b
+constexpr int kMicrobenchmarkSqrt = 1;      // c = sqrt(a)
+constexpr int kMicrobenchmarkInvSqrt = 2;   // c = 1 / sqrt(a)
+constexpr int kMicrobenchmarkSquare = 3;    // c = a * a
+
+/// Applies the given operation to size numbers, one per cycle. b is not accessed unless the operation is
+/// kMicrobenchmarkMultiply.
+extern "C" void Microbenchmark(DramLine const *const a, DramLine const *const b, DramLine *const c, const int size,
+                               const int operation);
 
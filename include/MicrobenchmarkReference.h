@@ -2,4 +2,9 @@
 
 #include "PackedFloat.h"
 
-void MicrobenchmarkReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size);
+/// Computes the result of the microbenchmark kernel for the given operation. b is only used for multiplications.
+void MicrobenchmarkReference(mpfr_t const *a, mpfr_t const *b, mpfr_t *c, int size, int operation);
+
+/// Computes the result of the reduction kernel over size numbers in the given mode, adding in the same order as the
+/// kernel does. y is only used for dot products.
+void ReductionReference(mpfr_t const *x, mpfr_t const *y, mpfr_ptr result, int size, int mode);
@@ -120,6 +120,16 @@ class PackedFloat {
         return x;
     }
 
+    /// 1 = 1/2 * 2^1
+    static PackedFloat One() {
+#pragma HLS INLINE
+        PackedFloat x;
+        x.data_ = 0;
+        x.SetMantissa(MantissaFlat(1) << (kMantissaBits - 1));
+        x.SetExponent(1);
+        return x;
+    }
+
     inline bool IsZero() const {
         return GetMantissa() == 0;
     }
@@ -169,7 +179,7 @@ class PackedFloat {
         return *this;
     }
 
-    inline void ToGmp(mpf_ptr num) {
+    inline void ToGmp(mpf_ptr num) const {
         const size_t gmp_limbs = (mpf_get_prec(num) + 8 * sizeof(mp_limb_t) - 1) / (8 * sizeof(mp_limb_t));
         constexpr size_t kNumLimbs = kMantissaBytes / sizeof(Limb);
         // GMP does not allow graceful rounding, so we cannot handle having insufficient bits in the target GMP number
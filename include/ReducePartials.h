@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Config.h"
+#include "DeviceTypes.h"
+#include "PackedFloat.h"
+
+/// Sums num_partials partial results stored back to back in partials, each holding size numbers, and writes the sum
+/// to result. The partials are added in index order, starting from the first.
+extern "C" void ReducePartials(DramLine const *partials, DramLine *result, int num_partials, int size);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Config.h"
+#include "DeviceTypes.h"
+#include "PackedFloat.h"
+
+/// Quantities computed by the reduction kernel, passed as its mode argument
+constexpr int kReductionSum = 0;          // sum(x)
+constexpr int kReductionDot = 1;          // sum(x * y)
+constexpr int kReductionSquaredNorm = 2;  // sum(x * x)
+
+/// Smallest power of two that is at least the given number of cycles
+constexpr int ReductionLanes(const int latency) {
+    int lanes = 1;
+    while (lanes < latency) {
+        lanes *= 2;
+    }
+    return lanes;
+}
+
+/// Number of partial sums the reduction kernel rotates over. Consecutive updates of the same partial sum must be at
+/// least as far apart as the latency of the multiply-accumulate pipeline. The partial sums are merged pairwise, so this
+/// is a power of two.
+constexpr int kReductionLanes = ReductionLanes(kMultiplyAccumulateLatency);
+
+/// Reduces the size numbers stored densely in x (and y, for dot products) to a single number written to result,
+/// according to the given mode. Number i is accumulated into partial sum i % kReductionLanes, starting from zero. The
+/// second half of the partial sums is then added to the first half, element by element, and this is repeated until a
+/// single sum is left. Every addition, including those of the merges, goes through the same multiply-accumulate unit.
+/// y is not accessed unless the mode is kReductionDot. The size must be positive.
+extern "C" void Reduction(DramLine const *x, DramLine const *y, DramLine *result, int size, int mode);
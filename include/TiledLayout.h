@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>  // std::min
+#include <cstddef>
+
+#include "Config.h"
+
+/// Storage orders of matrices in device memory. Each tiled layout stores an operand of the matrix multiplication kernel
+/// in the exact order it is consumed, so every block is transferred with a single sequential burst:
+///  - kTiledA: blocks of kTileSizeN rows, each stored column by column.
+///  - kTiledB: blocks of kTileSizeM columns, each stored row by row. The last block is padded to kTileSizeM columns.
+///  - kTiledC: kTileSizeN x kTileSizeM tiles stored row by row, in row-major order of tiles. The last tile of every row
+///    of tiles is padded to kTileSizeM columns.
+/// Partial blocks along N are never padded.
+enum class MatrixLayout { kRowMajor, kTiledA, kTiledB, kTiledC };
+
+/// Number of numbers occupied by a rows x cols matrix in the given layout, including padding
+inline std::size_t LayoutSize(MatrixLayout layout, std::size_t rows, std::size_t cols) {
+    const std::size_t padded_cols = (cols + kTileSizeM - 1) / kTileSizeM * kTileSizeM;
+    return (layout == MatrixLayout::kTiledB || layout == MatrixLayout::kTiledC) ? rows * padded_cols : rows * cols;
+}
+
+/// Computes the row and column of the number stored at the given position of a rows x cols matrix in the given layout.
+/// Returns false if the position holds padding.
+inline bool LayoutCoordinates(MatrixLayout layout, std::size_t index, std::size_t rows, std::size_t cols,
+                              std::size_t &row, std::size_t &col) {
+    switch (layout) {
+        case MatrixLayout::kRowMajor: {
+            row = index / cols;
+            col = index % cols;
+            return true;
+        }
+        case MatrixLayout::kTiledA: {
+            const std::size_t block_size = kTileSizeN * cols;
+            const std::size_t n0 = index / block_size;
+            const std::size_t block_rows = std::min(std::size_t(kTileSizeN), rows - n0 * kTileSizeN);
+            const std::size_t offset = index % block_size;
+            row = n0 * kTileSizeN + offset % block_rows;
+            col = offset / block_rows;
+            return true;
+        }
+        case MatrixLayout::kTiledB: {
+            const std::size_t block_size = rows * kTileSizeM;
+            const std::size_t m0 = index / block_size;
+            const std::size_t offset = index % block_size;
+            row = offset / kTileSizeM;
+            col = m0 * kTileSizeM + offset % kTileSizeM;
+            return col < cols;
+        }
+        case MatrixLayout::kTiledC: {
+            const std::size_t tiles_m = (cols + kTileSizeM - 1) / kTileSizeM;
+            const std::size_t block_size = kTileSizeN * tiles_m * kTileSizeM;
+            const std::size_t n0 = index / block_size;
+            const std::size_t block_rows = std::min(std::size_t(kTileSizeN), rows - n0 * kTileSizeN);
+            const std::size_t tile_size = block_rows * kTileSizeM;
+            const std::size_t offset = index % block_size;
+            row = n0 * kTileSizeN + (offset % tile_size) / kTileSizeM;
+            col = (offset / tile_size) * kTileSizeM + offset % kTileSizeM;
+            return col < cols;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Config.h"
+#include "DeviceTypes.h"
+
+/// Writes the transpose of columns [col_begin, col_begin + col_count) of the row-major size_rows x size_cols matrix
+/// in input to output, as a row-major col_count x size_rows matrix.
+extern "C" void Transpose(DramLine const *input, DramLine *output, int size_rows, int size_cols, int col_begin,
+                          int col_count);
@@ -1,70 +1,1352 @@
 #include "Apfp.h"
 
 #include <MatrixMultiplication.h>
+#include <hlslib/xilinx/Utility.h>  // hlslib::CeilDivide
 
+#include <algorithm>  // std::max, std::min, std::remove_if
+#include <chrono>     // std::chrono::seconds
 #include <stdexcept>
+#include <string>
 
 #include "Config.h"
 
+namespace {
+
+// Mapping from compute unit to DDR bank. Must match APFP_BANK_ROTATION in CMakeLists.txt.
+constexpr int kDramMapping[] = {1, 0, 2, 3};
+
+// Whether the kernel summing partial results across compute units is linked into the program (APFP_REDUCE_PARTIALS)
+#ifdef APFP_REDUCE_PARTIALS
+constexpr bool kReducePartials = true;
+#else
+constexpr bool kReducePartials = false;
+#endif
+
+// Whether the reduction kernel is linked into the program (APFP_REDUCTION)
+#ifdef APFP_REDUCTION
+constexpr bool kReductionKernel = true;
+#else
+constexpr bool kReductionKernel = false;
+#endif
+
+// Whether the matrix-vector multiplication kernel is linked into the program (APFP_MATRIX_VECTOR)
+#ifdef APFP_MATRIX_VECTOR
+constexpr bool kMatrixVectorKernel = true;
+#else
+constexpr bool kMatrixVectorKernel = false;
+#endif
+
+void Unpack(PackedFloat const& source, mpf_ptr destination) {
+    source.ToGmp(destination);
+}
+
+void Unpack(PackedFloat const& source, mpfr_ptr destination) {
+    source.ToMpfr(destination);
+}
+
+/// Pack count numbers starting at position first of a shard stored in the given layout. The shard holds rows starting
+/// at row_begin of a block with cols columns, which is stored on the host with a row stride of leading_dimension.
+/// Padding positions of the layout are zeroed.
+template <typename T>
+void PackShard(ConversionEngine& converter, T const* source, std::size_t leading_dimension, MatrixLayout layout,
+               std::size_t row_begin, std::size_t rows, std::size_t cols, std::size_t first, std::size_t count,
+               PackedFloat* destination) {
+    if (layout == MatrixLayout::kRowMajor && leading_dimension == cols) {
+        converter.Pack(source + row_begin * cols + first, count, destination);
+        return;
+    }
+    converter.ParallelFor(count, [&](std::size_t begin, std::size_t end) {
+        std::size_t row, col;
+        for (std::size_t i = begin; i < end; ++i) {
+            destination[i] = LayoutCoordinates(layout, first + i, rows, cols, row, col)
+                                 ? PackedFloat(source[(row_begin + row) * leading_dimension + col])
+                                 : PackedFloat::Zero();
+        }
+    });
+}
+
+/// Inverse of PackShard, skipping padding
+template <typename T>
+void UnpackShard(ConversionEngine& converter, PackedFloat const* source, std::size_t first, std::size_t count,
+                 MatrixLayout layout, std::size_t row_begin, std::size_t rows, std::size_t cols,
+                 std::size_t leading_dimension, T* destination) {
+    if (layout == MatrixLayout::kRowMajor && leading_dimension == cols) {
+        converter.Unpack(source, count, destination + row_begin * cols + first);
+        return;
+    }
+    converter.ParallelFor(count, [&](std::size_t begin, std::size_t end) {
+        std::size_t row, col;
+        for (std::size_t i = begin; i < end; ++i) {
+            if (LayoutCoordinates(layout, first + i, rows, cols, row, col)) {
+                Unpack(source[i], destination[(row_begin + row) * leading_dimension + col]);
+            }
+        }
+    });
+}
+
+int GemmFlags(mpf_srcptr alpha, mpf_srcptr beta) {
+    return ::GemmFlags(mpf_cmp_ui(alpha, 1) == 0, mpf_sgn(beta) == 0, mpf_cmp_ui(beta, 1) == 0);
+}
+
+int GemmFlags(mpfr_srcptr alpha, mpfr_srcptr beta) {
+    return ::GemmFlags(mpfr_cmp_ui(alpha, 1) == 0, mpfr_zero_p(beta) != 0, mpfr_cmp_ui(beta, 1) == 0);
+}
+
+/// Number of host numbers spanned by a rows x cols block with the given row stride
+std::size_t BlockSpan(std::size_t rows, std::size_t cols, std::size_t leading_dimension) {
+    return (rows == 0 || cols == 0) ? 0 : (rows - 1) * leading_dimension + cols;
+}
+
+/// Array of MPFR numbers at the precision of the device, which are cleared together with the array
+class MpfrArray {
+   public:
+    explicit MpfrArray(std::size_t size) : data_(new mpfr_t[size]), size_(size) {
+        for (std::size_t i = 0; i < size_; ++i) {
+            mpfr_init2(data_[i], kMantissaBits);
+        }
+    }
+
+    ~MpfrArray() {
+        for (std::size_t i = 0; i < size_; ++i) {
+            mpfr_clear(data_[i]);
+        }
+    }
+
+    MpfrArray(MpfrArray const&) = delete;
+    MpfrArray& operator=(MpfrArray const&) = delete;
+
+    mpfr_t* data() {
+        return data_.get();
+    }
+
+    mpfr_ptr operator[](std::size_t i) {
+        return data_[i];
+    }
+
+   private:
+    std::unique_ptr<mpfr_t[]> data_;
+    std::size_t size_;
+};
+
+void Assign(mpfr_srcptr source, mpf_ptr destination) {
+    mpfr_get_f(destination, source, kRoundingMode);
+}
+
+void Assign(mpfr_srcptr source, mpfr_ptr destination) {
+    mpfr_set(destination, source, kRoundingMode);
+}
+
+void SetZero(mpf_ptr destination) {
+    mpf_set_ui(destination, 0);
+}
+
+void SetZero(mpfr_ptr destination) {
+    mpfr_set_zero(destination, 1);
+}
+
+/// Overwrite the lower triangle of a row-major size x size block with its Cholesky factor. Returns false if the block
+/// is not positive definite, in which case its contents are undefined.
+bool FactorizeBlock(mpfr_t* block, std::size_t size) {
+    MpfrArray scratch(2);
+    mpfr_ptr sum = scratch[0];
+    mpfr_ptr product = scratch[1];
+    for (std::size_t j = 0; j < size; ++j) {
+        mpfr_set(sum, block[j * size + j], kRoundingMode);
+        for (std::size_t k = 0; k < j; ++k) {
+            mpfr_sqr(product, block[j * size + k], kRoundingMode);
+            mpfr_sub(sum, sum, product, kRoundingMode);
+        }
+        if (mpfr_sgn(sum) <= 0) {
+            return false;
+        }
+        mpfr_sqrt(block[j * size + j], sum, kRoundingMode);
+        for (std::size_t i = j + 1; i < size; ++i) {
+            mpfr_set(sum, block[i * size + j], kRoundingMode);
+            for (std::size_t k = 0; k < j; ++k) {
+                mpfr_mul(product, block[i * size + k], block[j * size + k], kRoundingMode);
+                mpfr_sub(sum, sum, product, kRoundingMode);
+            }
+            mpfr_div(block[i * size + j], sum, block[j * size + j], kRoundingMode);
+        }
+    }
+    return true;
+}
+
+/// Compute the upper triangular inverse transpose of a lower triangular factor by forward substitution, one column of
+/// the inverse (a row of its transpose) at a time
+void InvertTransposedFactor(mpfr_t const* factor, mpfr_t* inverse_transposed, std::size_t size) {
+    MpfrArray scratch(2);
+    mpfr_ptr sum = scratch[0];
+    mpfr_ptr product = scratch[1];
+    for (std::size_t c = 0; c < size; ++c) {
+        mpfr_t* const row = inverse_transposed + c * size;
+        for (std::size_t r = 0; r < c; ++r) {
+            mpfr_set_zero(row[r], 1);
+        }
+        mpfr_ui_div(row[c], 1, factor[c * size + c], kRoundingMode);
+        for (std::size_t r = c + 1; r < size; ++r) {
+            mpfr_set_zero(sum, 1);
+            for (std::size_t k = c; k < r; ++k) {
+                mpfr_mul(product, factor[r * size + k], row[k], kRoundingMode);
+                mpfr_add(sum, sum, product, kRoundingMode);
+            }
+            mpfr_div(row[r], sum, factor[r * size + r], kRoundingMode);
+            mpfr_neg(row[r], row[r], kRoundingMode);
+        }
+    }
+}
+
+}  // namespace
+
 Apfp::Apfp() {
-    program_.emplace(context_.MakeProgram(kernel_path_));
+    program_.emplace(context_->MakeProgram(kernel_path_));
+    converter_ = std::make_shared<ConversionEngine>();
+    buffer_pool_ = MakeBufferPool(context_);
     lines_per_number_ = kLinesPerNumber;
 }
 
-DeviceMatrix Apfp::AllocateDeviceMatrix(std::size_t rows, std::size_t cols) {
+BufferPool::Handle Apfp::AllocateShard(int compute_unit, std::size_t rows, std::size_t cols) {
+    // The kernel reads full tiles of B and C regardless of the matrix bounds, so pad the allocation accordingly
+    const std::size_t padded_rows = hlslib::CeilDivide(rows, std::size_t(kTileSizeN)) * kTileSizeN;
+    const std::size_t padded_cols = hlslib::CeilDivide(cols, std::size_t(kTileSizeM)) * kTileSizeM;
+    return buffer_pool_->Allocate(kDramMapping[compute_unit % 4], lines_per_number_ * padded_rows * padded_cols);
+}
+
+DeviceMatrix Apfp::AllocateDeviceMatrix(std::size_t rows, std::size_t cols, MatrixLayout layout) {
     // This seems like poor encapsulation, is there a better way?
 
     DeviceMatrix matrix;
     matrix.num_rows_ = rows;
     matrix.num_cols_ = cols;
-    matrix.buffer_ = context_.MakeBuffer<DramLine, hlslib::ocl::Access::readWrite>(lines_per_number_ * rows * cols);
+    matrix.layout_ = layout;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        const std::size_t row_begin = (i * rows) / kComputeUnits;
+        const std::size_t row_end = ((i + 1) * rows) / kComputeUnits;
+        matrix.shards_.push_back({row_begin, row_end, AllocateShard(i, row_end - row_begin, cols)});
+    }
+    matrix.replicas_.resize(kComputeUnits);
+    matrix.converter_ = converter_;
     return matrix;
 }
 
 DeviceMatrix Apfp::MatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b) {
-    auto result = AllocateDeviceMatrix(a.rows(), b.cols());
-    MatrixMultiplication(a, b, &result);
+    auto result = AllocateDeviceMatrix(a.rows(), b.cols(),
+                                       (a.layout() == MatrixLayout::kTiledA) ? MatrixLayout::kTiledC
+                                                                             : MatrixLayout::kRowMajor);
+    // Recycled buffers hold stale data, so overwrite rather than accumulate into them
+    hlslib::ocl::WaitForEvents(LaunchMatrixMultiplication(a, b, &result, PackedFloat::Zero(), PackedFloat::Zero(),
+                                                          GemmFlags(true, true, false), {}));
     return result;
 }
 
 void Apfp::MatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b, DeviceMatrix* result) {
+    hlslib::ocl::WaitForEvents(MatrixMultiplicationAsync(a, b, result));
+}
+
+std::vector<hlslib::ocl::Event> Apfp::MatrixMultiplicationAsync(const DeviceMatrix& a, const DeviceMatrix& b,
+                                                                DeviceMatrix* result,
+                                                                std::vector<hlslib::ocl::Event> const& dependencies) {
+    // The scaling factors are not used when accumulating
+    return LaunchMatrixMultiplication(a, b, result, PackedFloat::Zero(), PackedFloat::Zero(),
+                                      GemmFlags(true, false, true), dependencies);
+}
+
+void Apfp::MatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b, DeviceMatrix* result, mpf_srcptr alpha,
+                                mpf_srcptr beta) {
+    hlslib::ocl::WaitForEvents(MatrixMultiplicationAsync(a, b, result, alpha, beta));
+}
+
+void Apfp::MatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b, DeviceMatrix* result, mpfr_srcptr alpha,
+                                mpfr_srcptr beta) {
+    hlslib::ocl::WaitForEvents(MatrixMultiplicationAsync(a, b, result, alpha, beta));
+}
+
+std::vector<hlslib::ocl::Event> Apfp::MatrixMultiplicationAsync(const DeviceMatrix& a, const DeviceMatrix& b,
+                                                                DeviceMatrix* result, mpf_srcptr alpha,
+                                                                mpf_srcptr beta,
+                                                                std::vector<hlslib::ocl::Event> const& dependencies) {
+    return LaunchMatrixMultiplication(a, b, result, PackedFloat(alpha), PackedFloat(beta), GemmFlags(alpha, beta),
+                                      dependencies);
+}
+
+std::vector<hlslib::ocl::Event> Apfp::MatrixMultiplicationAsync(const DeviceMatrix& a, const DeviceMatrix& b,
+                                                                DeviceMatrix* result, mpfr_srcptr alpha,
+                                                                mpfr_srcptr beta,
+                                                                std::vector<hlslib::ocl::Event> const& dependencies) {
+    return LaunchMatrixMultiplication(a, b, result, PackedFloat(alpha), PackedFloat(beta), GemmFlags(alpha, beta),
+                                      dependencies);
+}
+
+std::vector<hlslib::ocl::Event> Apfp::LaunchMatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b,
+                                                                 DeviceMatrix* result, PackedFloat const& alpha,
+                                                                 PackedFloat const& beta, const int flags,
+                                                                 std::vector<hlslib::ocl::Event> const& dependencies) {
     if (a.cols() != b.rows() || result->rows() != a.rows() || result->cols() != b.cols()) {
         throw std::logic_error("Matrix dimension mismatch");
     }
-    auto kernel =
-        program_->MakeKernel("MatrixMultiplication", a.buffer_, b.buffer_, result->buffer_, result->buffer_,
-                             static_cast<int>(a.rows()), static_cast<int>(b.rows()), static_cast<int>(result->cols()));
-    kernel.ExecuteTask();
+    if (kComputeUnits > 1 && (&b == result || &a == result)) {
+        throw std::logic_error("Output matrix cannot alias an input when running on multiple compute units");
+    }
+    const bool tiled = a.layout() == MatrixLayout::kTiledA && b.layout() == MatrixLayout::kTiledB &&
+                       result->layout() == MatrixLayout::kTiledC;
+    if (!tiled && (a.layout() != MatrixLayout::kRowMajor || b.layout() != MatrixLayout::kRowMajor ||
+                   result->layout() != MatrixLayout::kRowMajor)) {
+        throw std::logic_error("Operands must either all be row-major, or in the tiled layouts of A, B and C");
+    }
+
+    // Splitting N leaves compute units idle when there are fewer rows of tiles than compute units, in which case
+    // splitting K keeps all of them busy, as long as every one of them gets part of K
+    if (kReducePartials && !tiled && kComputeUnits > 1 &&
+        hlslib::CeilDivide(a.rows(), std::size_t(kTileSizeN)) < kComputeUnits && b.rows() >= kComputeUnits) {
+        return LaunchMatrixMultiplicationSplitK(a, b, result, alpha, beta, flags, dependencies);
+    }
+
+    // The result is overwritten, so any replicas of it are now stale
+    result->replicas_.clear();
+    result->replicas_.resize(kComputeUnits);
+    result->replica_events_.clear();
+    const auto kernel_dependencies = result->Dependencies(a.Dependencies(GatherReplicas(b, dependencies)));
+
+    std::vector<hlslib::ocl::Event> events;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        auto& c_shard = result->shards_[i];
+        if (c_shard.rows() == 0) {
+            continue;
+        }
+        auto& b_buffer = (kComputeUnits > 1) ? *b.replicas_[i] : *b.shards_[i].buffer;
+        const int size_n = static_cast<int>(c_shard.rows());
+        const int size_k = static_cast<int>(b.rows());
+        const int size_m = static_cast<int>(result->cols());
+        // The tiled layouts fix the tile shape, while row-major operands can use whichever shape wastes the least work
+        // on padding. Then keep whichever operand minimizes the memory traffic of this shard on chip.
+        const TileShape tile = tiled ? TileShape{kTileSizeN, kTileSizeM} : ChooseTileShape(size_n, size_k, size_m);
+        const int shard_flags = flags | StationaryOperandFlags(size_n, size_k, size_m, tile.n, tile.m) |
+                                (tiled ? kGemmTiledLayout : 0);
+        // Each shard is a block of rows of the symmetric result, so the diagonal is offset by its first row
+        const int row_offset = ((flags & kGemmLowerTriangle) != 0) ? static_cast<int>(c_shard.row_begin) : 0;
+        auto kernel = program_->MakeKernel(
+            "MatrixMultiplication:{MatrixMultiplication_" + std::to_string(i + 1) + "}", *a.shards_[i].buffer,
+            b_buffer, *c_shard.buffer, *c_shard.buffer, size_n, size_k, size_m, tile.n, tile.m, row_offset, alpha,
+            beta, shard_flags);
+        events.emplace_back(kernel.ExecuteTaskAsync(kernel_dependencies.cbegin(), kernel_dependencies.cend()));
+    }
+    // The replicas of B are released whenever B is overwritten, possibly before these kernels have run
+    a.RecordUse(events);
+    b.RecordUse(events);
+    result->RecordUse(events);
+    return events;
 }
 
-void Apfp::TransposeInPlace(DeviceMatrix*) {
-    throw std::exception();
+std::vector<hlslib::ocl::Event> Apfp::LaunchMatrixMultiplicationSplitK(
+    const DeviceMatrix& a, const DeviceMatrix& b, DeviceMatrix* result, PackedFloat const& alpha,
+    PackedFloat const& beta, const int flags, std::vector<hlslib::ocl::Event> const& dependencies) {
+    const std::size_t size_n = a.rows();
+    const std::size_t size_k = a.cols();
+    const std::size_t size_m = b.cols();
+
+    result->replicas_.clear();
+    result->replicas_.resize(kComputeUnits);
+    result->replica_events_.clear();
+    // A slice of A and a partial result per compute unit, followed by the gathered partials of every shard of C.
+    // References to the buffers are held while more are added, so the vector must not reallocate.
+    auto& scratch = result->scratch_;
+    scratch.clear();
+    scratch.reserve(3 * kComputeUnits);
+
+    // The shard of B in each bank is exactly the range of K needed by that compute unit, so only the matching columns
+    // of A must be gathered. N is small whenever K is split, so this is done with one copy per row.
+    std::vector<hlslib::ocl::Event> partial_events;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        auto const& b_shard = b.shards_[i];
+        const std::size_t depth = b_shard.rows();
+        scratch.emplace_back(AllocateShard(i, size_n, depth));
+        auto& a_slice = *scratch.back();
+        scratch.emplace_back(AllocateShard(i, size_n, size_m));
+        auto& partial = *scratch.back();
+        // Recycled scratch buffers can still be in use by their previous owners
+        const auto copy_dependencies = result->Dependencies(a.Dependencies(b.Dependencies(dependencies)));
+        std::vector<hlslib::ocl::Event> copies(copy_dependencies);
+        for (auto const& a_shard : a.shards_) {
+            for (std::size_t row = a_shard.row_begin; row < a_shard.row_end; ++row) {
+                copies.emplace_back(a_shard.buffer->CopyToDeviceAsync(
+                    lines_per_number_ * ((row - a_shard.row_begin) * size_k + b_shard.row_begin),
+                    lines_per_number_ * depth, a_slice, lines_per_number_ * row * depth, copy_dependencies.cbegin(),
+                    copy_dependencies.cend()));
+            }
+        }
+        // Only the first partial includes beta*C, while the others overwrite their scratch buffer. Every partial covers
+        // all rows of the result, so a lower triangle starts at row zero.
+        int partial_flags = flags & (kGemmScaleProduct | kGemmLowerTriangle);
+        if (i == 0) {
+            partial_flags = flags;
+            if ((flags & kGemmReadC) != 0) {
+                for (auto const& c_shard : result->shards_) {
+                    copies.emplace_back(c_shard.buffer->CopyToDeviceAsync(
+                        0, lines_per_number_ * c_shard.rows() * size_m, partial,
+                        lines_per_number_ * c_shard.row_begin * size_m, copy_dependencies.cbegin(),
+                        copy_dependencies.cend()));
+                }
+            }
+        }
+        const TileShape tile =
+            ChooseTileShape(static_cast<int>(size_n), static_cast<int>(depth), static_cast<int>(size_m));
+        partial_flags |= StationaryOperandFlags(static_cast<int>(size_n), static_cast<int>(depth),
+                                                static_cast<int>(size_m), tile.n, tile.m);
+        auto kernel = program_->MakeKernel(
+            "MatrixMultiplication:{MatrixMultiplication_" + std::to_string(i + 1) + "}", a_slice, *b_shard.buffer,
+            partial, partial, static_cast<int>(size_n), static_cast<int>(depth), static_cast<int>(size_m), tile.n,
+            tile.m, 0, alpha, beta, partial_flags);
+        partial_events.emplace_back(kernel.ExecuteTaskAsync(copies.cbegin(), copies.cend()));
+    }
+
+    // Every compute unit sums its shard of rows across all partials into its shard of the result
+    const int num_partials = kComputeUnits;
+    std::vector<hlslib::ocl::Event> events;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        auto& c_shard = result->shards_[i];
+        if (c_shard.rows() == 0) {
+            continue;
+        }
+        const std::size_t shard_size = c_shard.rows() * size_m;
+        scratch.emplace_back(
+            buffer_pool_->Allocate(kDramMapping[i % 4], lines_per_number_ * num_partials * shard_size));
+        auto& gathered = *scratch.back();
+        const auto gather_dependencies = result->Dependencies(partial_events);
+        std::vector<hlslib::ocl::Event> gathers;
+        for (int p = 0; p < num_partials; ++p) {
+            gathers.emplace_back(scratch[2 * p + 1]->CopyToDeviceAsync(
+                lines_per_number_ * c_shard.row_begin * size_m, lines_per_number_ * shard_size, gathered,
+                lines_per_number_ * p * shard_size, gather_dependencies.cbegin(), gather_dependencies.cend()));
+        }
+        auto kernel = program_->MakeKernel("ReducePartials:{ReducePartials_" + std::to_string(i + 1) + "}", gathered,
+                                           *c_shard.buffer, num_partials, static_cast<int>(shard_size));
+        events.emplace_back(kernel.ExecuteTaskAsync(gathers.cbegin(), gathers.cend()));
+    }
+    // Every copy and partial product precedes the reductions, so these are the last users of all buffers involved,
+    // including the scratch buffers now owned by the result
+    a.RecordUse(events);
+    b.RecordUse(events);
+    result->RecordUse(events);
+    return events;
+}
+
+DeviceMatrix Apfp::SymmetricRankK(const DeviceMatrix& b) {
+    auto result = AllocateDeviceMatrix(b.cols(), b.cols());
+    // Recycled buffers hold stale data, so overwrite rather than accumulate into them
+    hlslib::ocl::WaitForEvents(
+        LaunchSymmetricRankK(b, &result, PackedFloat::Zero(), PackedFloat::Zero(), GemmFlags(true, true, false), {}));
+    return result;
+}
+
+void Apfp::SymmetricRankK(const DeviceMatrix& b, DeviceMatrix* result) {
+    hlslib::ocl::WaitForEvents(SymmetricRankKAsync(b, result));
+}
+
+std::vector<hlslib::ocl::Event> Apfp::SymmetricRankKAsync(const DeviceMatrix& b, DeviceMatrix* result,
+                                                          std::vector<hlslib::ocl::Event> const& dependencies) {
+    return LaunchSymmetricRankK(b, result, PackedFloat::Zero(), PackedFloat::Zero(), GemmFlags(true, false, true),
+                                dependencies);
+}
+
+void Apfp::SymmetricRankK(const DeviceMatrix& b, DeviceMatrix* result, mpf_srcptr alpha, mpf_srcptr beta) {
+    hlslib::ocl::WaitForEvents(SymmetricRankKAsync(b, result, alpha, beta));
+}
+
+void Apfp::SymmetricRankK(const DeviceMatrix& b, DeviceMatrix* result, mpfr_srcptr alpha, mpfr_srcptr beta) {
+    hlslib::ocl::WaitForEvents(SymmetricRankKAsync(b, result, alpha, beta));
 }
 
-DeviceMatrix Apfp::Transpose(const DeviceMatrix&) {
-    throw std::exception();
+std::vector<hlslib::ocl::Event> Apfp::SymmetricRankKAsync(const DeviceMatrix& b, DeviceMatrix* result,
+                                                          mpf_srcptr alpha, mpf_srcptr beta,
+                                                          std::vector<hlslib::ocl::Event> const& dependencies) {
+    return LaunchSymmetricRankK(b, result, PackedFloat(alpha), PackedFloat(beta), GemmFlags(alpha, beta),
+                                dependencies);
+}
+
+std::vector<hlslib::ocl::Event> Apfp::SymmetricRankKAsync(const DeviceMatrix& b, DeviceMatrix* result,
+                                                          mpfr_srcptr alpha, mpfr_srcptr beta,
+                                                          std::vector<hlslib::ocl::Event> const& dependencies) {
+    return LaunchSymmetricRankK(b, result, PackedFloat(alpha), PackedFloat(beta), GemmFlags(alpha, beta),
+                                dependencies);
+}
+
+std::vector<hlslib::ocl::Event> Apfp::LaunchSymmetricRankK(const DeviceMatrix& b, DeviceMatrix* result,
+                                                           PackedFloat const& alpha, PackedFloat const& beta,
+                                                           const int flags,
+                                                           std::vector<hlslib::ocl::Event> const& dependencies) {
+    if (result->rows() != b.cols() || result->cols() != b.cols()) {
+        throw std::logic_error("Matrix dimension mismatch");
+    }
+    if (b.layout() != MatrixLayout::kRowMajor || result->layout() != MatrixLayout::kRowMajor) {
+        throw std::logic_error("Symmetric rank-k updates are only supported for row-major matrices");
+    }
+    // The kernel reads the left-hand operand by rows of the result, so B^T is formed on the device first, and kept
+    // with the result until it is overwritten again
+    result->scratch_.clear();
+    auto b_transposed = AllocateDeviceMatrix(b.cols(), b.rows());
+    const auto transposed = TransposeAsync(b, &b_transposed, dependencies);
+    auto events =
+        LaunchMatrixMultiplication(b_transposed, b, result, alpha, beta, flags | kGemmLowerTriangle, transposed);
+    for (auto& shard : b_transposed.shards_) {
+        result->scratch_.emplace_back(std::move(shard.buffer));
+    }
+    return events;
+}
+
+DeviceMatrix Apfp::MatrixVectorMultiplication(const DeviceMatrix& a, const DeviceMatrix& x) {
+    auto y = AllocateDeviceMatrix(a.rows(), 1);
+    // Recycled buffers hold stale data, so overwrite rather than accumulate into them
+    hlslib::ocl::WaitForEvents(LaunchMatrixVectorMultiplication(a, x, &y, 0, {}));
+    return y;
+}
+
+void Apfp::MatrixVectorMultiplication(const DeviceMatrix& a, const DeviceMatrix& x, DeviceMatrix* y) {
+    hlslib::ocl::WaitForEvents(MatrixVectorMultiplicationAsync(a, x, y));
+}
+
+std::vector<hlslib::ocl::Event> Apfp::MatrixVectorMultiplicationAsync(
+    const DeviceMatrix& a, const DeviceMatrix& x, DeviceMatrix* y,
+    std::vector<hlslib::ocl::Event> const& dependencies) {
+    return LaunchMatrixVectorMultiplication(a, x, y, kGemmReadC, dependencies);
+}
+
+std::vector<hlslib::ocl::Event> Apfp::LaunchMatrixVectorMultiplication(
+    const DeviceMatrix& a, const DeviceMatrix& x, DeviceMatrix* y, const int flags,
+    std::vector<hlslib::ocl::Event> const& dependencies) {
+    if (a.cols() != x.rows() || x.cols() != 1 || y->rows() != a.rows() || y->cols() != 1) {
+        throw std::logic_error("Matrix dimension mismatch");
+    }
+    if (&x == y || &a == y) {
+        throw std::logic_error("Output vector cannot alias an input of a matrix-vector multiplication");
+    }
+    if (a.layout() != MatrixLayout::kRowMajor || x.layout() != MatrixLayout::kRowMajor ||
+        y->layout() != MatrixLayout::kRowMajor) {
+        throw std::logic_error("Matrix-vector multiplication is only supported for row-major operands");
+    }
+    if (!kMatrixVectorKernel) {
+        // The flags of both kernels agree, and the matrix multiplication kernel handles a single column like any other
+        return LaunchMatrixMultiplication(a, x, y, PackedFloat::Zero(), PackedFloat::Zero(), flags, dependencies);
+    }
+
+    y->replicas_.clear();
+    y->replicas_.resize(kComputeUnits);
+    y->replica_events_.clear();
+    // A and y are sharded by rows in the same way, so only x has to be present in every bank
+    const auto kernel_dependencies = y->Dependencies(a.Dependencies(GatherReplicas(x, dependencies)));
+
+    std::vector<hlslib::ocl::Event> events;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        auto& y_shard = y->shards_[i];
+        if (y_shard.rows() == 0) {
+            continue;
+        }
+        auto& x_buffer = (kComputeUnits > 1) ? *x.replicas_[i] : *x.shards_[i].buffer;
+        auto kernel = program_->MakeKernel(
+            "MatrixVectorMultiplication:{MatrixVectorMultiplication_" + std::to_string(i + 1) + "}",
+            *a.shards_[i].buffer, x_buffer, *y_shard.buffer, *y_shard.buffer, static_cast<int>(y_shard.rows()),
+            static_cast<int>(a.cols()), flags);
+        events.emplace_back(kernel.ExecuteTaskAsync(kernel_dependencies.cbegin(), kernel_dependencies.cend()));
+    }
+    a.RecordUse(events);
+    x.RecordUse(events);
+    y->RecordUse(events);
+    return events;
+}
+
+DeviceMatrix Apfp::Dot(const DeviceMatrix& x, const DeviceMatrix& y) {
+    auto result = AllocateDeviceMatrix(1, 1);
+    hlslib::ocl::WaitForEvents(DotAsync(x, y, &result));
+    return result;
+}
+
+DeviceMatrix Apfp::Sum(const DeviceMatrix& x) {
+    auto result = AllocateDeviceMatrix(1, 1);
+    hlslib::ocl::WaitForEvents(SumAsync(x, &result));
+    return result;
+}
+
+DeviceMatrix Apfp::SquaredNorm(const DeviceMatrix& x) {
+    auto result = AllocateDeviceMatrix(1, 1);
+    hlslib::ocl::WaitForEvents(SquaredNormAsync(x, &result));
+    return result;
+}
+
+std::vector<hlslib::ocl::Event> Apfp::DotAsync(const DeviceMatrix& x, const DeviceMatrix& y, DeviceMatrix* result,
+                                               std::vector<hlslib::ocl::Event> const& dependencies) {
+    return LaunchReduction(x, &y, result, kReductionDot, dependencies);
+}
+
+std::vector<hlslib::ocl::Event> Apfp::SumAsync(const DeviceMatrix& x, DeviceMatrix* result,
+                                               std::vector<hlslib::ocl::Event> const& dependencies) {
+    return LaunchReduction(x, nullptr, result, kReductionSum, dependencies);
+}
+
+std::vector<hlslib::ocl::Event> Apfp::SquaredNormAsync(const DeviceMatrix& x, DeviceMatrix* result,
+                                                       std::vector<hlslib::ocl::Event> const& dependencies) {
+    return LaunchReduction(x, nullptr, result, kReductionSquaredNorm, dependencies);
+}
+
+std::vector<hlslib::ocl::Event> Apfp::LaunchReduction(const DeviceMatrix& x, const DeviceMatrix* y,
+                                                      DeviceMatrix* result, const int mode,
+                                                      std::vector<hlslib::ocl::Event> const& dependencies) {
+    if (!kReductionKernel) {
+        throw std::logic_error("Reductions require the reduction kernel, which is linked with APFP_REDUCTION");
+    }
+    if (result->rows() != 1 || result->cols() != 1 || (y && (y->rows() != x.rows() || y->cols() != x.cols()))) {
+        throw std::logic_error("Matrix dimension mismatch");
+    }
+    if (x.rows() * x.cols() == 0) {
+        throw std::logic_error("Cannot reduce an empty matrix");
+    }
+    if (&x == result || y == result) {
+        throw std::logic_error("Output matrix cannot alias an input of a reduction");
+    }
+    if (x.layout() != MatrixLayout::kRowMajor || (y && y->layout() != MatrixLayout::kRowMajor) ||
+        result->layout() != MatrixLayout::kRowMajor) {
+        throw std::logic_error("Reductions are only supported for row-major operands");
+    }
+
+    result->replicas_.clear();
+    result->replicas_.resize(kComputeUnits);
+    result->replica_events_.clear();
+    auto& scratch = result->scratch_;
+    scratch.clear();
+    scratch.reserve(kComputeUnits + 1);
+
+    // The single number of the result lives in the bank of exactly one compute unit
+    int result_unit = 0;
+    while (result->shards_[result_unit].rows() == 0) {
+        ++result_unit;
+    }
+    auto& result_buffer = *result->shards_[result_unit].buffer;
+
+    // Without the kernel combining partial results, the compute unit holding the result reduces replicas of the
+    // operands gathered into its bank
+    if (kComputeUnits > 1 && !kReducePartials) {
+        auto kernel_dependencies = GatherReplicas(x, dependencies);
+        if (y) {
+            kernel_dependencies = GatherReplicas(*y, kernel_dependencies);
+        }
+        kernel_dependencies = result->Dependencies(std::move(kernel_dependencies));
+        auto& x_buffer = *x.replicas_[result_unit];
+        auto& y_buffer = y ? *y->replicas_[result_unit] : x_buffer;
+        auto kernel = program_->MakeKernel("Reduction:{Reduction_" + std::to_string(result_unit + 1) + "}", x_buffer,
+                                           y_buffer, result_buffer, static_cast<int>(x.rows() * x.cols()), mode);
+        const std::vector<hlslib::ocl::Event> events{
+            kernel.ExecuteTaskAsync(kernel_dependencies.cbegin(), kernel_dependencies.cend())};
+        x.RecordUse(events);
+        if (y) {
+            y->RecordUse(events);
+        }
+        result->RecordUse(events);
+        return events;
+    }
+
+    // With a single compute unit, its partial result is the final result. Otherwise, every compute unit writes a
+    // partial to its own bank, from where they are gathered into the bank of the result.
+    std::vector<hlslib::ocl::Event> partial_events;
+    std::vector<int> partial_units;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        auto const& x_shard = x.shards_[i];
+        if (x_shard.rows() == 0) {
+            continue;
+        }
+        // The second operand is never read unless computing a dot product, but the kernel still needs a buffer
+        auto& y_buffer = y ? *y->shards_[i].buffer : *x_shard.buffer;
+        BufferPool::Buffer* partial = &result_buffer;
+        if (kComputeUnits > 1) {
+            scratch.emplace_back(buffer_pool_->Allocate(kDramMapping[i % 4], lines_per_number_));
+            partial = &*scratch.back();
+        }
+        auto kernel = program_->MakeKernel("Reduction:{Reduction_" + std::to_string(i + 1) + "}", *x_shard.buffer,
+                                           y_buffer, *partial, static_cast<int>(x_shard.rows() * x.cols()), mode);
+        auto kernel_dependencies = result->Dependencies(x.Dependencies(dependencies));
+        if (y) {
+            kernel_dependencies = y->Dependencies(std::move(kernel_dependencies));
+        }
+        partial_events.emplace_back(kernel.ExecuteTaskAsync(kernel_dependencies.cbegin(), kernel_dependencies.cend()));
+        partial_units.emplace_back(i);
+    }
+    if (kComputeUnits == 1) {
+        x.RecordUse(partial_events);
+        if (y) {
+            y->RecordUse(partial_events);
+        }
+        result->RecordUse(partial_events);
+        return partial_events;
+    }
+
+    // The partials are summed in the order of the compute units, like the partials of a split-K multiplication
+    const int num_partials = static_cast<int>(partial_units.size());
+    scratch.emplace_back(buffer_pool_->Allocate(kDramMapping[result_unit % 4], lines_per_number_ * num_partials));
+    auto& gathered = *scratch.back();
+    const auto gather_dependencies = result->Dependencies(partial_events);
+    std::vector<hlslib::ocl::Event> gathers;
+    for (int p = 0; p < num_partials; ++p) {
+        gathers.emplace_back(scratch[p]->CopyToDeviceAsync(0, lines_per_number_, gathered, lines_per_number_ * p,
+                                                           gather_dependencies.cbegin(), gather_dependencies.cend()));
+    }
+    auto kernel = program_->MakeKernel("ReducePartials:{ReducePartials_" + std::to_string(result_unit + 1) + "}",
+                                       gathered, result_buffer, num_partials, 1);
+    const std::vector<hlslib::ocl::Event> events{kernel.ExecuteTaskAsync(gathers.cbegin(), gathers.cend())};
+    x.RecordUse(events);
+    if (y) {
+        y->RecordUse(events);
+    }
+    result->RecordUse(events);
+    return events;
+}
+
+std::vector<hlslib::ocl::Event> Apfp::GatherReplicas(const DeviceMatrix& matrix,
+                                                     std::vector<hlslib::ocl::Event> const& dependencies) {
+    if (kComputeUnits > 1 && !matrix.replicas_[0]) {
+        matrix.replica_events_.clear();
+        for (int i = 0; i < kComputeUnits; ++i) {
+            matrix.replicas_[i] = AllocateShard(i, matrix.rows(), matrix.cols());
+        }
+        const auto copy_dependencies = matrix.Dependencies(dependencies);
+        for (int i = 0; i < kComputeUnits; ++i) {
+            for (auto const& shard : matrix.shards_) {
+                if (shard.rows() == 0) {
+                    continue;
+                }
+                if (matrix.layout() != MatrixLayout::kTiledB) {
+                    // Row blocks are contiguous in both the row-major and the tiled layouts of A and C
+                    matrix.replica_events_.emplace_back(shard.buffer->CopyToDeviceAsync(
+                        0, lines_per_number_ * LayoutSize(matrix.layout(), shard.rows(), matrix.cols()),
+                        *matrix.replicas_[i],
+                        lines_per_number_ * LayoutSize(matrix.layout(), shard.row_begin, matrix.cols()),
+                        copy_dependencies.cbegin(), copy_dependencies.cend()));
+                    continue;
+                }
+                // Every panel of columns of B holds a slice of each shard
+                const std::size_t tiles_m = hlslib::CeilDivide(matrix.cols(), std::size_t(kTileSizeM));
+                for (std::size_t m0 = 0; m0 < tiles_m; ++m0) {
+                    matrix.replica_events_.emplace_back(shard.buffer->CopyToDeviceAsync(
+                        lines_per_number_ * m0 * shard.rows() * kTileSizeM,
+                        lines_per_number_ * shard.rows() * kTileSizeM, *matrix.replicas_[i],
+                        lines_per_number_ * (m0 * matrix.rows() + shard.row_begin) * kTileSizeM,
+                        copy_dependencies.cbegin(), copy_dependencies.cend()));
+                }
+            }
+        }
+    }
+    auto events = matrix.Dependencies(dependencies);
+    events.insert(events.end(), matrix.replica_events_.begin(), matrix.replica_events_.end());
+    return events;
+}
+
+void Apfp::TransposeInPlace(DeviceMatrix* a) {
+    auto result = AllocateDeviceMatrix(a->cols(), a->rows());
+    hlslib::ocl::WaitForEvents(TransposeAsync(*a, &result));
+    // The old buffers are returned to the pool
+    *a = std::move(result);
+}
+
+DeviceMatrix Apfp::Transpose(const DeviceMatrix& a) {
+    auto result = AllocateDeviceMatrix(a.cols(), a.rows());
+    hlslib::ocl::WaitForEvents(TransposeAsync(a, &result));
+    return result;
+}
+
+std::vector<hlslib::ocl::Event> Apfp::TransposeAsync(const DeviceMatrix& a, DeviceMatrix* result,
+                                                     std::vector<hlslib::ocl::Event> const& dependencies) {
+    if (result->rows() != a.cols() || result->cols() != a.rows()) {
+        throw std::logic_error("Matrix dimension mismatch");
+    }
+    if (&a == result) {
+        throw std::logic_error("Output matrix cannot alias the input of a transpose");
+    }
+    if (a.layout() != MatrixLayout::kRowMajor || result->layout() != MatrixLayout::kRowMajor) {
+        throw std::logic_error("Transpose is only supported for row-major matrices");
+    }
+
+    result->replicas_.clear();
+    result->replicas_.resize(kComputeUnits);
+    result->replica_events_.clear();
+    // Each row block of the output is a block of columns of the input, which can span every shard of the input
+    const auto kernel_dependencies = result->Dependencies(GatherReplicas(a, dependencies));
+
+    std::vector<hlslib::ocl::Event> events;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        auto& out_shard = result->shards_[i];
+        if (out_shard.rows() == 0) {
+            continue;
+        }
+        auto& input = (kComputeUnits > 1) ? *a.replicas_[i] : *a.shards_[i].buffer;
+        auto kernel = program_->MakeKernel("Transpose:{Transpose_" + std::to_string(i + 1) + "}", input,
+                                           *out_shard.buffer, static_cast<int>(a.rows()), static_cast<int>(a.cols()),
+                                           static_cast<int>(out_shard.row_begin), static_cast<int>(out_shard.rows()));
+        events.emplace_back(kernel.ExecuteTaskAsync(kernel_dependencies.cbegin(), kernel_dependencies.cend()));
+    }
+    a.RecordUse(events);
+    result->RecordUse(events);
+    return events;
+}
+
+std::vector<hlslib::ocl::Event> Apfp::CopySubmatrix(const DeviceMatrix& source, std::size_t row, std::size_t col,
+                                                    DeviceMatrix* destination,
+                                                    std::vector<hlslib::ocl::Event> const& dependencies) {
+    if (row + destination->rows() > source.rows() || col + destination->cols() > source.cols()) {
+        throw std::logic_error("Submatrix exceeds the bounds of the source matrix");
+    }
+    if (source.layout() != MatrixLayout::kRowMajor || destination->layout() != MatrixLayout::kRowMajor) {
+        throw std::logic_error("Submatrices can only be copied between row-major matrices");
+    }
+
+    destination->replicas_.clear();
+    destination->replicas_.resize(kComputeUnits);
+    destination->replica_events_.clear();
+    const auto copy_dependencies = destination->Dependencies(source.Dependencies(dependencies));
+
+    std::vector<hlslib::ocl::Event> events;
+    for (auto& shard : destination->shards_) {
+        for (std::size_t r = shard.row_begin; r < shard.row_end; ++r) {
+            // Shards are ordered by row, and empty ones end where the previous one does
+            auto const& source_shard =
+                *std::find_if(source.shards_.begin(), source.shards_.end(),
+                              [&](auto const& candidate) { return row + r < candidate.row_end; });
+            events.emplace_back(source_shard.buffer->CopyToDeviceAsync(
+                lines_per_number_ * ((row + r - source_shard.row_begin) * source.cols() + col),
+                lines_per_number_ * destination->cols(), *shard.buffer,
+                lines_per_number_ * (r - shard.row_begin) * destination->cols(), copy_dependencies.cbegin(),
+                copy_dependencies.cend()));
+        }
+    }
+    source.RecordUse(events);
+    destination->RecordUse(events);
+    return events;
+}
+
+void Apfp::Cholesky(const mpf_t* a, mpf_t* l, std::size_t size, std::size_t block_size) {
+    CholeskyImpl(a, l, size, block_size);
+}
+
+void Apfp::Cholesky(const mpfr_t* a, mpfr_t* l, std::size_t size, std::size_t block_size) {
+    CholeskyImpl(a, l, size, block_size);
+}
+
+template <typename T>
+void Apfp::CholeskyImpl(T const* a, T* l, std::size_t size, std::size_t block_size) {
+    if (block_size == 0) {
+        throw std::invalid_argument("Block size must be positive");
+    }
+    if (size == 0) {
+        return;
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+        for (std::size_t j = i + 1; j < size; ++j) {
+            SetZero(l[i * size + j]);
+        }
+    }
+
+    // The trailing matrix is updated as A22 = -1 * L21 * L21^T + 1 * A22, of which only the lower triangle is needed
+    MpfrArray scaling(2);
+    mpfr_set_si(scaling[0], -1, kRoundingMode);
+    mpfr_set_ui(scaling[1], 1, kRoundingMode);
+    const PackedFloat alpha(scaling[0]);
+    const PackedFloat beta(scaling[1]);
+    const int update_flags = GemmFlags(scaling[0], scaling[1]) | kGemmLowerTriangle;
+
+    const std::size_t max_block = std::min(block_size, size);
+    MpfrArray diagonal(max_block * max_block);
+    MpfrArray inverse_transposed(max_block * max_block);
+
+    auto trailing = AllocateDeviceMatrix(size, size);
+    auto ready = trailing.TransferToDeviceImpl(a, size * size, size, {});
+    for (std::size_t j0 = 0; j0 < size; j0 += block_size) {
+        const std::size_t block = std::min(block_size, size - j0);
+        const std::size_t rest = size - j0 - block;
+
+        // Factorize the diagonal block on the host, L11 = chol(A11)
+        auto diagonal_block = AllocateDeviceMatrix(block, block);
+        const auto diagonal_copied = CopySubmatrix(trailing, 0, 0, &diagonal_block, ready);
+        diagonal_block.TransferToHostImpl(diagonal.data(), block * block, block, diagonal_copied).get();
+        if (!FactorizeBlock(diagonal.data(), block)) {
+            throw std::runtime_error("Matrix is not positive definite");
+        }
+        for (std::size_t i = 0; i < block; ++i) {
+            for (std::size_t j = 0; j <= i; ++j) {
+                Assign(diagonal[i * block + j], l[(j0 + i) * size + j0 + j]);
+            }
+        }
+        if (rest == 0) {
+            break;
+        }
+
+        // Solve for the panel below it on the device, L21 = A21 * L11^-T
+        InvertTransposedFactor(diagonal.data(), inverse_transposed.data(), block);
+        auto inverse_block = AllocateDeviceMatrix(block, block);
+        auto solve_dependencies =
+            inverse_block.TransferToDeviceImpl(inverse_transposed.data(), block * block, block, {});
+        auto panel = AllocateDeviceMatrix(rest, block);
+        const auto panel_copied = CopySubmatrix(trailing, block, 0, &panel, ready);
+        solve_dependencies.insert(solve_dependencies.end(), panel_copied.begin(), panel_copied.end());
+        auto factor = AllocateDeviceMatrix(rest, block);
+        const auto solved = LaunchMatrixMultiplication(panel, inverse_block, &factor, PackedFloat::Zero(),
+                                                       PackedFloat::Zero(), GemmFlags(true, true, false),
+                                                       solve_dependencies);
+        auto download = factor.TransferToHostImpl(l + (j0 + block) * size + j0, BlockSpan(rest, block, size), size,
+                                                  solved);
+
+        // Update the lower triangle of the trailing matrix on the device, A22 -= L21 * L21^T
+        auto next = AllocateDeviceMatrix(rest, rest);
+        auto update_dependencies = CopySubmatrix(trailing, block, block, &next, ready);
+        auto factor_transposed = AllocateDeviceMatrix(block, rest);
+        const auto transposed = TransposeAsync(factor, &factor_transposed, solved);
+        update_dependencies.insert(update_dependencies.end(), transposed.begin(), transposed.end());
+        ready = LaunchMatrixMultiplication(factor, factor_transposed, &next, alpha, beta, update_flags,
+                                           update_dependencies);
+
+        // The next diagonal block is needed on the host right away, so nothing is gained by letting this step's
+        // buffers outlive it. The download of the panel overlaps with the update.
+        hlslib::ocl::WaitForEvents(ready);
+        download.get();
+        trailing = std::move(next);
+    }
+}
+
+void Apfp::MatrixMultiplicationOutOfCore(const mpf_t* a, const mpf_t* b, mpf_t* c, std::size_t size_n,
+                                         std::size_t size_k, std::size_t size_m, std::size_t block_size) {
+    MatrixMultiplicationOutOfCoreImpl(a, b, c, size_n, size_k, size_m, block_size);
+}
+
+void Apfp::MatrixMultiplicationOutOfCore(const mpfr_t* a, const mpfr_t* b, mpfr_t* c, std::size_t size_n,
+                                         std::size_t size_k, std::size_t size_m, std::size_t block_size) {
+    MatrixMultiplicationOutOfCoreImpl(a, b, c, size_n, size_k, size_m, block_size);
+}
+
+template <typename T>
+void Apfp::MatrixMultiplicationOutOfCoreImpl(T const* a, T const* b, T* c, std::size_t size_n, std::size_t size_k,
+                                             std::size_t size_m, std::size_t block_size) {
+    if (block_size == 0) {
+        throw std::invalid_argument("Block size must be positive");
+    }
+    if (size_n == 0 || size_k == 0 || size_m == 0) {
+        return;
+    }
+    // Blocks that are not a multiple of the tile size would be padded by the kernel in every block, rather than only
+    // at the edge of the full matrix. The blocks are gathered from the host matrices element by element anyway, so
+    // they are repacked into the tiled layouts at no extra cost, letting the kernels read them in long bursts.
+    const std::size_t block_n = hlslib::CeilDivide(block_size, std::size_t(kTileSizeN)) * kTileSizeN;
+    const std::size_t block_m = hlslib::CeilDivide(block_size, std::size_t(kTileSizeM)) * kTileSizeM;
+    const std::size_t block_k = block_size;
+
+    // Two slots per operand: while the kernels read from one, the next blocks are converted and uploaded to the other.
+    // Buffers are recycled through the pool, so reallocating a slot for every block is cheap.
+    std::optional<DeviceMatrix> a_blocks[2], b_blocks[2], c_blocks[2];
+    std::vector<hlslib::ocl::Event> slot_kernels[2];  // Kernels last enqueued reading from each slot of A and B
+    std::future<void> c_downloads[2];                 // Pending download from each slot of C
+    std::size_t ab_step = 0;
+    std::size_t c_step = 0;
+
+    for (std::size_t n0 = 0; n0 < size_n; n0 += block_n) {
+        const std::size_t rows = std::min(block_n, size_n - n0);
+        for (std::size_t m0 = 0; m0 < size_m; m0 += block_m) {
+            const std::size_t cols = std::min(block_m, size_m - m0);
+            const std::size_t c_slot = c_step++ % 2;
+
+            // The download of the block previously held in this slot must finish before its buffers are recycled
+            if (c_downloads[c_slot].valid()) {
+                c_downloads[c_slot].get();
+            }
+            c_blocks[c_slot] = AllocateDeviceMatrix(rows, cols, MatrixLayout::kTiledC);
+            auto& c_block = *c_blocks[c_slot];
+            T* const c_ptr = c + n0 * size_m + m0;
+            auto accumulate = c_block.TransferToDeviceImpl(c_ptr, BlockSpan(rows, cols, size_m), size_m, {});
+
+            for (std::size_t k0 = 0; k0 < size_k; k0 += block_k) {
+                const std::size_t depth = std::min(block_k, size_k - k0);
+                const std::size_t slot = ab_step++ % 2;
+
+                // Only the kernels from two steps ago must finish, so the kernels enqueued in the previous step keep
+                // the device busy while this pair of blocks is being converted
+                hlslib::ocl::WaitForEvents(slot_kernels[slot]);
+                a_blocks[slot] = AllocateDeviceMatrix(rows, depth, MatrixLayout::kTiledA);
+                b_blocks[slot] = AllocateDeviceMatrix(depth, cols, MatrixLayout::kTiledB);
+                auto dependencies = a_blocks[slot]->TransferToDeviceImpl(a + n0 * size_k + k0,
+                                                                         BlockSpan(rows, depth, size_k), size_k, {});
+                const auto b_events = b_blocks[slot]->TransferToDeviceImpl(
+                    b + k0 * size_m + m0, BlockSpan(depth, cols, size_m), size_m, {});
+                dependencies.insert(dependencies.end(), b_events.begin(), b_events.end());
+                // Consecutive blocks of K accumulate into the same block of C, so they must run in order
+                dependencies.insert(dependencies.end(), accumulate.begin(), accumulate.end());
+                accumulate = MatrixMultiplicationAsync(*a_blocks[slot], *b_blocks[slot], &c_block, dependencies);
+                slot_kernels[slot] = accumulate;
+            }
+
+            c_downloads[c_slot] = c_block.TransferToHostImpl(c_ptr, BlockSpan(rows, cols, size_m), size_m, accumulate);
+        }
+    }
+    for (auto& download : c_downloads) {
+        if (download.valid()) {
+            download.get();
+        }
+    }
+}
+
+DeviceBatch Apfp::AllocateDeviceBatch(std::vector<std::pair<std::size_t, std::size_t>> const& shapes) {
+    DeviceBatch batch;
+    batch.unit_sizes_.resize(kComputeUnits, 0);
+    for (std::size_t i = 0; i < shapes.size(); ++i) {
+        auto& unit_size = batch.unit_sizes_[i % kComputeUnits];
+        batch.entries_.push_back({shapes[i].first, shapes[i].second, unit_size});
+        unit_size += shapes[i].first * shapes[i].second;
+    }
+    for (int i = 0; i < kComputeUnits; ++i) {
+        // The kernel reads up to a tile beyond the last row of B and C
+        batch.buffers_.emplace_back(
+            buffer_pool_->Allocate(kDramMapping[i % 4], lines_per_number_ * (batch.unit_sizes_[i] + kTileSizeM)));
+    }
+    batch.converter_ = converter_;
+    return batch;
+}
+
+void Apfp::BatchedMatrixMultiplication(const DeviceBatch& a, const DeviceBatch& b, DeviceBatch* c) {
+    hlslib::ocl::WaitForEvents(BatchedMatrixMultiplicationAsync(a, b, c));
+}
+
+std::vector<hlslib::ocl::Event> Apfp::BatchedMatrixMultiplicationAsync(
+    const DeviceBatch& a, const DeviceBatch& b, DeviceBatch* c, std::vector<hlslib::ocl::Event> const& dependencies) {
+    if (a.size() != b.size() || a.size() != c->size()) {
+        throw std::logic_error("Batch size mismatch");
+    }
+    std::vector<std::vector<BatchDescriptor>> descriptors(kComputeUnits);
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (a.cols(i) != b.rows(i) || c->rows(i) != a.rows(i) || c->cols(i) != b.cols(i)) {
+            throw std::logic_error("Matrix dimension mismatch at batch index " + std::to_string(i));
+        }
+        // Empty problems leave C untouched, and the kernel requires positive sizes. Any other shape is safe, as the
+        // kernel pads problems with few rows until every pass covers the latency of the multiply-accumulate pipeline.
+        if (a.rows(i) == 0 || a.cols(i) == 0 || b.cols(i) == 0) {
+            continue;
+        }
+        descriptors[i % kComputeUnits].push_back(
+            {static_cast<int>(a.entries_[i].offset), static_cast<int>(b.entries_[i].offset),
+             static_cast<int>(c->entries_[i].offset), static_cast<int>(a.rows(i)), static_cast<int>(a.cols(i)),
+             static_cast<int>(b.cols(i))});
+    }
+
+    // The tables are owned by the output batch, which must be kept alive until the kernels complete anyway
+    c->descriptor_tables_.clear();
+    const auto kernel_dependencies = c->Dependencies(b.Dependencies(a.Dependencies(dependencies)));
+    std::vector<hlslib::ocl::Event> events;
+    for (int i = 0; i < kComputeUnits; ++i) {
+        if (descriptors[i].empty()) {
+            continue;
+        }
+        c->descriptor_tables_.emplace_back(context_->MakeBuffer<BatchDescriptor, hlslib::ocl::Access::read>(
+            hlslib::ocl::StorageType::DDR, kDramMapping[i % 4], descriptors[i].size()));
+        c->descriptor_tables_.back().CopyFromHost(0, descriptors[i].size(), descriptors[i].cbegin());
+        auto kernel = program_->MakeKernel(
+            "BatchedMatrixMultiplication:{BatchedMatrixMultiplication_" + std::to_string(i + 1) + "}",
+            c->descriptor_tables_.back(), *a.buffers_[i], *b.buffers_[i], *c->buffers_[i], *c->buffers_[i],
+            static_cast<int>(descriptors[i].size()));
+        events.emplace_back(kernel.ExecuteTaskAsync(kernel_dependencies.cbegin(), kernel_dependencies.cend()));
+    }
+    a.RecordUse(events);
+    b.RecordUse(events);
+    c->RecordUse(events);
+    return events;
+}
+
+BufferPool::Statistics Apfp::BufferPoolStatistics() const {
+    return buffer_pool_->statistics();
+}
+
+void Apfp::ReleaseCachedBuffers() {
+    buffer_pool_->Clear();
+}
+
+void DeviceMatrix::RecordUse(std::vector<hlslib::ocl::Event> const& events) const {
+    for (auto const& shard : shards_) {
+        shard.buffer.RecordUse(events);
+    }
+    for (auto const& replica : replicas_) {
+        replica.RecordUse(events);
+    }
+    for (auto const& buffer : scratch_) {
+        buffer.RecordUse(events);
+    }
+}
+
+std::vector<hlslib::ocl::Event> DeviceMatrix::Dependencies(std::vector<hlslib::ocl::Event> events) const {
+    auto add = [&events](BufferPool::Handle const& handle) {
+        events.insert(events.end(), handle.dependencies().begin(), handle.dependencies().end());
+    };
+    for (auto const& shard : shards_) {
+        add(shard.buffer);
+    }
+    for (auto const& replica : replicas_) {
+        add(replica);
+    }
+    for (auto const& buffer : scratch_) {
+        add(buffer);
+    }
+    return events;
 }
 
 void DeviceMatrix::TransferToDevice(const mpf_t* buffer_ptr, std::size_t buffer_size) {
-    if (rows() * cols() > buffer_size) {
+    hlslib::ocl::WaitForEvents(TransferToDeviceAsync(buffer_ptr, buffer_size));
+}
+
+void DeviceMatrix::TransferToDevice(const mpfr_t* buffer_ptr, std::size_t buffer_size) {
+    hlslib::ocl::WaitForEvents(TransferToDeviceAsync(buffer_ptr, buffer_size));
+}
+
+std::vector<hlslib::ocl::Event> DeviceMatrix::TransferToDeviceAsync(
+    const mpf_t* buffer_ptr, std::size_t buffer_size, std::vector<hlslib::ocl::Event> const& dependencies) {
+    return TransferToDeviceImpl(buffer_ptr, buffer_size, cols(), dependencies);
+}
+
+std::vector<hlslib::ocl::Event> DeviceMatrix::TransferToDeviceAsync(
+    const mpfr_t* buffer_ptr, std::size_t buffer_size, std::vector<hlslib::ocl::Event> const& dependencies) {
+    return TransferToDeviceImpl(buffer_ptr, buffer_size, cols(), dependencies);
+}
+
+template <typename T>
+std::vector<hlslib::ocl::Event> DeviceMatrix::TransferToDeviceImpl(
+    T const* buffer_ptr, std::size_t buffer_size, std::size_t leading_dimension,
+    std::vector<hlslib::ocl::Event> const& dependencies) {
+    if (BlockSpan(rows(), cols(), leading_dimension) > buffer_size) {
         throw std::runtime_error("Source host buffer size smaller than destination device matrix size");
     }
 
     // TODO: This all assumes a bit width and will break once we need different runtime sizes
-    std::vector<PackedFloat> host_buffer;
-    host_buffer.resize(cols() * rows());
+    // Previous uploads can still be reading from their staging buffers, so every call packs into a new one
+    std::size_t staging_size = 0;
+    for (auto const& shard : shards_) {
+        staging_size += LayoutSize(layout_, shard.rows(), cols());
+    }
+    auto staging = std::make_shared<StagingBuffer>(staging_size);
 
-    std::transform(buffer_ptr, buffer_ptr + host_buffer.size(), host_buffer.begin(),
-                   [](const mpf_t& a) { return PackedFloat(a); });
+    // Any replicas gathered from the previous contents are now stale
+    const auto num_replicas = replicas_.size();
+    replicas_.clear();
+    replicas_.resize(num_replicas);
+    replica_events_.clear();
+    const auto copy_dependencies = Dependencies(dependencies);
 
-    buffer_.CopyFromHost(0, host_buffer.size() * kLinesPerNumber,
-                         reinterpret_cast<DramLine const*>(host_buffer.data()));
+    // Convert and transfer in chunks that give every conversion thread a full chunk of work, so the DMA of each chunk
+    // overlaps with the conversion of the next, even within a single shard
+    const std::size_t chunk_size = converter_->num_threads() * ConversionEngine::kChunkSize;
+    std::vector<hlslib::ocl::Event> events;
+    std::size_t shard_offset = 0;
+    for (auto& shard : shards_) {
+        const std::size_t shard_size = LayoutSize(layout_, shard.rows(), cols());
+        for (std::size_t i = 0; i < shard_size; i += chunk_size) {
+            const std::size_t size = std::min(chunk_size, shard_size - i);
+            PackShard(*converter_, buffer_ptr, leading_dimension, layout_, shard.row_begin, shard.rows(), cols(), i,
+                      size, &(*staging)[shard_offset + i]);
+            events.emplace_back(shard.buffer->CopyFromHostAsync(
+                kLinesPerNumber * i, kLinesPerNumber * size,
+                reinterpret_cast<DramLine const*>(&(*staging)[shard_offset + i]), copy_dependencies.cbegin(),
+                copy_dependencies.cend()));
+        }
+        shard_offset += shard_size;
+    }
+    RecordUse(events);
+
+    // Hold on to the staging buffer until the transfers have completed, and drop the tasks of finished uploads
+    pending_uploads_.erase(std::remove_if(pending_uploads_.begin(), pending_uploads_.end(),
+                                          [](auto const& upload) {
+                                              return upload.wait_for(std::chrono::seconds(0)) ==
+                                                     std::future_status::ready;
+                                          }),
+                           pending_uploads_.end());
+    pending_uploads_.emplace_back(std::async(std::launch::async, [staging = std::move(staging), events]() mutable {
+        hlslib::ocl::WaitForEvents(events);
+    }));
+    return events;
 }
 
 void DeviceMatrix::TransferToHost(mpf_t* buffer_ptr, std::size_t buffer_size) {
-    if (rows() * cols() >= buffer_size) {
+    TransferToHostAsync(buffer_ptr, buffer_size).get();
+}
+
+void DeviceMatrix::TransferToHost(mpfr_t* buffer_ptr, std::size_t buffer_size) {
+    TransferToHostAsync(buffer_ptr, buffer_size).get();
+}
+
+std::future<void> DeviceMatrix::TransferToHostAsync(mpf_t* buffer_ptr, std::size_t buffer_size,
+                                                    std::vector<hlslib::ocl::Event> const& dependencies) {
+    return TransferToHostImpl(buffer_ptr, buffer_size, cols(), dependencies);
+}
+
+std::future<void> DeviceMatrix::TransferToHostAsync(mpfr_t* buffer_ptr, std::size_t buffer_size,
+                                                    std::vector<hlslib::ocl::Event> const& dependencies) {
+    return TransferToHostImpl(buffer_ptr, buffer_size, cols(), dependencies);
+}
+
+template <typename T>
+std::future<void> DeviceMatrix::TransferToHostImpl(T* buffer_ptr, std::size_t buffer_size,
+                                                   std::size_t leading_dimension,
+                                                   std::vector<hlslib::ocl::Event> const& dependencies) {
+    if (BlockSpan(rows(), cols(), leading_dimension) > buffer_size) {
         throw std::runtime_error("Destination host buffer size smaller than source device matrix size");
     }
 
-    buffer_.CopyToHost(0, kLinesPerNumber * rows() * cols(), reinterpret_cast<DramLine*>(buffer_ptr));
+    // Transfer in chunks that give every conversion thread a full chunk of work, so unpacking of one chunk overlaps
+    // with the DMA of the next
+    const std::size_t chunk_size = converter_->num_threads() * ConversionEngine::kChunkSize;
+    struct Chunk {
+        std::size_t row_begin;  // Of the shard the chunk belongs to
+        std::size_t rows;
+        std::size_t first;  // Position within the shard
+        std::size_t size;
+        std::size_t staging_offset;
+        hlslib::ocl::Event event;
+    };
+    // Like uploads, every download gets a staging buffer of its own, so several can be pending at once
+    std::size_t staging_size = 0;
+    for (auto const& shard : shards_) {
+        staging_size += LayoutSize(layout_, shard.rows(), cols());
+    }
+    auto staging = std::make_shared<StagingBuffer>(staging_size);
+    const auto copy_dependencies = Dependencies(dependencies);
+    std::vector<Chunk> chunks;
+    std::size_t shard_offset = 0;
+    for (auto& shard : shards_) {
+        const std::size_t shard_size = LayoutSize(layout_, shard.rows(), cols());
+        for (std::size_t i = 0; i < shard_size; i += chunk_size) {
+            const std::size_t size = std::min(chunk_size, shard_size - i);
+            chunks.push_back({shard.row_begin, shard.rows(), i, size, shard_offset + i,
+                              shard.buffer->CopyToHostAsync(kLinesPerNumber * i, kLinesPerNumber * size,
+                                                           reinterpret_cast<DramLine*>(&(*staging)[shard_offset + i]),
+                                                           copy_dependencies.cbegin(), copy_dependencies.cend())});
+        }
+        shard_offset += shard_size;
+    }
+    std::vector<hlslib::ocl::Event> copies;
+    for (auto const& chunk : chunks) {
+        copies.emplace_back(chunk.event);
+    }
+    RecordUse(copies);
+
+    // Unpack on a separate thread, so the caller can keep enqueuing work in the meantime. The lambda holds its own
+    // references to the staging buffer and conversion engine so the matrix can be moved while the download is pending.
+    return std::async(std::launch::async, [chunks = std::move(chunks), staging, converter = converter_, buffer_ptr,
+                                           layout = layout_, cols = cols(), leading_dimension]() mutable {
+        for (auto& chunk : chunks) {
+            chunk.event.wait();
+            UnpackShard(*converter, &(*staging)[chunk.staging_offset], chunk.first, chunk.size, layout,
+                        chunk.row_begin, chunk.rows, cols, leading_dimension, buffer_ptr);
+        }
+    });
+}
+
+void DeviceBatch::RecordUse(std::vector<hlslib::ocl::Event> const& events) const {
+    for (auto const& buffer : buffers_) {
+        buffer.RecordUse(events);
+    }
+}
+
+std::vector<hlslib::ocl::Event> DeviceBatch::Dependencies(std::vector<hlslib::ocl::Event> events) const {
+    for (auto const& buffer : buffers_) {
+        events.insert(events.end(), buffer.dependencies().begin(), buffer.dependencies().end());
+    }
+    return events;
+}
+
+std::size_t DeviceBatch::num_elements() const {
+    std::size_t total = 0;
+    for (auto const& entry : entries_) {
+        total += entry.rows * entry.cols;
+    }
+    return total;
+}
+
+void DeviceBatch::HostOffsets(std::vector<std::size_t>& host_offsets, std::vector<std::size_t>& unit_offsets) const {
+    host_offsets.resize(entries_.size());
+    std::size_t host_offset = 0;
+    for (std::size_t i = 0; i < entries_.size(); ++i) {
+        host_offsets[i] = host_offset;
+        host_offset += entries_[i].rows * entries_[i].cols;
+    }
+    unit_offsets.resize(unit_sizes_.size());
+    std::size_t unit_offset = 0;
+    for (std::size_t i = 0; i < unit_sizes_.size(); ++i) {
+        unit_offsets[i] = unit_offset;
+        unit_offset += unit_sizes_[i];
+    }
+}
+
+void DeviceBatch::TransferToDevice(const mpf_t* buffer_ptr, std::size_t buffer_size) {
+    TransferToDeviceImpl(buffer_ptr, buffer_size);
+}
+
+void DeviceBatch::TransferToDevice(const mpfr_t* buffer_ptr, std::size_t buffer_size) {
+    TransferToDeviceImpl(buffer_ptr, buffer_size);
+}
+
+template <typename T>
+void DeviceBatch::TransferToDeviceImpl(T const* buffer_ptr, std::size_t buffer_size) {
+    if (num_elements() > buffer_size) {
+        throw std::runtime_error("Source host buffer size smaller than destination device batch size");
+    }
+    std::vector<std::size_t> host_offsets, unit_offsets;
+    HostOffsets(host_offsets, unit_offsets);
+    staging_.resize(num_elements());
+    // Parallelize over matrices rather than numbers, as the matrices are expected to be small
+    const std::size_t num_units = unit_sizes_.size();
+    converter_->ParallelFor(entries_.size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            auto const& entry = entries_[i];
+            const auto destination = unit_offsets[i % num_units] + entry.offset;
+            for (std::size_t j = 0; j < entry.rows * entry.cols; ++j) {
+                staging_[destination + j] = PackedFloat(buffer_ptr[host_offsets[i] + j]);
+            }
+        }
+    });
+    // Recycled buffers can still be in use by their previous owners
+    const auto copy_dependencies = Dependencies({});
+    std::vector<hlslib::ocl::Event> events;
+    for (std::size_t i = 0; i < num_units; ++i) {
+        if (unit_sizes_[i] == 0) {
+            continue;
+        }
+        events.emplace_back(buffers_[i]->CopyFromHostAsync(
+            0, kLinesPerNumber * unit_sizes_[i], reinterpret_cast<DramLine const*>(&staging_[unit_offsets[i]]),
+            copy_dependencies.cbegin(), copy_dependencies.cend()));
+    }
+    hlslib::ocl::WaitForEvents(events);
+}
+
+void DeviceBatch::TransferToHost(mpf_t* buffer_ptr, std::size_t buffer_size) {
+    TransferToHostImpl(buffer_ptr, buffer_size);
+}
+
+void DeviceBatch::TransferToHost(mpfr_t* buffer_ptr, std::size_t buffer_size) {
+    TransferToHostImpl(buffer_ptr, buffer_size);
+}
+
+template <typename T>
+void DeviceBatch::TransferToHostImpl(T* buffer_ptr, std::size_t buffer_size) {
+    if (num_elements() > buffer_size) {
+        throw std::runtime_error("Destination host buffer size smaller than source device batch size");
+    }
+    std::vector<std::size_t> host_offsets, unit_offsets;
+    HostOffsets(host_offsets, unit_offsets);
+    staging_.resize(num_elements());
+    const std::size_t num_units = unit_sizes_.size();
+    const auto copy_dependencies = Dependencies({});
+    std::vector<hlslib::ocl::Event> events;
+    for (std::size_t i = 0; i < num_units; ++i) {
+        if (unit_sizes_[i] == 0) {
+            continue;
+        }
+        events.emplace_back(buffers_[i]->CopyToHostAsync(0, kLinesPerNumber * unit_sizes_[i],
+                                                         reinterpret_cast<DramLine*>(&staging_[unit_offsets[i]]),
+                                                         copy_dependencies.cbegin(), copy_dependencies.cend()));
+    }
+    hlslib::ocl::WaitForEvents(events);
+    converter_->ParallelFor(entries_.size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            auto const& entry = entries_[i];
+            const auto source = unit_offsets[i % num_units] + entry.offset;
+            for (std::size_t j = 0; j < entry.rows * entry.cols; ++j) {
+                Unpack(staging_[source + j], buffer_ptr[host_offsets[i] + j]);
+            }
+        }
+    });
 }
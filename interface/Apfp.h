@@ -1,52 +1,299 @@
 #pragma once
 #include <gmp.h>
 #include <hlslib/xilinx/OpenCL.h>
+#include <mpfr.h>
 
+#include <future>
+#include <memory>
 #include <optional>
+#include <vector>
 
+#include "BufferPool.h"
+#include "Conversion.h"
 #include "MatrixMultiplication.h"
+#include "MatrixVectorMultiplication.h"
 #include "PackedFloat.h"
+#include "Reduction.h"
+#include "TiledLayout.h"
 
 class DeviceMatrix;
+class DeviceBatch;
+
+/// Host-side staging buffer for DMA transfers. Page alignment lets the runtime DMA directly from it.
+using StagingBuffer = std::vector<PackedFloat, hlslib::ocl::AlignedAllocator<PackedFloat, 4096>>;
 
 /// Object oriented interface for Apfp
 class Apfp {
-    hlslib::ocl::Context context_;
+    // Shared with the buffer pool, which can outlive this object as long as device matrices hold on to its buffers
+    std::shared_ptr<hlslib::ocl::Context> context_ = std::make_shared<hlslib::ocl::Context>();
     std::optional<hlslib::ocl::Program> program_;
+    std::shared_ptr<ConversionEngine> converter_;
+    std::shared_ptr<BufferPool> buffer_pool_;
 
     std::size_t lines_per_number_;
     const std::string kernel_path_ = "";
 
+    /// Allocate a pooled buffer in the DDR bank attached to the given compute unit, padded to full tiles
+    BufferPool::Handle AllocateShard(int compute_unit, std::size_t rows, std::size_t cols);
+
+    /// Make sure the full matrix is available in the bank of every compute unit, returning the events that must
+    /// complete before the replicas can be read. With a single compute unit, the matrix already lives in the right
+    /// bank.
+    std::vector<hlslib::ocl::Event> GatherReplicas(const DeviceMatrix& matrix,
+                                                   std::vector<hlslib::ocl::Event> const& dependencies);
+
+    /// Launch the kernels computing result = alpha * a * b + beta * result with the given GemmFlags
+    std::vector<hlslib::ocl::Event> LaunchMatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b,
+                                                               DeviceMatrix* result, PackedFloat const& alpha,
+                                                               PackedFloat const& beta, int flags,
+                                                               std::vector<hlslib::ocl::Event> const& dependencies);
+
+    /// Launch a multiplication where every compute unit computes a partial result over the range of K given by its
+    /// shard of B, and the partials are then summed by the reduction kernels. Used when there are too few rows of
+    /// tiles to give every compute unit a share of N.
+    std::vector<hlslib::ocl::Event> LaunchMatrixMultiplicationSplitK(
+        const DeviceMatrix& a, const DeviceMatrix& b, DeviceMatrix* result, PackedFloat const& alpha,
+        PackedFloat const& beta, int flags, std::vector<hlslib::ocl::Event> const& dependencies);
+
+    /// Launch the kernels computing the lower triangle of result = alpha * b^T * b + beta * result with the given
+    /// GemmFlags, forming b^T on the device first
+    std::vector<hlslib::ocl::Event> LaunchSymmetricRankK(const DeviceMatrix& b, DeviceMatrix* result,
+                                                         PackedFloat const& alpha, PackedFloat const& beta, int flags,
+                                                         std::vector<hlslib::ocl::Event> const& dependencies);
+
+    /// Launch the kernels computing y = A * x, or y += A * x if the kGemmReadC flag is set, falling back to the matrix
+    /// multiplication kernel if the matrix-vector kernel is not linked
+    std::vector<hlslib::ocl::Event> LaunchMatrixVectorMultiplication(
+        const DeviceMatrix& a, const DeviceMatrix& x, DeviceMatrix* y, int flags,
+        std::vector<hlslib::ocl::Event> const& dependencies);
+
+    /// Launch the kernels reducing x (and y, for dot products) to the 1 x 1 result in the given reduction mode. Every
+    /// compute unit reduces its shard to a partial result, and the partials are then summed in the bank of the result.
+    std::vector<hlslib::ocl::Event> LaunchReduction(const DeviceMatrix& x, const DeviceMatrix* y, DeviceMatrix* result,
+                                                    int mode, std::vector<hlslib::ocl::Event> const& dependencies);
+
+    /// Copy the block of destination->rows() x destination->cols() numbers starting at the given row and column of a
+    /// row-major matrix into the row-major destination, with one device-side copy per row
+    std::vector<hlslib::ocl::Event> CopySubmatrix(const DeviceMatrix& source, std::size_t row, std::size_t col,
+                                                  DeviceMatrix* destination,
+                                                  std::vector<hlslib::ocl::Event> const& dependencies);
+
+    template <typename T>
+    void CholeskyImpl(T const* a, T* l, std::size_t size, std::size_t block_size);
+
+    template <typename T>
+    void MatrixMultiplicationOutOfCoreImpl(T const* a, T const* b, T* c, std::size_t size_n, std::size_t size_k,
+                                           std::size_t size_m, std::size_t block_size);
+
    public:
     Apfp();
 
-    /// Allocate a buffer on the device
-    DeviceMatrix AllocateDeviceMatrix(std::size_t rows, std::size_t cols);
+    // Owns the device context and program, which cannot be duplicated
+    Apfp(Apfp const&) = delete;
+    Apfp(Apfp&&) = delete;
+    Apfp& operator=(Apfp const&) = delete;
+    Apfp& operator=(Apfp&&) = delete;
 
-    /// Two argument matrix multiply allocating the output buffer
+    /// Allocate a buffer on the device. The rows are partitioned into one block per compute unit, each residing in the
+    /// memory bank of that compute unit. Host buffers are always row-major, and are repacked into the device layout
+    /// during conversion. Matrices that are only used as operands of multiplications can be stored in the tiled layouts
+    /// (kTiledA for left-hand operands, kTiledB for right-hand operands and kTiledC for results), which the kernels
+    /// read and write in long sequential bursts instead of one burst per number.
+    DeviceMatrix AllocateDeviceMatrix(std::size_t rows, std::size_t cols,
+                                      MatrixLayout layout = MatrixLayout::kRowMajor);
+
+    /// Two argument matrix multiply allocating the output buffer. The result is written without reading the
+    /// (uninitialized) output buffer, and is stored in the kTiledC layout if A is stored in the kTiledA layout.
     DeviceMatrix MatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b);
 
-    /// Three argument matrix multiply with supplied output buffer
+    /// Three argument matrix multiply with supplied output buffer. The operands must either all be row-major, or all be
+    /// stored in the tiled layout matching their role.
     void MatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b, DeviceMatrix* result);
 
+    /// Three argument matrix multiply that returns as soon as the kernels have been enqueued. Each compute unit
+    /// computes the row block of the result residing in its bank, after B has been gathered into every bank. When A
+    /// has fewer rows of tiles than there are compute units, K is split across the compute units instead. The
+    /// kernels wait for all dependencies, and the result is ready once all returned events have completed.
+    std::vector<hlslib::ocl::Event> MatrixMultiplicationAsync(const DeviceMatrix& a, const DeviceMatrix& b,
+                                                              DeviceMatrix* result,
+                                                              std::vector<hlslib::ocl::Event> const& dependencies = {});
+
+    /// BLAS-style matrix multiply computing result = alpha * A * B + beta * result. When beta is zero the previous
+    /// contents of the result are never read, so it does not need to be initialized. Scaling factors other than zero
+    /// and one are applied to the result as it is written back, at no cost in passes over the output.
+    void MatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b, DeviceMatrix* result, mpf_srcptr alpha,
+                              mpf_srcptr beta);
+    void MatrixMultiplication(const DeviceMatrix& a, const DeviceMatrix& b, DeviceMatrix* result, mpfr_srcptr alpha,
+                              mpfr_srcptr beta);
+    std::vector<hlslib::ocl::Event> MatrixMultiplicationAsync(const DeviceMatrix& a, const DeviceMatrix& b,
+                                                              DeviceMatrix* result, mpf_srcptr alpha, mpf_srcptr beta,
+                                                              std::vector<hlslib::ocl::Event> const& dependencies = {});
+    std::vector<hlslib::ocl::Event> MatrixMultiplicationAsync(const DeviceMatrix& a, const DeviceMatrix& b,
+                                                              DeviceMatrix* result, mpfr_srcptr alpha,
+                                                              mpfr_srcptr beta,
+                                                              std::vector<hlslib::ocl::Event> const& dependencies = {});
+
+    /// Symmetric rank-k update allocating the output, computing Q = B^T * B for an n x m matrix B. Only the tiles of Q
+    /// holding entries on or below the diagonal are computed, which roughly halves the work of the product. The
+    /// entries above the tiles crossing the diagonal are left uninitialized. All operands must be row-major.
+    DeviceMatrix SymmetricRankK(const DeviceMatrix& b);
+
+    /// Symmetric rank-k update accumulating into the lower triangle of the supplied m x m result, computing
+    /// Q += B^T * B. Entries above the tiles crossing the diagonal are undefined afterwards.
+    void SymmetricRankK(const DeviceMatrix& b, DeviceMatrix* result);
+    std::vector<hlslib::ocl::Event> SymmetricRankKAsync(const DeviceMatrix& b, DeviceMatrix* result,
+                                                        std::vector<hlslib::ocl::Event> const& dependencies = {});
+
+    /// BLAS-style symmetric rank-k update computing the lower triangle of Q = alpha * B^T * B + beta * Q
+    void SymmetricRankK(const DeviceMatrix& b, DeviceMatrix* result, mpf_srcptr alpha, mpf_srcptr beta);
+    void SymmetricRankK(const DeviceMatrix& b, DeviceMatrix* result, mpfr_srcptr alpha, mpfr_srcptr beta);
+    std::vector<hlslib::ocl::Event> SymmetricRankKAsync(const DeviceMatrix& b, DeviceMatrix* result, mpf_srcptr alpha,
+                                                        mpf_srcptr beta,
+                                                        std::vector<hlslib::ocl::Event> const& dependencies = {});
+    std::vector<hlslib::ocl::Event> SymmetricRankKAsync(const DeviceMatrix& b, DeviceMatrix* result,
+                                                        mpfr_srcptr alpha, mpfr_srcptr beta,
+                                                        std::vector<hlslib::ocl::Event> const& dependencies = {});
+
+    /// Matrix-vector multiply allocating the output vector, computing y = A * x for an n x m matrix A and an m x 1
+    /// vector x. With APFP_MATRIX_VECTOR, A is streamed from memory exactly once, which makes the product bound by
+    /// memory bandwidth, so use this rather than MatrixMultiplication whenever B has a single column. Otherwise, it
+    /// runs on the matrix multiplication kernel.
+    DeviceMatrix MatrixVectorMultiplication(const DeviceMatrix& a, const DeviceMatrix& x);
+
+    /// Matrix-vector multiply accumulating into the supplied n x 1 output vector, computing y += A * x. All operands
+    /// must be row-major.
+    void MatrixVectorMultiplication(const DeviceMatrix& a, const DeviceMatrix& x, DeviceMatrix* y);
+
+    /// Matrix-vector multiply computing y += A * x that returns as soon as the kernels have been enqueued. Each compute
+    /// unit computes the rows of y residing in its bank, after x has been gathered into every bank.
+    std::vector<hlslib::ocl::Event> MatrixVectorMultiplicationAsync(
+        const DeviceMatrix& a, const DeviceMatrix& x, DeviceMatrix* y,
+        std::vector<hlslib::ocl::Event> const& dependencies = {});
+
+    /// Reductions over all entries of a matrix, which is usually a vector, into a newly allocated 1 x 1 matrix. Dot
+    /// computes the sum of x * y over matching entries of two matrices of the same shape, and SquaredNorm the sum of
+    /// x * x. Each compute unit streams its shard through a single multiply-accumulate pipeline, so these run at one
+    /// number per cycle per compute unit. Requires the reduction kernel, which is linked with APFP_REDUCTION.
+    DeviceMatrix Dot(const DeviceMatrix& x, const DeviceMatrix& y);
+    DeviceMatrix Sum(const DeviceMatrix& x);
+    DeviceMatrix SquaredNorm(const DeviceMatrix& x);
+
+    /// Reductions into the supplied 1 x 1 result, returning as soon as the kernels have been enqueued. The result is
+    /// overwritten.
+    std::vector<hlslib::ocl::Event> DotAsync(const DeviceMatrix& x, const DeviceMatrix& y, DeviceMatrix* result,
+                                             std::vector<hlslib::ocl::Event> const& dependencies = {});
+    std::vector<hlslib::ocl::Event> SumAsync(const DeviceMatrix& x, DeviceMatrix* result,
+                                             std::vector<hlslib::ocl::Event> const& dependencies = {});
+    std::vector<hlslib::ocl::Event> SquaredNormAsync(const DeviceMatrix& x, DeviceMatrix* result,
+                                                     std::vector<hlslib::ocl::Event> const& dependencies = {});
+
     // Transpose a matrix in place
     void TransposeInPlace(DeviceMatrix* a);
 
     // Transpose a matrix and allocate a new buffer
     DeviceMatrix Transpose(const DeviceMatrix& a);
+
+    /// Transpose a matrix into the supplied output buffer, returning as soon as the kernels have been enqueued
+    std::vector<hlslib::ocl::Event> TransposeAsync(const DeviceMatrix& a, DeviceMatrix* result,
+                                                   std::vector<hlslib::ocl::Event> const& dependencies = {});
+
+    /// Computes C += A * B for row-major matrices in host memory that are too large to fit on the device. The
+    /// problem is split into blocks of at most block_size in each dimension (rounded up to full tiles), and every
+    /// block of C is accumulated on the device over all blocks of the K dimension. The blocks of A and B are double
+    /// buffered, so the next pair is converted and uploaded while the kernels compute on the current pair, and each
+    /// finished block of C is downloaded while the next one is being computed. Roughly 6 * block_size^2 numbers
+    /// are held on the device at a time, plus a replica of each block of B per compute unit when there is more than
+    /// one.
+    void MatrixMultiplicationOutOfCore(const mpf_t* a, const mpf_t* b, mpf_t* c, std::size_t size_n,
+                                       std::size_t size_k, std::size_t size_m, std::size_t block_size);
+    void MatrixMultiplicationOutOfCore(const mpfr_t* a, const mpfr_t* b, mpfr_t* c, std::size_t size_n,
+                                       std::size_t size_k, std::size_t size_m, std::size_t block_size);
+
+    /// Computes the Cholesky factor L of a symmetric positive definite size x size matrix A = L * L^T in host memory,
+    /// with a blocked right-looking factorization. Only the lower triangle of A is read, and L is written to the lower
+    /// triangle of l, with zeros above the diagonal. A stays on the device for the whole factorization. In every step,
+    /// the next diagonal block of at most block_size x block_size numbers is factorized on the host with MPFR, the
+    /// panel below it is solved on the device by multiplying with the inverse transpose of its factor, and the trailing
+    /// matrix is updated with a symmetric rank-k update on the device. Throws std::runtime_error if a diagonal block
+    /// turns out not to be positive definite.
+    void Cholesky(const mpf_t* a, mpf_t* l, std::size_t size, std::size_t block_size);
+    void Cholesky(const mpfr_t* a, mpfr_t* l, std::size_t size, std::size_t block_size);
+
+    /// Allocate a batch of independent matrices with the given (rows, cols) shapes
+    DeviceBatch AllocateDeviceBatch(std::vector<std::pair<std::size_t, std::size_t>> const& shapes);
+
+    /// Computes c[i] += a[i] * b[i] for every matrix in the batches, streaming all of them through a single kernel
+    /// launch per compute unit to avoid per-matrix launch overhead
+    void BatchedMatrixMultiplication(const DeviceBatch& a, const DeviceBatch& b, DeviceBatch* c);
+
+    /// Batched matrix multiply that returns as soon as the kernels have been enqueued
+    std::vector<hlslib::ocl::Event> BatchedMatrixMultiplicationAsync(
+        const DeviceBatch& a, const DeviceBatch& b, DeviceBatch* c,
+        std::vector<hlslib::ocl::Event> const& dependencies = {});
+
+    /// Hits, misses and memory usage of the device buffer pool backing all matrices
+    BufferPool::Statistics BufferPoolStatistics() const;
+
+    /// Free device buffers that are cached for reuse but not held by any matrix
+    void ReleaseCachedBuffers();
 };
 
 /// Helper class to track matrices on the device
 /// We should probably refactor the interface to Apfp to something more controlled?
 class DeviceMatrix {
+    /// Contiguous block of rows stored in the memory bank of a single compute unit
+    struct Shard {
+        std::size_t row_begin;
+        std::size_t row_end;
+        BufferPool::Handle buffer;
+
+        std::size_t rows() const {
+            return row_end - row_begin;
+        }
+    };
+
     std::size_t num_rows_;
     std::size_t num_cols_;
-    hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::readWrite> buffer_;
+    MatrixLayout layout_ = MatrixLayout::kRowMajor;  // Applies to each shard individually
+    std::vector<Shard> shards_;
+
+    // When used as the right-hand operand of a multiplication, every compute unit needs all of the matrix in its own
+    // bank. These replicas are gathered lazily and kept until the matrix is overwritten.
+    mutable std::vector<BufferPool::Handle> replicas_;
+    mutable std::vector<hlslib::ocl::Event> replica_events_;
+
+    // Intermediate buffers of the last operation that wrote this matrix in several steps, such as the slices of A and
+    // the partial results of a split-K multiplication, which must outlive the kernels using them
+    std::vector<BufferPool::Handle> scratch_;
+
+    // Host-side staging buffers must outlive the DMA transfers using them. Every upload packs into a buffer of its
+    // own, which is held by a task waiting for its transfers, so destroying the matrix waits for pending uploads.
+    std::vector<std::future<void>> pending_uploads_;
+    std::shared_ptr<ConversionEngine> converter_;
 
     friend Apfp;
 
     DeviceMatrix() = default;
 
+    /// Record commands reading or writing any of the buffers of this matrix, so that the pool only recycles them once
+    /// these have completed
+    void RecordUse(std::vector<hlslib::ocl::Event> const& events) const;
+
+    /// The given events together with the dependencies of every buffer of this matrix, which commands using the
+    /// buffers must wait for before touching them
+    std::vector<hlslib::ocl::Event> Dependencies(std::vector<hlslib::ocl::Event> events) const;
+
+    /// Transfers read and write the host matrix with a row stride of leading_dimension numbers, which lets blocks of a
+    /// larger host matrix be moved without copying them out first
+    template <typename T>
+    std::vector<hlslib::ocl::Event> TransferToDeviceImpl(T const* buffer_ptr, std::size_t buffer_size,
+                                                         std::size_t leading_dimension,
+                                                         std::vector<hlslib::ocl::Event> const& dependencies);
+
+    template <typename T>
+    std::future<void> TransferToHostImpl(T* buffer_ptr, std::size_t buffer_size, std::size_t leading_dimension,
+                                         std::vector<hlslib::ocl::Event> const& dependencies);
+
    public:
     std::size_t rows() const {
         return num_rows_;
@@ -56,11 +303,99 @@ class DeviceMatrix {
         return num_cols_;
     }
 
+    MatrixLayout layout() const {
+        return layout_;
+    }
+
     /// Transfer from the host to the device
     /// TODO: Make this take input iterators
     void TransferToDevice(const mpf_t* buffer_ptr, std::size_t buffer_size);
+    void TransferToDevice(const mpfr_t* buffer_ptr, std::size_t buffer_size);
+
+    /// Convert the host buffer and enqueue the transfer to the device without waiting for it to complete. The data is
+    /// converted on all cores in chunks, each of which is enqueued as soon as it has been converted, overlapping the
+    /// conversion of the next chunk with its DMA. The source buffer can be reused as soon as this function returns.
+    /// Every call converts into a staging buffer of its own that is kept until its transfers have completed, so further
+    /// uploads into the same matrix can be enqueued right away, but they are only ordered with respect to each other
+    /// through the dependencies.
+    std::vector<hlslib::ocl::Event> TransferToDeviceAsync(const mpf_t* buffer_ptr, std::size_t buffer_size,
+                                                          std::vector<hlslib::ocl::Event> const& dependencies = {});
+    std::vector<hlslib::ocl::Event> TransferToDeviceAsync(const mpfr_t* buffer_ptr, std::size_t buffer_size,
+                                                          std::vector<hlslib::ocl::Event> const& dependencies = {});
 
     /// Transfer from the device to the host
     /// TODO: Make this take output iterators
     void TransferToHost(mpf_t* buffer_ptr, std::size_t buffer_size);
+    void TransferToHost(mpfr_t* buffer_ptr, std::size_t buffer_size);
+
+    /// Enqueue the transfer from the device once all dependencies have completed. The data is transferred in chunks,
+    /// each of which is unpacked on all cores as soon as it has landed while the following chunks are still in flight.
+    /// GMP destinations must have at least the precision of the device numbers. The destination buffer is only valid
+    /// once the returned future is ready.
+    std::future<void> TransferToHostAsync(mpf_t* buffer_ptr, std::size_t buffer_size,
+                                          std::vector<hlslib::ocl::Event> const& dependencies = {});
+    std::future<void> TransferToHostAsync(mpfr_t* buffer_ptr, std::size_t buffer_size,
+                                          std::vector<hlslib::ocl::Event> const& dependencies = {});
+};
+
+/// Collection of independent matrices of individual shapes, used for batched operations on many small matrices. The
+/// matrices assigned to each compute unit (matrix i goes to unit i % kComputeUnits) are stored back to back in a single
+/// buffer in that unit's bank. On the host, the matrices are expected back to back in index order.
+class DeviceBatch {
+    struct Entry {
+        std::size_t rows;
+        std::size_t cols;
+        std::size_t offset;  // In numbers from the start of the buffer of the compute unit
+    };
+
+    std::vector<Entry> entries_;
+    std::vector<std::size_t> unit_sizes_;  // Number of numbers stored on each compute unit
+    std::vector<BufferPool::Handle> buffers_;
+    mutable std::vector<hlslib::ocl::Buffer<BatchDescriptor, hlslib::ocl::Access::read>> descriptor_tables_;
+    StagingBuffer staging_;
+    std::shared_ptr<ConversionEngine> converter_;
+
+    friend Apfp;
+
+    DeviceBatch() = default;
+
+    /// Record commands reading or writing the buffers of this batch, so that the pool only recycles them once these
+    /// have completed
+    void RecordUse(std::vector<hlslib::ocl::Event> const& events) const;
+
+    /// The given events together with the dependencies of the buffers of this batch, which commands using the buffers
+    /// must wait for before touching them
+    std::vector<hlslib::ocl::Event> Dependencies(std::vector<hlslib::ocl::Event> events) const;
+
+    /// Offset of the first number of each matrix in the host-side layout, and of each compute unit in the staging
+    /// buffer
+    void HostOffsets(std::vector<std::size_t>& host_offsets, std::vector<std::size_t>& unit_offsets) const;
+
+    template <typename T>
+    void TransferToDeviceImpl(T const* buffer_ptr, std::size_t buffer_size);
+
+    template <typename T>
+    void TransferToHostImpl(T* buffer_ptr, std::size_t buffer_size);
+
+   public:
+    std::size_t size() const {
+        return entries_.size();
+    }
+
+    std::size_t rows(std::size_t i) const {
+        return entries_[i].rows;
+    }
+
+    std::size_t cols(std::size_t i) const {
+        return entries_[i].cols;
+    }
+
+    /// Total number of entries across all matrices in the batch
+    std::size_t num_elements() const;
+
+    void TransferToDevice(const mpf_t* buffer_ptr, std::size_t buffer_size);
+    void TransferToDevice(const mpfr_t* buffer_ptr, std::size_t buffer_size);
+
+    void TransferToHost(mpf_t* buffer_ptr, std::size_t buffer_size);
+    void TransferToHost(mpfr_t* buffer_ptr, std::size_t buffer_size);
 };
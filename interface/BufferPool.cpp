@@ -0,0 +1,10 @@
+#include "BufferPool.h"
+
+template class BasicBufferPool<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::readWrite>, hlslib::ocl::Event>;
+
+std::shared_ptr<BufferPool> MakeBufferPool(std::shared_ptr<hlslib::ocl::Context> context) {
+    return std::make_shared<BufferPool>([context = std::move(context)](int bank, std::size_t lines) {
+        return context->MakeBuffer<DramLine, hlslib::ocl::Access::readWrite>(hlslib::ocl::StorageType::DDR, bank,
+                                                                             lines);
+    });
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <hlslib/xilinx/OpenCL.h>
+
+#include <memory>
+
+#include "BasicBufferPool.h"
+#include "DeviceTypes.h"
+
+/// Pool of the DRAM buffers backing device matrices, tracking the OpenCL events of the commands using them
+using BufferPool =
+    BasicBufferPool<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::readWrite>, hlslib::ocl::Event>;
+
+// Instantiated once in BufferPool.cpp
+extern template class BasicBufferPool<hlslib::ocl::Buffer<DramLine, hlslib::ocl::Access::readWrite>,
+                                      hlslib::ocl::Event>;
+
+/// Create a pool allocating from the DDR banks of the given context, which the pool keeps alive
+std::shared_ptr<BufferPool> MakeBufferPool(std::shared_ptr<hlslib::ocl::Context> context);
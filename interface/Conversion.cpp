@@ -0,0 +1,94 @@
+#include "Conversion.h"
+
+#include <algorithm>  // std::max, std::min
+#include <future>
+
+ConversionEngine::ConversionEngine(unsigned num_threads) {
+    // hardware_concurrency is allowed to return 0 if it cannot be determined
+    num_threads = std::max(num_threads, 1u);
+    for (unsigned i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(&ConversionEngine::Worker, this);
+    }
+}
+
+ConversionEngine::~ConversionEngine() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+void ConversionEngine::Worker() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (stop_ && tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
+
+void ConversionEngine::ParallelFor(std::size_t count, std::function<void(std::size_t, std::size_t)> const &func) {
+    if (count <= kChunkSize) {
+        // Not worth the round trip through the queue
+        func(0, count);
+        return;
+    }
+    std::vector<std::future<void>> chunks;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (std::size_t begin = 0; begin < count; begin += kChunkSize) {
+            const std::size_t end = std::min(begin + kChunkSize, count);
+            auto task = std::make_shared<std::packaged_task<void()>>([&func, begin, end] { func(begin, end); });
+            chunks.emplace_back(task->get_future());
+            tasks_.emplace([task] { (*task)(); });
+        }
+    }
+    cv_.notify_all();
+    // get() rather than wait() so exceptions thrown by a chunk propagate to the caller
+    for (auto &chunk : chunks) {
+        chunk.get();
+    }
+}
+
+void ConversionEngine::Pack(mpf_t const *source, std::size_t count, PackedFloat *destination) {
+    ParallelFor(count, [source, destination](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            destination[i] = PackedFloat(source[i]);
+        }
+    });
+}
+
+void ConversionEngine::Pack(mpfr_t const *source, std::size_t count, PackedFloat *destination) {
+    ParallelFor(count, [source, destination](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            destination[i] = PackedFloat(source[i]);
+        }
+    });
+}
+
+void ConversionEngine::Unpack(PackedFloat const *source, std::size_t count, mpf_t *destination) {
+    ParallelFor(count, [source, destination](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            source[i].ToGmp(destination[i]);
+        }
+    });
+}
+
+void ConversionEngine::Unpack(PackedFloat const *source, std::size_t count, mpfr_t *destination) {
+    ParallelFor(count, [source, destination](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            source[i].ToMpfr(destination[i]);
+        }
+    });
+}
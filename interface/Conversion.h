@@ -0,0 +1,60 @@
+#pragma once
+#include <gmp.h>
+#include <mpfr.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "PackedFloat.h"
+
+/// Pool of worker threads converting between GMP/MPFR numbers and PackedFloat. Large arrays are split into chunks that
+/// are converted in parallel, writing directly into the destination (typically a DMA staging buffer).
+class ConversionEngine {
+   public:
+    /// Number of numbers converted per task. At 1024 bits this corresponds to 512 KiB, which is large enough to
+    /// amortize scheduling overhead while still balancing well across cores.
+    static constexpr std::size_t kChunkSize = 4096;
+
+    explicit ConversionEngine(unsigned num_threads = std::thread::hardware_concurrency());
+
+    ConversionEngine(ConversionEngine const &) = delete;
+    ConversionEngine(ConversionEngine &&) = delete;
+    ConversionEngine &operator=(ConversionEngine const &) = delete;
+    ConversionEngine &operator=(ConversionEngine &&) = delete;
+
+    ~ConversionEngine();
+
+    /// Convert count GMP numbers into the destination array
+    void Pack(mpf_t const *source, std::size_t count, PackedFloat *destination);
+
+    /// Convert count MPFR numbers into the destination array
+    void Pack(mpfr_t const *source, std::size_t count, PackedFloat *destination);
+
+    /// Convert count packed numbers into the destination GMP array
+    void Unpack(PackedFloat const *source, std::size_t count, mpf_t *destination);
+
+    /// Convert count packed numbers into the destination MPFR array
+    void Unpack(PackedFloat const *source, std::size_t count, mpfr_t *destination);
+
+    std::size_t num_threads() const {
+        return workers_.size();
+    }
+
+    /// Call func(begin, end) for consecutive chunks covering [0, count) on the worker threads, blocking until all
+    /// chunks have been processed
+    void ParallelFor(std::size_t count, std::function<void(std::size_t, std::size_t)> const &func);
+
+   private:
+    void Worker();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};